@@ -0,0 +1,274 @@
+/* Copyright (c) 2008, Matthew W. Jones
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, 
+ *   this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice, 
+ *   this list of conditions and the following disclaimer in the documentation 
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* ProcAn command aggregates */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include "procan.h"
+#include "backend.h"
+#include "instrument.h"
+#include "names.h"
+#include "aggregate.h"
+
+static command_aggregate *aggs = NULL;
+static int naggs = 1;             /* Index 0 is never handed out */
+static int maxaggs = 0;
+static long last_alert = 0;
+
+/* Open addressing hash of aggregate indices keyed by name and uid */
+static int *index_aggs = NULL;
+static unsigned int index_size = 0;
+
+static unsigned int agg_hash(unsigned int name, int uid)
+{
+    return (name * 2654435761U) ^ ((unsigned int)uid * 40503U);
+}
+
+static void index_insert(int agg)
+{
+    unsigned int i = agg_hash(aggs[agg].name, aggs[agg].uid) & (index_size - 1);
+    while (index_aggs[i] != 0)
+        i = (i + 1) & (index_size - 1);
+    index_aggs[i] = agg;
+}
+
+static void grow(void)
+{
+    int a;
+
+    maxaggs = (maxaggs == 0) ? 256 : maxaggs * 2;
+    if ((aggs = realloc(aggs, maxaggs * sizeof(command_aggregate))) == NULL)
+        {
+            printf("malloc error, can not allocate memory.\n");
+            exit(-1);
+        }
+    free(index_aggs);
+    index_size = maxaggs * 2;
+    if ((index_aggs = calloc(index_size, sizeof(int))) == NULL)
+        {
+            printf("malloc error, can not allocate memory.\n");
+            exit(-1);
+        }
+    for (a = 1; a < naggs; a++)
+        index_insert(a);
+}
+
+/* Find the aggregate of a name and uid, adding it if there is room */
+static int find(unsigned int name, int uid)
+{
+    unsigned int i;
+    int a;
+
+    if (index_size > 0)
+        {
+            for (i = agg_hash(name, uid) & (index_size - 1); (a = index_aggs[i]) != 0;
+                 i = (i + 1) & (index_size - 1))
+                {
+                    if (aggs[a].name == name && aggs[a].uid == uid)
+                        return a;
+                }
+        }
+    if (naggs == AGG_MAX)
+        return 0;
+    if (naggs >= maxaggs)
+        grow();
+    a = naggs++;
+    memset(&aggs[a], 0, sizeof(command_aggregate));
+    aggs[a].name = name;
+    aggs[a].uid = uid;
+    index_insert(a);
+    return a;
+}
+
+void agg_join(int slot)
+{
+    proc_averages *pav = &procavs[slot];
+
+    agg_leave(slot);
+    if ((pav->agg = find(pav->name, pav->uid)) == 0)
+        return;
+    aggs[pav->agg].instances++;
+    pav->share_percent = 0;
+    pav->share_size = 0;
+    pav->share_rssize = 0;
+    pav->share_score = 0;
+    pav->share_intrests = 0;
+    agg_update(slot);
+}
+
+void agg_leave(int slot)
+{
+    proc_averages *pav = &procavs[slot];
+    command_aggregate *ca;
+
+    if (pav->agg == 0)
+        return;
+    ca = &aggs[pav->agg];
+    ca->instances--;
+    ca->percent -= pav->share_percent;
+    ca->size -= pav->share_size;
+    ca->rssize -= pav->share_rssize;
+    ca->score -= pav->share_score;
+    ca->intrests -= pav->share_intrests;
+    ca->changed = 1;
+    pav->agg = 0;
+}
+
+void agg_update(int slot)
+{
+    proc_averages *pav = &procavs[slot];
+    command_aggregate *ca;
+
+    if (pav->agg == 0)
+        return;
+    ca = &aggs[pav->agg];
+    ca->percent += hcols.last_percent[slot] - pav->share_percent;
+    ca->size += hcols.last_size[slot] - pav->share_size;
+    ca->rssize += hcols.last_rssize[slot] - pav->share_rssize;
+    ca->score += hcols.intrest_score[slot] - pav->share_score;
+    ca->intrests += pav->num_intrests - pav->share_intrests;
+    ca->changed = 1;
+    pav->share_percent = hcols.last_percent[slot];
+    pav->share_size = hcols.last_size[slot];
+    pav->share_rssize = hcols.last_rssize[slot];
+    pav->share_score = hcols.intrest_score[slot];
+    pav->share_intrests = pav->num_intrests;
+}
+
+void agg_settle(void)
+{
+    command_aggregate *ca;
+    int a;
+
+    for (a = 1; a < naggs; a++)
+        {
+            ca = &aggs[a];
+            if (!ca->changed)
+                continue;
+            ca->changed = 0;
+            if (ca->instances == 0)   /* Keep what was learned for the next instance */
+                continue;
+            if (ca->passes == 0)
+                {
+                    ca->base_percent = ca->percent;
+                    ca->base_rssize = ca->rssize;
+                }
+            else
+                {
+                    ca->base_percent += AGG_LEARN * (ca->percent - ca->base_percent);
+                    ca->base_rssize += AGG_LEARN * (ca->rssize - ca->base_rssize);
+                }
+            ca->passes++;
+        }
+}
+
+command_aggregate* agg_get(int agg)
+{
+    if (agg <= 0 || agg >= naggs)
+        return NULL;
+    return &aggs[agg];
+}
+
+int agg_top(int *order, int max)
+{
+    int a, i, n = 0;
+
+    for (a = 1; a < naggs; a++)
+        {
+            if (aggs[a].instances == 0)
+                continue;
+            if (n < max)
+                i = n++;
+            else if (max > 0 && aggs[order[max-1]].intrests < aggs[a].intrests)
+                i = max - 1;
+            else
+                continue;
+            for (; i > 0 && aggs[order[i-1]].intrests < aggs[a].intrests; i--)
+                order[i] = order[i-1];
+            order[i] = a;
+        }
+    return n;
+}
+
+/* Level an aggregate calls for, only groups of processes are judged
+ * here, a lone process is already alerted on by its own slot.
+ */
+static int judge(procan_config *pc, command_aggregate *ca)
+{
+    if (ca->instances < 2)
+        return 0;
+    if (ca->intrests > pc->alarmlevel)
+        return ALERT_ALARM;
+    if (ca->intrests > pc->warnlevel)
+        return ALERT_WARNING;
+    if (ca->passes >= AGG_WARMUP && ca->base_rssize > 0 &&
+        ca->rssize > AGG_RSS_FACTOR * ca->base_rssize)
+        return ALERT_WARNING;
+    return 0;
+}
+
+void agg_alert(procan_config *pc, long now)
+{
+    command_aggregate *ca;
+    char what[NAME_LEN + 20];
+    char msg[NAME_LEN + 150];
+    int level, a;
+
+    if (now - last_alert < AGG_INTERVAL)
+        return;
+    last_alert = now;
+
+    /* Alerts are worded under procchart_mutex and delivered after it */
+    instr_lock(&procchart_mutex, INSTR_PROCCHART_WAIT);
+    for (a = 1; a < naggs; a++)
+        {
+            ca = &aggs[a];
+            level = judge(pc, ca);
+            if (level > ca->level)
+                {
+                    snprintf(what, NAME_LEN + 20, "command:%s:%i", name_text(ca->name), ca->uid);
+                    snprintf(msg, NAME_LEN + 150, "%i %s processes of uid %i have an interest "
+                             "of %i (resident %lld, usually %lld)",
+                             ca->instances, name_text(ca->name), ca->uid, ca->intrests,
+                             ca->rssize, (long long)ca->base_rssize);
+                }
+            backend_escalate(pc, &ca->level, level, what, ca->intrests, msg);
+        }
+    pthread_mutex_unlock(&procchart_mutex);
+}
+
+void agg_free(void)
+{
+    free(aggs);
+    free(index_aggs);
+    aggs = NULL;
+    index_aggs = NULL;
+    index_size = 0;
+    naggs = 1;
+    maxaggs = 0;
+}
@@ -0,0 +1,63 @@
+/* ProcAn command aggregates
+ * Folds the history slots of every process running the same command as
+ * the same user into one aggregate, so a pool of workers or a daemon
+ * that restarts under new pids is followed as a whole.  Each slot adds
+ * its last sample and interest to its aggregate and takes it back out
+ * when it changes or goes, so keeping them up to date costs O(1) per
+ * slot.  Aggregates are never dropped, the level they learn outlives
+ * the processes that taught it.  Index 0 means no aggregate.  Only
+ * touched with procchart_mutex held.
+ */
+
+#define AGG_MAX 8192                  /* Most aggregates kept */
+#define AGG_INTERVAL 10               /* Seconds between alert checks */
+#define AGG_WARMUP 60                 /* Passes learned before the baseline is trusted */
+#define AGG_LEARN 0.02f               /* Weight of each pass in the baseline */
+#define AGG_RSS_FACTOR 2              /* Times its baseline an aggregate's resident set may reach */
+
+typedef struct
+{
+    unsigned int name;
+    int uid;
+    int instances;            /* Slots following a process of the command now */
+    long long size;           /* Summed over those slots */
+    long long rssize;
+    int percent;
+    int score;
+    int intrests;
+    float base_percent;       /* Learned usual levels of percent and rssize */
+    float base_rssize;
+    int passes;               /* Passes the baseline learned from */
+    int changed;              /* A member changed since the last pass */
+    int level;                /* ALERT_* level last delivered, 0 if none */
+}command_aggregate;
+
+/* Add a freshly set up slot to the aggregate of its command and uid */
+void agg_join(int slot);
+
+/* Take a slot's share out of its aggregate, nothing if it has none */
+void agg_leave(int slot);
+
+/* Bring a slot's share of its aggregate up to date */
+void agg_update(int slot);
+
+/* Let every aggregate that changed in this pass learn from it */
+void agg_settle(void);
+
+/* Fetch an aggregate by index, NULL for 0 or one out of range */
+command_aggregate* agg_get(int agg);
+
+/* Fill order with up to max aggregates that have running instances,
+ * most interesting first.  Returns how many were filled.
+ */
+int agg_top(int *order, int max);
+
+/* Raise warnings and alarms for aggregates of more than one process
+ * whose summed interest passes the levels, or whose resident set left
+ * its baseline far behind.  Called from the analyzer with
+ * pconfig_mutex held.
+ */
+void agg_alert(procan_config *pc, long now);
+
+/* Free every aggregate */
+void agg_free(void);
@@ -29,10 +29,32 @@
 #include <stdlib.h>
 #include <pthread.h>
 #include <sys/time.h>
+#include <sys/types.h>
 #include <string.h>
 #include <unistd.h>
+#include <signal.h>
 #include "procan.h"
 #include "backend.h"
+#include "instrument.h"
+#include "sampler.h"
+#include "ticker.h"
+#include "anomaly.h"
+#include "leak.h"
+#include "cgroup.h"
+#include "oom.h"
+#include "rollup.h"
+#include "pidmap.h"
+#include "expire.h"
+#include "names.h"
+#include "aggregate.h"
+#include "tree.h"
+#include "cgscore.h"
+#include "psi.h"
+#include "io.h"
+#include "counters.h"
+#include "fds.h"
+#include "threads.h"
+#include "churn.h"
 
 /* Globals from procan.c, they are initialized there. */
 extern pthread_mutex_t hangup_mutex;
@@ -41,16 +63,36 @@ extern int m_hangup;
 extern pthread_mutex_t procsnap_mutex;
 extern proc_statistics *procsnap;
 extern int numprocsnap;
+extern pid_t *procgone;
+extern int numprocgone;
+extern cgroup_sample *cgroupsnap;
+extern int numcgroupsnap;
+extern proc_memory memsnap[];
+extern int nummemsnap;
+extern proc_fds *fdsnap;
+extern int numfdsnap;
+extern thread_sample *threadsnap;
+extern int numthreadsnap;
+extern proc_churn *churnsnap;
+extern int numchurnsnap;
+extern long long hostforks;
+extern int churnevents;
 
 extern pthread_mutex_t procchart_mutex;
 extern proc_averages *procavs;
+extern history_columns hcols;
 extern int numprocavs;
+extern pid_t memwant[];
+extern int nummemwant;
+extern pid_t threadwant[];
+extern int numthreadwant;
 
 extern pthread_mutex_t pconfig_mutex;
 extern procan_config *pc;
 extern int *bes;
 
 extern int scriptoutput;
+extern volatile sig_atomic_t m_dumpstats;
 
 /* Write script stdout in pipe mode */
 void script_output(char *type, char *cmd, int lastpid, int movement, int score, int niterests)
@@ -64,29 +106,32 @@ void script_output(char *type, char *cmd, int lastpid, int movement, int score,
     fflush(stdout);
 }
 
-/* Locate a free slot in the procavs list.
- * it can do this by picking the first slot whose process
- * has expired or by picking the first unused slot.
- *
- * By using this mechanism we are able to reuse memory for
- * new processes.
+/* Slots whose history has expired, linked through next_free */
+static int freeslots = -1;
+
+/* Finds the history slot of a pid */
+static pidmap history_index;
+
+/* Slots due for a check against the alert levels, see due_slots() */
+static int *dueslots = NULL;
+static int ndueslots = 0;
+
+/* Locate a free slot in the procavs list, either one whose process
+ * has expired or the next one that was never used.  Returns -1 when
+ * the table is full.
  */
 int get_unused_slot(struct timeval atimev)
 {
     int uuslot = -1;
-    int k;
-    for (k = 0; k < numprocavs; k++)
+
+    if (freeslots >= 0)
         {
-            if (procavs[k].last_measure_time < (atimev.tv_sec - 30))
-                {
-                    uuslot = k;
-                    break;
-                }
+            uuslot = freeslots;
+            freeslots = procavs[uuslot].next_free;
         }
-
     //MAXPROCAVS should be more of an interval for growing
     //the numprocavs space instead of an upper limit.
-    if (uuslot == -1 && numprocavs < MAXPROCAVS)
+    else if (numprocavs < MAXPROCAVS)
         {
             uuslot = numprocavs;
             numprocavs++;
@@ -94,95 +139,863 @@ int get_unused_slot(struct timeval atimev)
     return uuslot;
 }
 
-/* Modify a single proc_averages instance based on a change in score
- * if we are using script output this will also notify. Any other notification
+/* Return a slot to the free list, its command buffer stays with it.
+ * The name, interests and notifications are cleared so walks over the
+ * whole table pass it over like a slot that was never used.
+ */
+static void release_slot(int slot)
+{
+    proc_averages *pav = &procavs[slot];
+
+    if (pidmap_get(&history_index, pav->lastpid) == slot)
+        pidmap_del(&history_index, pav->lastpid);
+    expire_cancel(slot);
+    agg_leave(slot);
+    tree_remove(slot);
+    threads_forget(slot);
+    pav->name = 0;
+    pav->notified = 0;
+    pav->num_intrests = 0;
+    pav->mintrests = 0;
+    pav->pintrests = 0;
+    pav->iintrests = 0;
+    pav->decayed_score = 0;
+    pav->decayed_intrests = 0;
+    pav->decayed_io = 0;
+    pav->io_level = 0;
+    pav->leak_rate = 0;
+    hcols.intrest_score[slot] = 0;
+    procavs[slot].next_free = freeslots;
+    freeslots = slot;
+}
+
+/* Called by the expiry wheel.  Slots are only scheduled when they are
+ * set up or their process exits, a slot that has been measured since
+ * is put back for EXPIRE_IDLE after its last measurement.
+ */
+static void expire_slot(int slot, long now)
+{
+    proc_averages *pav = &procavs[slot];
+    long deadline;
+
+    if (pav->gone_time > 0)
+        deadline = pav->gone_time + EXPIRE_GRACE;
+    else
+        deadline = pav->last_measure_time + EXPIRE_IDLE;
+    if (deadline > now)
+        expire_schedule(slot, deadline);
+    else
+        release_slot(slot);
+}
+
+/* Report a change in a slot's interest score, score is the new value.
+ * If we are using script output this will also notify. Any other notification
  * that needs to be done in the future should be done here.
  */
-void modify_interest(proc_averages *pav, char *type, int change)
+void notify_interest(int slot, char *type, int change, int score)
 {
-    pav->intrest_score = pav->intrest_score + change;
-    pav->mintrests++;
+    procavs[slot].mintrests++;
     if (scriptoutput)
         {
             script_output(type,
-                          pav->command,
-                          pav->lastpid,
+                          (char *)name_text(procavs[slot].name),
+                          procavs[slot].lastpid,
                           change,
-                          pav->intrest_score,
-                          pav->num_intrests);
+                          score,
+                          procavs[slot].num_intrests);
+        }
+}
+
+/* Seconds for scores to decay by half, 0 if they do not decay */
+static long half_life(void)
+{
+    if (pc == NULL || pc->halflife == 0)
+        return DEFAULT_HALF_LIFE * 60;
+    return (pc->halflife < 0) ? 0 : pc->halflife * 60L;
+}
+
+/* Fraction of a score left after dt seconds, 2^(-dt/halflife).  Whole
+ * half-lives are shifts, the rest comes from a short series for
+ * e^(-t) with t = ln 2 * the fraction left over, so libm is not needed.
+ */
+float decay_factor(long dt)
+{
+    long half = half_life();
+    float t;
+    long k;
+
+    if (half == 0 || dt <= 0)
+        return 1;
+    k = dt / half;
+    if (k >= 30)
+        return 0;
+    t = (float)(dt % half) / half * 0.6931472f;
+    return (1 - t + t*t/2 - t*t*t/6 + t*t*t*t/24) / (1L << k);
+}
+
+static int round_decayed(float v)
+{
+    return (v < 0) ? (int)(v - 0.5f) : (int)(v + 0.5f);
+}
+
+/* Scores and interests are kept as floats that decay continuously from
+ * when they were last brought up to date, hcols.intrest_score and
+ * num_intrests hold them rounded.  Flags go once the interests decay
+ * back under the level that raised them, and a slot that has gone
+ * quiet starts its threshold and counters over.
+ */
+void decay_slot(int slot, long now)
+{
+    proc_averages *pav = &procavs[slot];
+    float f;
+
+    if (now <= pav->last_decay_time)
+        return;
+    f = decay_factor(now - pav->last_decay_time);
+    pav->last_decay_time = now;
+    pav->decayed_io *= f;
+    if (pav->decayed_score == 0 && pav->decayed_intrests == 0 && pav->decayed_io == 0)
+        return;
+    pav->decayed_score *= f;
+    pav->decayed_intrests *= f;
+    hcols.intrest_score[slot] = round_decayed(pav->decayed_score);
+    pav->num_intrests = round_decayed(pav->decayed_intrests);
+    if (pc != NULL && pav->num_intrests <= pc->warnlevel)
+        pav->notified &= ~NOTIFY_WARNED;
+    if (pc != NULL && pav->num_intrests <= pc->alarmlevel)
+        pav->notified &= ~NOTIFY_ALARMED;
+    if (hcols.intrest_score[slot] == 0 && pav->num_intrests == 0)
+        {
+            pav->decayed_score = 0;
+            pav->decayed_intrests = 0;
+            pav->decayed_io = 0;
+            pav->mintrests = 0;
+            pav->pintrests = 0;
+            pav->iintrests = 0;
+            hcols.interest_threshold[slot] = DEFAULT_INTEREST_THRESHOLD;
         }
+    agg_update(slot);
+    tree_update(slot);
+}
+
+/* The lower of warnlevel and alarmlevel */
+static int due_level(void)
+{
+    if (pc == NULL)
+        return 0;
+    return (pc->warnlevel < pc->alarmlevel) ? pc->warnlevel : pc->alarmlevel;
 }
 
-void initialize_slot(proc_averages *pav, proc_statistics *pc, long curtime)
+/* Put a slot whose interests just went up in the due list */
+static void mark_due(int slot)
 {
-    //  if (pav->command == NULL)   /* Create an entry for it */
-    //  {
-    if ((pav->command = malloc(25*sizeof(char))) == NULL)
+    if (!procavs[slot].due && procavs[slot].num_intrests > due_level())
         {
-            printf("malloc error, can not allocate memory.\n");
-            exit(-1);
+            procavs[slot].due = 1;
+            dueslots[ndueslots++] = slot;
+        }
+}
+
+int due_slots(int *indcs, long now)
+{
+    int level = due_level();
+    int i, j, slot;
+
+    for (i = 0, j = 0; i < ndueslots; i++)
+        {
+            slot = dueslots[i];
+            decay_slot(slot, now);
+            if (procavs[slot].num_intrests > level || procavs[slot].notified != 0)
+                {
+                    indcs[j] = slot;
+                    dueslots[j++] = slot;
+                }
+            else
+                procavs[slot].due = 0;
         }
-    //  }
-    strncpy(pav->command, pc->_command, 25);
+    ndueslots = j;
+    return j;
+}
+
+/* Hang a slot under the slot of its parent process, if that is tracked.
+ * Parents seen after their children are picked up on the next sample.
+ */
+static void link_parent(int slot, int ppid)
+{
+    int parent = (ppid > 0) ? pidmap_get(&history_index, ppid) : -1;
+
+    if (parent >= 0 && procavs[parent].gone_time > 0)
+        parent = -1;
+    if (parent != tree_parent(slot))
+        tree_attach(slot, parent);
+}
+
+void initialize_slot(int slot, proc_statistics *pc, long curtime)
+{
+    proc_averages *pav = &procavs[slot];
+    pav->name = pc->_name;
     pav->lastpid = pc->_pid;
+    pav->starttime = pc->_starttime;
     pav->uid = pc->_uid;
+    pav->cgroup = pc->_cgroup;
     pav->last_measure_time = curtime;
-    pav->last_interest_time = curtime;
+    pav->last_decay_time = curtime;
+    pav->gone_time = 0;
+    pav->next_free = -1;
+    pav->decayed_score = 0;
+    pav->decayed_intrests = 0;
     pav->num_seen = 1;
-    pav->mov_percent = 0;
-    pav->last_percent = pc->_perc;
-    pav->avg_size_gain = 0;
-    pav->last_size = pc->_size;
-    pav->avg_rssize_gain = 0;
-    pav->last_rssize = pc->_rssize;
     pav->times_measured = 1;
-    pav->ticks_interesting = 0;
-    pav->ticks_since_interesting = 0;
-    pav->intrest_score = 0;
-    pav->interest_threshold = DEFAULT_INTEREST_THRESHOLD;
     pav->num_intrests = 0;
     pav->mintrests = 0;
     pav->pintrests = 0;
-    pav->dwarned = 0;
-    pav->dalarmed = 0;
-    pav->mwarned = 0;
-    pav->malarmed = 0;
-    pav->swarned = 0;
-    pav->salarmed = 0;
+    pav->notified = 0;
+    pav->last_cputime = pc->_cputime;
+    pav->last_sample_time = pc->_sampletime;
+    pav->last_interval = 0;
+    hcols.mov_percent[slot] = 0;
+    hcols.last_percent[slot] = pc->_perc;
+    hcols.avg_size_gain[slot] = 0;
+    hcols.last_size[slot] = pc->_size;
+    hcols.avg_rssize_gain[slot] = 0;
+    hcols.last_rssize[slot] = pc->_rssize;
+    hcols.ticks_interesting[slot] = 0;
+    hcols.ticks_since_interesting[slot] = 0;
+    hcols.intrest_score[slot] = 0;
+    hcols.interest_threshold[slot] = DEFAULT_INTEREST_THRESHOLD;
+    hcols.fresh[slot] = 0;
+    pav->pss = -1;
+    pav->uss = -1;
+    pav->swap = -1;
+    ewma_init(slot, pc);
+    leak_init(slot, pc->_sampletime);
+    io_init(slot, pc);
+    counters_init(slot, pc);
+    fds_init(slot);
+    churn_init(slot);
+    rollup_init(slot);
+    agg_join(slot);
+    tree_init(slot);
+    link_parent(slot, pc->_ppid);
+    tree_update(slot);
+    pidmap_put(&history_index, pav->lastpid, slot);
+    expire_schedule(slot, curtime + EXPIRE_IDLE);
+}
+
+/* The history columns are allocated in multiples of this many slots,
+ * slots past numprocavs are never fresh and score_columns() can skip
+ * the odd ends of the loop.
+ */
+#define HISTORY_LANES 8
+
+static int maxhistory = 0;
+
+void reserve_history(int n)
+{
+    int **cols[] = {&hcols.last_percent, &hcols.last_size, &hcols.last_rssize,
+                    &hcols.mov_percent, &hcols.avg_size_gain, &hcols.avg_rssize_gain,
+                    &hcols.intrest_score, &hcols.interest_threshold,
+                    &hcols.ticks_interesting, &hcols.ticks_since_interesting,
+                    &hcols.fresh, &hcols.new_percent, &hcols.new_size, &hcols.new_rssize,
+                    &hcols.prev_score, &hcols.proc_change, &hcols.mem_change,
+                    &hcols.rss_change, &hcols.above, &hcols.ewma_seen, &hcols.deviating, NULL};
+    float **fcols[] = {&hcols.cpu_mean, &hcols.cpu_var, &hcols.size_mean, &hcols.size_var,
+                       &hcols.rss_mean, &hcols.rss_var, NULL};
+    int i;
+
+    n = (n + HISTORY_LANES - 1) & ~(HISTORY_LANES - 1);
+    if (n <= maxhistory)
+        return;
+    if ((procavs = (proc_averages *) realloc(procavs, n*sizeof(proc_averages))) == NULL)
+        {
+            printf("reserve_history(): malloc error, can not allocate memory.\n");
+            exit(-1);
+        }
+    memset(&procavs[maxhistory], 0, (n - maxhistory)*sizeof(proc_averages));
+    for (i = 0; cols[i] != NULL; i++)
+        {
+            if ((*cols[i] = (int *) realloc(*cols[i], n*sizeof(int))) == NULL)
+                {
+                    printf("reserve_history(): malloc error, can not allocate memory.\n");
+                    exit(-1);
+                }
+            memset(*cols[i] + maxhistory, 0, (n - maxhistory)*sizeof(int));
+        }
+    for (i = 0; fcols[i] != NULL; i++)
+        {
+            if ((*fcols[i] = (float *) realloc(*fcols[i], n*sizeof(float))) == NULL)
+                {
+                    printf("reserve_history(): malloc error, can not allocate memory.\n");
+                    exit(-1);
+                }
+            memset(*fcols[i] + maxhistory, 0, (n - maxhistory)*sizeof(float));
+        }
+    leak_reserve(maxhistory, n);
+    counters_reserve(maxhistory, n);
+    fds_reserve(maxhistory, n);
+    io_reserve(maxhistory, n);
+    churn_reserve(maxhistory, n);
+    expire_reserve(maxhistory, n);
+    rollup_reserve(maxhistory, n);
+    if ((dueslots = (int *) realloc(dueslots, n*sizeof(int))) == NULL)
+        {
+            printf("reserve_history(): malloc error, can not allocate memory.\n");
+            exit(-1);
+        }
+    tree_reserve(maxhistory, n);
+    maxhistory = n;
+}
+
+void free_history(void)
+{
+    free(procavs);
+    free(hcols.last_percent);
+    free(hcols.last_size);
+    free(hcols.last_rssize);
+    free(hcols.mov_percent);
+    free(hcols.avg_size_gain);
+    free(hcols.avg_rssize_gain);
+    free(hcols.intrest_score);
+    free(hcols.interest_threshold);
+    free(hcols.ticks_interesting);
+    free(hcols.ticks_since_interesting);
+    free(hcols.fresh);
+    free(hcols.new_percent);
+    free(hcols.new_size);
+    free(hcols.new_rssize);
+    free(hcols.prev_score);
+    free(hcols.proc_change);
+    free(hcols.mem_change);
+    free(hcols.rss_change);
+    free(hcols.above);
+    free(hcols.cpu_mean);
+    free(hcols.cpu_var);
+    free(hcols.size_mean);
+    free(hcols.size_var);
+    free(hcols.rss_mean);
+    free(hcols.rss_var);
+    free(hcols.ewma_seen);
+    free(hcols.deviating);
+    leak_free();
+    counters_free();
+    fds_free();
+    io_free();
+    threads_free();
+    churn_free();
+    expire_free();
+    pidmap_free(&history_index);
+    freeslots = -1;
+    rollup_free();
+    free(dueslots);
+    dueslots = NULL;
+    ndueslots = 0;
+    agg_free();
+    tree_free();
+    cgscore_free();
+    memset(&hcols, 0, sizeof(hcols));
+    procavs = NULL;
+    numprocavs = 0;
+    maxhistory = 0;
+    nummemwant = 0;
+    numthreadwant = 0;
+}
+
+/* Fold one smaps_rollup figure into a slot, growth and shrinking
+ * count the same way mem and rss do.  Returns the change.
+ */
+static int memory_change(int slot, char *type, long *last, long now)
+{
+    int change = 0;
+
+    if (*last >= 0 && now != *last)
+        {
+            change = (now > *last) ? 1 : -1;
+            procavs[slot].decayed_score += change;
+            hcols.intrest_score[slot] = round_decayed(procavs[slot].decayed_score);
+            notify_interest(slot, type, change, hcols.intrest_score[slot]);
+        }
+    *last = now;
+    return change;
+}
+
+/* Apply the smaps_rollup reads the collector made for the processes
+ * we asked about in memwant.
+ */
+static void apply_memory(long now)
+{
+    int i, j;
+
+    for (i = 0; i < nummemsnap; i++)
+        {
+            j = pidmap_get(&history_index, memsnap[i].pid);
+            if (j < 0 || procavs[j].gone_time > 0)
+                continue;
+            decay_slot(j, now);
+            memory_change(j, "pss", &procavs[j].pss, memsnap[i].pss);
+            memory_change(j, "uss", &procavs[j].uss, memsnap[i].uss);
+            memory_change(j, "swap", &procavs[j].swap, memsnap[i].swap);
+            agg_update(j);
+            tree_update(j);
+        }
+    nummemsnap = 0;
+}
+
+/* Apply the descriptor counts the collector made this cycle */
+static void apply_fds(long now)
+{
+    int i, j, change;
+
+    for (i = 0; i < numfdsnap; i++)
+        {
+            j = pidmap_get(&history_index, fdsnap[i].pid);
+            if (j < 0 || procavs[j].gone_time > 0)
+                continue;
+            if ((change = fds_update(j, fdsnap[i].fds, fdsnap[i].limit)) > 0)
+                {
+                    decay_slot(j, now);
+                    procavs[j].decayed_score += change;
+                    hcols.intrest_score[j] = round_decayed(procavs[j].decayed_score);
+                    notify_interest(j, "fd", change, hcols.intrest_score[j]);
+                    agg_update(j);
+                    tree_update(j);
+                }
+        }
+    numfdsnap = 0;
+}
+
+/* Hand the threads the collector read to the tables of their
+ * processes, the samples of a process come together.
+ */
+static void apply_threads(long now)
+{
+    int i, j, start;
+
+    for (start = 0; start < numthreadsnap; start = i)
+        {
+            for (i = start + 1; i < numthreadsnap && threadsnap[i].pid == threadsnap[start].pid; i++)
+                ;
+            j = pidmap_get(&history_index, threadsnap[start].pid);
+            if (j >= 0 && procavs[j].gone_time == 0)
+                threads_update(j, &threadsnap[start], i - start, now);
+        }
+    numthreadsnap = 0;
+}
+
+/* Ask for the threads of the processes threadprocs names that use
+ * threadcpu percent of a processor or more.  Those asked for before
+ * stay while they are that busy, the slots measured in this pass fill
+ * up the rest.
+ */
+static void choose_threads(int *slots, int nslots)
+{
+    int cpu = (pc != NULL && pc->threadcpu > 0) ? pc->threadcpu : DEFAULT_THREAD_CPU;
+    int i, j, k, n = 0;
+
+    if (pc == NULL || pc->nthreadprocs == 0)
+        {
+            numthreadwant = 0;
+            return;
+        }
+    for (i = 0; i < numthreadwant; i++)
+        {
+            j = pidmap_get(&history_index, threadwant[i]);
+            if (j >= 0 && procavs[j].gone_time == 0 && hcols.last_percent[j] >= cpu)
+                threadwant[n++] = threadwant[i];
+        }
+    for (i = 0; i < nslots && n < MAX_THREAD_PROCS; i++)
+        {
+            j = slots[i];
+            if (hcols.last_percent[j] < cpu || procavs[j].gone_time > 0 ||
+                !threads_wanted(procavs[j].name))
+                continue;
+            for (k = 0; k < n && threadwant[k] != procavs[j].lastpid; k++)
+                ;
+            if (k == n)
+                threadwant[n++] = procavs[j].lastpid;
+        }
+    numthreadwant = n;
+}
+
+/* Count the spawns and exits the collector saw through the proc
+ * connector against their parents, and the host's fork count.
+ */
+static void apply_churn(long now)
+{
+    int i;
+
+    if (hostforks >= 0)
+        churn_host(hostforks, now);
+    for (i = 0; i < numchurnsnap; i++)
+        churn_parent(pidmap_get(&history_index, churnsnap[i].pid),
+                     churnsnap[i].spawns, churnsnap[i].exits, now);
+    numchurnsnap = 0;
+}
+
+/* Give churn interest to the parents that just started spawning too fast */
+static void score_churn(long now)
+{
+    int raised[CHURN_ALERT_MAX];
+    int i, j, n = churn_settle(now, raised, CHURN_ALERT_MAX);
+
+    for (i = 0; i < n; i++)
+        {
+            j = raised[i];
+            decay_slot(j, now);
+            procavs[j].decayed_score += CHURN_SCORE;
+            hcols.intrest_score[j] = round_decayed(procavs[j].decayed_score);
+            notify_interest(j, "churn", CHURN_SCORE, hcols.intrest_score[j]);
+            agg_update(j);
+            tree_update(j);
+        }
+}
+
+/* Does slot a rank above slot b for a smaps_rollup read */
+static int memory_before(int a, int b)
+{
+    if (hcols.intrest_score[a] != hcols.intrest_score[b])
+        return hcols.intrest_score[a] > hcols.intrest_score[b];
+    return hcols.last_rssize[a] > hcols.last_rssize[b];
+}
+
+/* Put a slot into the want list, which is kept sorted best first */
+static int offer_memory(int *top, int ntop, int want, int slot)
+{
+    int i;
+
+    if (ntop == want && !memory_before(slot, top[ntop - 1]))
+        return ntop;
+    for (i = 0; i < ntop; i++)
+        if (top[i] == slot)
+            return ntop;
+    if (ntop < want)
+        ntop++;
+    for (i = ntop - 1; i > 0 && memory_before(slot, top[i - 1]); i--)
+        top[i] = top[i - 1];
+    top[i] = slot;
+    return ntop;
+}
+
+/* Pick the smapstop processes with the highest scores for the collector
+ * to read smaps_rollup of.  Only the last choice and the slots measured
+ * in this pass are looked at, the sampler measures high scorers often.
+ */
+static void choose_memory(int *slots, int nslots)
+{
+    int top[MAX_SMAPS_TOP];
+    int i, j, ntop = 0;
+    int want = (pc != NULL) ? pc->smapstop : 0;
+
+    if (want > MAX_SMAPS_TOP)
+        want = MAX_SMAPS_TOP;
+    if (want <= 0)
+        {
+            nummemwant = 0;
+            return;
+        }
+    for (i = 0; i < nummemwant; i++)
+        {
+            j = pidmap_get(&history_index, memwant[i]);
+            if (j >= 0 && procavs[j].gone_time == 0)
+                ntop = offer_memory(top, ntop, want, j);
+        }
+    for (i = 0; i < nslots; i++)
+        if (procavs[slots[i]].gone_time == 0)
+            ntop = offer_memory(top, ntop, want, slots[i]);
+    for (i = 0; i < ntop; i++)
+        memwant[i] = procavs[top[i]].lastpid;
+    nummemwant = ntop;
 }
 
 int locate_history(int snapoffset)
 {
-    int j = 0;
-    int foundhistory = -1;
-    if (procsnap[snapoffset]._command == NULL )
+    int foundhistory;
+    if (procsnap[snapoffset]._name == 0)
         return -2;
-    pthread_mutex_lock(&procchart_mutex);
 
-    if (should_ignore_proc(procsnap[snapoffset]._command)
+    if (should_ignore_proc(procsnap[snapoffset]._name)
         || should_ignore_uid(procsnap[snapoffset]._uid))
+        return -2;
+    if (procavs == NULL)
+        reserve_history(MAXPROCAVS);
+
+    foundhistory = pidmap_get(&history_index, procsnap[snapoffset]._pid);
+    if (foundhistory >= 0 &&
+        (procavs[foundhistory].gone_time > 0 ||
+         procavs[foundhistory].starttime != procsnap[snapoffset]._starttime))
         {
-            pthread_mutex_unlock(&procchart_mutex);
-            return -2;
+            /* The pid was reused after its process exited, start over */
+            release_slot(foundhistory);
+            foundhistory = -1;
         }
-    if (procavs == NULL)
+    return foundhistory;
+}
+
+/* Pick a where the mask m is all ones and b where it is 0 */
+#define BLEND(m, a, b) (((a) & (m)) | ((b) & ~(m)))
+
+/* The scoring rules.  Processor load that stays up for 5 samples
+ * adds 5, growing or shrinking memory and resident sets move the
+ * score by 1 and the threshold adapts to scores that stay put.
+ *
+ * Every slot is run through the same straight line code and slots
+ * without a new sample just keep their values.  There are no branches
+ * and the columns are padded to HISTORY_LANES, so the compiler can
+ * vectorize the loop even at -O2.
+ */
+static void score_columns(int n, const int * restrict fresh, const int * restrict new_percent,
+                          const int * restrict new_size, const int * restrict new_rssize,
+                          int * restrict last_percent, int * restrict last_size,
+                          int * restrict last_rssize, int * restrict mov_percent,
+                          int * restrict avg_size_gain, int * restrict avg_rssize_gain,
+                          int * restrict intrest_score, int * restrict interest_threshold,
+                          int * restrict ticks_interesting, int * restrict ticks_since_interesting,
+                          int * restrict prev_score, int * restrict proc_change,
+                          int * restrict mem_change, int * restrict rss_change, int * restrict above)
+{
+    int i;
+
+    n = (n + HISTORY_LANES - 1) & ~(HISTORY_LANES - 1);
+    for (i = 0; i < n; i++)
         {
-            if ((procavs = (proc_averages *) malloc(MAXPROCAVS*sizeof(proc_averages))) == NULL)
+            int take = -fresh[i];   /* All ones for a slot with a new sample */
+            int busy = (new_percent[i] > 0) & (last_percent[i] > 0);
+            int idle = (new_percent[i] == 0) & (last_percent[i] == 0);
+            int mov = (mov_percent[i] + busy) * (1 - idle);
+            int bump = (mov >= 5);
+            int sgain = new_size[i] - last_size[i];
+            int rgain = new_rssize[i] - last_rssize[i];
+            int schange = (sgain > 0) - (sgain < 0);
+            int rchange = (rgain > 0) - (rgain < 0);
+            int score = intrest_score[i] - idle * 5 * mov_percent[i] + bump * 5 + schange + rchange;
+            int up = (score > interest_threshold[i]);
+            int tint = (ticks_interesting[i] + 1) * up;
+            int tsince = (ticks_since_interesting[i] + 1) * (1 - up);
+            int thresh = (tsince > ADAPTIVE_THRESHOLD*2) ? score + 1 : interest_threshold[i];
+
+            thresh = (tint > ADAPTIVE_THRESHOLD) ? score + ADAPTIVE_THRESHOLD : thresh;
+            tsince = (tsince > ADAPTIVE_THRESHOLD*2) ? 0 : tsince;
+            mov = mov * (1 - bump);
+
+            prev_score[i] = BLEND(take, intrest_score[i], prev_score[i]);
+            proc_change[i] = take & (bump * 5);
+            mem_change[i] = take & schange;
+            rss_change[i] = take & rchange;
+            above[i] = take & up;
+            mov_percent[i] = BLEND(take, mov, mov_percent[i]);
+            last_percent[i] = BLEND(take, new_percent[i], last_percent[i]);
+            avg_size_gain[i] = BLEND(take, sgain, avg_size_gain[i]);
+            last_size[i] = BLEND(take, new_size[i], last_size[i]);
+            avg_rssize_gain[i] = BLEND(take, rgain, avg_rssize_gain[i]);
+            last_rssize[i] = BLEND(take, new_rssize[i], last_rssize[i]);
+            intrest_score[i] = BLEND(take, score, intrest_score[i]);
+            interest_threshold[i] = BLEND(take, thresh, interest_threshold[i]);
+            ticks_interesting[i] = BLEND(take, tint, ticks_interesting[i]);
+            ticks_since_interesting[i] = BLEND(take, tsince, ticks_since_interesting[i]);
+        }
+}
+
+void score_history(int n)
+{
+    score_columns(n, hcols.fresh, hcols.new_percent, hcols.new_size, hcols.new_rssize,
+                  hcols.last_percent, hcols.last_size, hcols.last_rssize, hcols.mov_percent,
+                  hcols.avg_size_gain, hcols.avg_rssize_gain, hcols.intrest_score,
+                  hcols.interest_threshold, hcols.ticks_interesting,
+                  hcols.ticks_since_interesting, hcols.prev_score, hcols.proc_change,
+                  hcols.mem_change, hcols.rss_change, hcols.above);
+}
+
+/* Pick the sampling tier for a process from how much its score moved
+ * during this pass and how much of the machine it is using.
+ */
+int choose_tier(int slot, int movement)
+{
+    if (movement < 0)
+        movement = -movement;
+    if (movement >= SAMPLE_HOT_MOVEMENT || hcols.intrest_score[slot] > hcols.interest_threshold[slot])
+        return TIER_HOT;
+    if (movement == 0 && hcols.last_percent[slot] == 0 && hcols.last_rssize[slot] < SAMPLE_COLD_RSS)
+        return TIER_COLD;
+    return TIER_WARM;
+}
+
+/* Work out a sample's CPU use in percent from the CPU time it used
+ * since its last sample and how long ago that really was.  Collectors
+ * that measure CPU use themselves leave _cputime at -1.
+ */
+int sample_percent(proc_averages *pav, proc_statistics *ps)
+{
+    unsigned long long elapsed;
+
+    if (ps->_cputime < 0)
+        return ps->_perc;
+    elapsed = ps->_sampletime - pav->last_sample_time;
+    pav->last_interval = elapsed;
+    if (pav->last_cputime < 0 || ps->_cputime < pav->last_cputime
+        || ps->_sampletime <= pav->last_sample_time)
+        return 0;
+    return (int)(((ps->_cputime - pav->last_cputime) * 100000000ULL) / elapsed);
+}
+
+/* Slots that were handed a sample during this pass */
+static int *passslots = NULL;
+static int maxpassslots = 0;
+
+/* Run a single analysis pass over the samples the collector has
+ * published since the last pass, the snapshot is drained afterwards.
+ * Samples are staged into the history columns, scored in one go by
+ * score_history() or score_ewma() and then reported.  The caller must hold procsnap_mutex.
+ */
+void analyze_snapshot(analyzer_times *an_time)
+{
+    int i, j, k, npass = 0;
+    int score, change;
+    float boost;
+
+    if (numprocsnap > maxpassslots)
+        {
+            maxpassslots = numprocsnap + MAXPROCAVS;
+            if ((passslots = (int *) realloc(passslots, maxpassslots*sizeof(int))) == NULL)
                 {
-                    printf("locate_history(): malloc error, can not allocate memory.\n");
+                    printf("malloc error, can not allocate memory.\n");
                     exit(-1);
                 }
         }
+    instr_lock(&procchart_mutex, INSTR_PROCCHART_WAIT);
+    gettimeofday(&an_time->_t, NULL);
+    if (procavs == NULL)
+        reserve_history(MAXPROCAVS);
+    expire_advance(an_time->_t.tv_sec, expire_slot);
+    cgscore_update(cgroupsnap, numcgroupsnap, an_time->_t.tv_sec);
+    numcgroupsnap = 0;
+    apply_churn(an_time->_t.tv_sec);
+    for (i = 0; i < numprocsnap; i++)
+        {
+            int foundhistory = locate_history(i);
+            if (foundhistory == -2) /* Skip this element */
+                continue;
+            else if (foundhistory == -1) /* If it's not found, pick an unused slot */
+                {
+                    int uuslot = get_unused_slot(an_time->atimev);
+                    if (uuslot == -1) //this usually means we are full, which really needs to be fixed.
+                        continue;
+                    initialize_slot(uuslot, &procsnap[i], an_time->_t.tv_sec);
+                    churn_command(procavs[uuslot].agg, 1, 0, an_time->_t.tv_sec);
+                    if (!churnevents)
+                        churn_parent(tree_parent(uuslot), 1, 0, an_time->_t.tv_sec);
+                }
+            else   /* This means we found the history, stage the sample for scoring */
+                {
+                    decay_slot(foundhistory, an_time->_t.tv_sec);
+                    procavs[foundhistory].lastpid = procsnap[i]._pid;
+                    link_parent(foundhistory, procsnap[i]._ppid);
+                    procavs[foundhistory].cgroup = procsnap[i]._cgroup;
+                    procsnap[i]._perc = sample_percent(&procavs[foundhistory], &procsnap[i]);
+                    io_update(foundhistory, &procsnap[i]);
+                    counters_update(foundhistory, &procsnap[i], procavs[foundhistory].last_sample_time);
+                    procavs[foundhistory].last_cputime = procsnap[i]._cputime;
+                    procavs[foundhistory].last_sample_time = procsnap[i]._sampletime;
+                    hcols.new_percent[foundhistory] = procsnap[i]._perc;
+                    hcols.new_size[foundhistory] = procsnap[i]._size;
+                    hcols.new_rssize[foundhistory] = procsnap[i]._rssize;
+                    hcols.fresh[foundhistory] = 1;
+                    passslots[npass++] = foundhistory;
+                }
+        }
+
+    if (pc != NULL && pc->scorer == SCORER_EWMA)
+        score_ewma(passslots, npass);
+    else
+        score_history(numprocavs);
 
-    for (j = 0; j < numprocavs; j++) /* Search for matching history */
+    for (k = 0; k < npass; k++)
         {
-            if (procsnap[snapoffset]._pid == procavs[j].lastpid)
+            j = passslots[k];
+            if (!hcols.fresh[j]) /* Handed to a new process since it was staged */
+                continue;
+            hcols.fresh[j] = 0;
+            score = hcols.intrest_score[j] - hcols.proc_change[j]
+                - hcols.mem_change[j] - hcols.rss_change[j];
+            if (hcols.proc_change[j])
+                {
+                    score = score + hcols.proc_change[j];
+                    notify_interest(j, "proc", hcols.proc_change[j], score);
+                    procavs[j].pintrests++;
+                }
+            if (hcols.mem_change[j])
+                {
+                    score = score + hcols.mem_change[j];
+                    notify_interest(j, "mem", hcols.mem_change[j], score);
+                }
+            if (hcols.rss_change[j])
                 {
-                    foundhistory = j;
-                    break;
+                    score = score + hcols.rss_change[j];
+                    notify_interest(j, "rss", hcols.rss_change[j], score);
                 }
+            if ((change = leak_update(j, procavs[j].last_sample_time, hcols.last_rssize[j])) > 0)
+                {
+                    hcols.intrest_score[j] = hcols.intrest_score[j] + change;
+                    notify_interest(j, "leak", change, hcols.intrest_score[j]);
+                }
+            if (procavs[j].io_change > 0)
+                {
+                    hcols.intrest_score[j] = hcols.intrest_score[j] + procavs[j].io_change;
+                    notify_interest(j, "io", procavs[j].io_change, hcols.intrest_score[j]);
+                    procavs[j].iintrests++;
+                    procavs[j].decayed_io += 1;
+                    procavs[j].io_change = 0;
+                }
+            for (i = 0; i < COUNTER_KINDS; i++)
+                {
+                    if ((change = counters_change(j, i)) != 0)
+                        {
+                            hcols.intrest_score[j] = hcols.intrest_score[j] + change;
+                            notify_interest(j, (char *)counters_name(i), change, hcols.intrest_score[j]);
+                        }
+                }
+            rollup_update(j, an_time->_t.tv_sec, hcols.last_percent[j],
+                          hcols.last_size[j], hcols.last_rssize[j]);
+            procavs[j].decayed_score += hcols.intrest_score[j] - hcols.prev_score[j];
+            if ((boost = psi_boost(procavs[j].cgroup, hcols.proc_change[j],
+                                   hcols.mem_change[j] + hcols.rss_change[j])) > 0)
+                {
+                    /* Growth under pressure counts for more */
+                    procavs[j].decayed_score += boost;
+                    hcols.intrest_score[j] = round_decayed(procavs[j].decayed_score);
+                }
+            procavs[j].decayed_intrests += hcols.above[j];
+            procavs[j].num_intrests = round_decayed(procavs[j].decayed_intrests);
+            mark_due(j);
+            agg_update(j);
+            tree_update(j);
+            procavs[j].times_measured = procavs[j].times_measured + 1;
+            procavs[j].last_measure_time = an_time->_t.tv_sec;
+            sampler_set_tier(procavs[j].lastpid,
+                             choose_tier(j, hcols.intrest_score[j] - hcols.prev_score[j]));
         }
-    return foundhistory;
+    apply_memory(an_time->_t.tv_sec);
+    apply_fds(an_time->_t.tv_sec);
+    apply_threads(an_time->_t.tv_sec);
+    choose_threads(passslots, npass);
+    choose_memory(passslots, npass);
+
+    /* History of processes the collector saw exit is kept for a grace period */
+    for (i = 0; i < numprocgone; i++)
+        {
+            j = pidmap_get(&history_index, procgone[i]);
+            if (j >= 0 && procavs[j].gone_time == 0)
+                {
+                    churn_command(procavs[j].agg, 0, 1, an_time->_t.tv_sec);
+                    if (!churnevents)
+                        churn_parent(tree_parent(j), 0, 1, an_time->_t.tv_sec);
+                    procavs[j].gone_time = an_time->_t.tv_sec;
+                    expire_schedule(j, an_time->_t.tv_sec + EXPIRE_GRACE);
+                }
+        }
+    numprocgone = 0;
+    score_churn(an_time->_t.tv_sec);
+    agg_settle();
+    pthread_mutex_unlock(&procchart_mutex);
+    numprocsnap = 0;
 }
 
 /* Will analyze process data gathered by the collector
@@ -193,92 +1006,34 @@ void* analyzer_thread(void *a)
 {
     int hangup=0;
     int i = 0;
+    int interval = 0;
+    long allocs;
+    unsigned long long start;
     analyzer_times an_time;
+    ticker cadence;
+    int psifds[PSI_MAX_TRIGGERS];
+    int npsifds = 0;
 
+    memset(&an_time, 0, sizeof(an_time));
+    ticker_init(&cadence, INSTR_ANALYZE_INTERVAL);
+    pthread_mutex_lock(&pconfig_mutex);
+    if (pc != NULL)
+        npsifds = psi_triggers(pc, psifds, PSI_MAX_TRIGGERS);
+    pthread_mutex_unlock(&pconfig_mutex);
+    for (i = 0; i < npsifds; i++)   /* A stall starting wakes us early */
+        ticker_watch(&cadence, psifds[i]);
     while (!hangup)  /* Thread Run Loop */
         {
+            allocs = instr_allocs();
             gettimeofday(&an_time.atimev,NULL);
-            pthread_mutex_lock(&procsnap_mutex);
-            for (i = 0; i < numprocsnap; i++)
-                {
-                    int foundhistory = locate_history(i);
-                    if (foundhistory == -2) /* Skip this element */
-                        continue;
-                    else if (foundhistory == -1) /* If it's not found, pick an unused slot */
-                        {
-                            int uuslot = get_unused_slot(an_time.atimev);
-                            if (uuslot == -1) //this usually means we are full, which really needs to be fixed.
-                                continue;
-
-                            gettimeofday(&an_time._t, NULL);
-
-                            initialize_slot(&procavs[uuslot], &procsnap[i], an_time._t.tv_sec);
-                        }
-                    else   /* This means we found the history, now we begin the analysis */
-                        {
-                            procavs[foundhistory].lastpid = procsnap[i]._pid;
-                            if (procsnap[i]._perc > 0 && procavs[foundhistory].last_percent > 0)
-                                procavs[foundhistory].mov_percent++;
-                            else if (procsnap[i]._perc == 0 && procavs[foundhistory].last_percent == 0)
-                                {
-                                    procavs[foundhistory].intrest_score = procavs[foundhistory].intrest_score -
-                                        5 * procavs[foundhistory].mov_percent;
-                                    procavs[foundhistory].mov_percent = 0;
-                                }
-                            if (procavs[foundhistory].mov_percent >= 5)
-                                {
-                                    modify_interest(&procavs[foundhistory],"proc",5);
-                                    procavs[foundhistory].pintrests++;
-                                    procavs[foundhistory].mov_percent = 0;
-                                }
-                            procavs[foundhistory].last_percent = procsnap[i]._perc;
-                            procavs[foundhistory].avg_size_gain = procsnap[i]._size - procavs[foundhistory].last_size;
-                            procavs[foundhistory].last_size = procsnap[i]._size;
-
-                            if (procavs[foundhistory].avg_size_gain > 0)
-                                modify_interest(&procavs[foundhistory], "mem", 1);
-
-                            if (procavs[foundhistory].avg_size_gain < 0)
-                                modify_interest(&procavs[foundhistory],"mem",-1);
-
-                            procavs[foundhistory].avg_rssize_gain = procsnap[i]._rssize - procavs[foundhistory].last_rssize;
-                            procavs[foundhistory].last_rssize = procsnap[i]._rssize;
-                            if (procavs[foundhistory].avg_rssize_gain > 0)
-                                modify_interest(&procavs[foundhistory],"rss",1);
-
-                            if (procavs[foundhistory].avg_rssize_gain < 0)
-                                modify_interest(&procavs[foundhistory],"rss",-1);
-
-                            //some interest calculations related to state changing
-                            if (procavs[foundhistory].intrest_score > procavs[foundhistory].interest_threshold)
-                                {
-                                    procavs[foundhistory].ticks_interesting++;
-                                    procavs[foundhistory].ticks_since_interesting = 0;
-                                    procavs[foundhistory].num_intrests++;
-                                }
-                            else
-                                {
-                                    procavs[foundhistory].ticks_since_interesting+=1;
-                                    procavs[foundhistory].ticks_interesting = 0;
-                                }
-
-                            if (procavs[foundhistory].ticks_since_interesting > ADAPTIVE_THRESHOLD*2)
-                                {
-                                    procavs[foundhistory].interest_threshold = procavs[foundhistory].intrest_score + 1;
-                                    procavs[foundhistory].ticks_since_interesting = 0;
-                                }
-                            if (procavs[foundhistory].ticks_interesting > ADAPTIVE_THRESHOLD)
-                                procavs[foundhistory].interest_threshold = procavs[foundhistory].intrest_score + ADAPTIVE_THRESHOLD;
-
-                            gettimeofday(&an_time._t,NULL);
-                            procavs[foundhistory].times_measured = procavs[foundhistory].times_measured + 1;
-                            procavs[foundhistory].last_measure_time = an_time._t.tv_sec;
-                        }
-
-                    pthread_mutex_unlock(&procchart_mutex);
-                }
+            psi_update();
+            instr_lock(&procsnap_mutex, INSTR_PROCSNAP_WAIT);
+            start = instr_now();
+            analyze_snapshot(&an_time);
+            instr_record(INSTR_ANALYZE_TIME, instr_now() - start);
             pthread_mutex_unlock(&procsnap_mutex);
             pthread_mutex_lock(&pconfig_mutex);
+            start = instr_now();
             for (i = 0; i < 3; i++)    /* Backend Processing at the end of the analysis cycle */
                 {
                     switch (bes[i])
@@ -299,15 +1054,35 @@ void* analyzer_thread(void *a)
                             break;
                         }
                 }
+            forecast_oom(pc, an_time._t.tv_sec);
+            agg_alert(pc, an_time._t.tv_sec);
+            cgscore_alert(pc, an_time._t.tv_sec);
+            psi_alert(pc, an_time._t.tv_sec);
+            io_alert(pc, an_time._t.tv_sec);
+            fds_alert(pc, an_time._t.tv_sec);
+            churn_alert(pc, an_time._t.tv_sec);
+            leak_alert(pc, an_time._t.tv_sec);
+            interval = (pc != NULL) ? pc->interval : 0;
             pthread_mutex_unlock(&pconfig_mutex);
+            backend_flush(bes);
+            instr_record(INSTR_BACKEND_TIME, instr_now() - start);
+            instr_record(INSTR_CYCLE_ALLOCS, instr_allocs() - allocs);
+            if (m_dumpstats)
+                {
+                    m_dumpstats = 0;
+                    instr_syslog();
+                    if (scriptoutput)
+                        instr_pipe();
+                }
             pthread_mutex_lock(&hangup_mutex);
             if(m_hangup)
                 hangup=1;
             pthread_mutex_unlock(&hangup_mutex);
-            perform_housekeeping(an_time._t.tv_sec);
             if (!hangup)
-                sleep(1);
+                ticker_wait(&cadence, cycle_interval(interval) * 1000000ULL);
         }
+    ticker_free(&cadence);
+    psi_free();
     free_config(pc);
     free(bes);
     return NULL;
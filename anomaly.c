@@ -0,0 +1,173 @@
+/* Copyright (c) 2008, Matthew W. Jones
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, 
+ *   this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice, 
+ *   this list of conditions and the following disclaimer in the documentation 
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* ProcAn streaming anomaly scorer */
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include "procan.h"
+#include "aggregate.h"
+#include "anomaly.h"
+
+extern proc_averages *procavs;
+extern history_columns hcols;
+extern procan_config *pc;
+
+/* Statistics of each command, indexed like the aggregates */
+static ewma_stats cmdstats[AGG_MAX];
+
+void ewma_init(int slot, proc_statistics *ps)
+{
+    hcols.cpu_mean[slot] = ps->_perc;
+    hcols.cpu_var[slot] = 0;
+    hcols.size_mean[slot] = ps->_size;
+    hcols.size_var[slot] = 0;
+    hcols.rss_mean[slot] = ps->_rssize;
+    hcols.rss_var[slot] = 0;
+    hcols.ewma_seen[slot] = 1;
+    hcols.deviating[slot] = 0;
+}
+
+/* Fold x into a running mean and variance.  Returns 2 if x sat more
+ * than z standard deviations above the old mean, 1 if it sat more than
+ * one above it and 0 otherwise.  Squares are compared to keep the
+ * square root out of it.
+ */
+static int ewma_update(float x, float *mean, float *var, float z, float mindev, int judge)
+{
+    float d = x - *mean;
+    float spread = (*var > mindev * mindev) ? *var : mindev * mindev;
+    int out = 0;
+
+    if (judge && d > 0 && d * d > spread)
+        out = (d * d > z * z * spread) ? 2 : 1;
+    *mean = *mean + EWMA_ALPHA * d;
+    *var = (1 - EWMA_ALPHA) * (*var + EWMA_ALPHA * d * d);
+    return out;
+}
+
+/* Copy a slot's own statistics to or from the history columns */
+static void load_own(int slot, ewma_stats *es)
+{
+    es->cpu_mean = hcols.cpu_mean[slot];
+    es->cpu_var = hcols.cpu_var[slot];
+    es->size_mean = hcols.size_mean[slot];
+    es->size_var = hcols.size_var[slot];
+    es->rss_mean = hcols.rss_mean[slot];
+    es->rss_var = hcols.rss_var[slot];
+    es->seen = hcols.ewma_seen[slot];
+}
+
+static void store_own(int slot, ewma_stats *es)
+{
+    hcols.cpu_mean[slot] = es->cpu_mean;
+    hcols.cpu_var[slot] = es->cpu_var;
+    hcols.size_mean[slot] = es->size_mean;
+    hcols.size_var[slot] = es->size_var;
+    hcols.rss_mean[slot] = es->rss_mean;
+    hcols.rss_var[slot] = es->rss_var;
+    hcols.ewma_seen[slot] = es->seen;
+}
+
+/* Every metric sitting more than zscore deviations above its mean adds
+ * 1 to the score.  A running mean soon catches up with a step, so
+ * anything staying more than one deviation above it for EWMA_SUSTAINED
+ * samples in a row adds 5 more.  A sample with nothing out of line lets
+ * the score fall back by 1.
+ * The threshold is left where it is, z-scores adapt by themselves.
+ */
+void score_ewma(int *slots, int n)
+{
+    float z = (pc != NULL && pc->zscore > 0) ? pc->zscore : DEFAULT_ZSCORE;
+    int i, j, agg, judge, cpu, mem, rss, bonus, score, up;
+    ewma_stats own, *es;
+
+    for (i = 0; i < n; i++)
+        {
+            j = slots[i];
+            agg = procavs[j].agg;
+            if (agg > 0 && agg < AGG_MAX)
+                es = &cmdstats[agg];
+            else
+                {
+                    load_own(j, &own);
+                    es = &own;
+                }
+            if (es->seen == 0)
+                {
+                    /* The first process of a command starts its statistics */
+                    es->cpu_mean = hcols.new_percent[j];
+                    es->cpu_var = 0;
+                    es->size_mean = hcols.new_size[j];
+                    es->size_var = 0;
+                    es->rss_mean = hcols.new_rssize[j];
+                    es->rss_var = 0;
+                    es->seen = 1;
+                }
+            judge = es->seen >= EWMA_WARMUP;
+            cpu = ewma_update(hcols.new_percent[j], &es->cpu_mean, &es->cpu_var,
+                              z, EWMA_MIN_CPU_DEV, judge);
+            mem = ewma_update(hcols.new_size[j], &es->size_mean, &es->size_var,
+                              z, EWMA_MIN_MEM_DEV * es->size_mean, judge);
+            rss = ewma_update(hcols.new_rssize[j], &es->rss_mean, &es->rss_var,
+                              z, EWMA_MIN_MEM_DEV * es->rss_mean, judge);
+            if (!judge)
+                es->seen++;
+            if (es == &own)
+                store_own(j, &own);
+
+            score = hcols.intrest_score[j];
+            hcols.prev_score[j] = score;
+            if (cpu || mem || rss)
+                hcols.deviating[j]++;
+            else
+                hcols.deviating[j] = 0;
+            cpu = (cpu == 2);
+            mem = (mem == 2);
+            rss = (rss == 2);
+            if (!(cpu || mem || rss) && score > 0)
+                score--;
+            bonus = (hcols.deviating[j] >= EWMA_SUSTAINED) ? 5 : 0;
+            if (bonus)
+                hcols.deviating[j] = 0;
+            hcols.proc_change[j] = cpu + bonus;
+            hcols.mem_change[j] = mem;
+            hcols.rss_change[j] = rss;
+            score = score + cpu + bonus + mem + rss;
+            hcols.intrest_score[j] = score;
+
+            up = (score > hcols.interest_threshold[j]);
+            hcols.above[j] = up;
+            hcols.ticks_interesting[j] = (hcols.ticks_interesting[j] + 1) * up;
+            hcols.ticks_since_interesting[j] = (hcols.ticks_since_interesting[j] + 1) * (1 - up);
+            hcols.mov_percent[j] = hcols.deviating[j];
+            hcols.avg_size_gain[j] = hcols.new_size[j] - hcols.last_size[j];
+            hcols.avg_rssize_gain[j] = hcols.new_rssize[j] - hcols.last_rssize[j];
+            hcols.last_percent[j] = hcols.new_percent[j];
+            hcols.last_size[j] = hcols.new_size[j];
+            hcols.last_rssize[j] = hcols.new_rssize[j];
+        }
+}
@@ -0,0 +1,43 @@
+/* ProcAn streaming anomaly scorer
+ * Keeps an exponentially weighted mean and variance of the CPU use,
+ * virtual size and resident set of every tracked command and raises
+ * the score of a process when its samples sit well above them.  The
+ * statistics belong to the command's aggregate, so every worker of a
+ * pool teaches them and a daemon restarted under a new pid is judged
+ * against what it learned before.  A slot left without an aggregate
+ * keeps its own in the history columns.  Selected with "scorer: ewma"
+ * in the configuration file.
+ */
+
+#define EWMA_ALPHA 0.1f               /* Weight of a new sample, about a 10 sample memory */
+#define EWMA_WARMUP 5                 /* Samples learned before any are judged */
+#define EWMA_SUSTAINED 5              /* Samples in a row over one deviation that earn a bonus */
+#define DEFAULT_ZSCORE 3              /* Standard deviations that make a sample deviate */
+
+/* Smallest standard deviation we judge against, so a process that never
+ * changes is not flagged for growing a single page.
+ */
+#define EWMA_MIN_CPU_DEV 2.0f         /* Percent */
+#define EWMA_MIN_MEM_DEV 0.01f        /* Fraction of the mean */
+
+typedef struct
+{
+    float cpu_mean;
+    float cpu_var;
+    float size_mean;
+    float size_var;
+    float rss_mean;
+    float rss_var;
+    int seen;                 /* Samples folded into the statistics */
+}ewma_stats;
+
+/* Start a slot's own statistics from its first sample, those of its
+ * command are left as they are.
+ */
+void ewma_init(int slot, proc_statistics *ps);
+
+/* Score the n slots listed in slots against their staged samples,
+ * filling the same history columns as score_history().  Nothing is
+ * allocated, the caller must hold procchart_mutex.
+ */
+void score_ewma(int *slots, int n);
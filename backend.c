@@ -35,11 +35,218 @@
 #include <unistd.h>
 #include "procan.h"
 #include "backend.h"
+#include "instrument.h"
+#include "names.h"
+#include "threads.h"
 
 #if defined (linux)
 #define MAXLOGNAME 9
 #endif
 
+/* A warning or alarm waiting to be sent.  Notes are gathered while the
+ * analyzer holds its locks and sent by backend_flush once it has let
+ * them go, since describing a process can wait on its command line.
+ */
+typedef struct
+{
+    int backend;                /* Backend to send it through, 0 for every one */
+    int level;                  /* ALERT_WARNING or ALERT_ALARM */
+    int value;                  /* Handed to scripts in place of the score */
+    pid_t pid;                  /* Process described ahead of msg, 0 for none */
+    char name[NAME_LEN + 1];
+    char detail[80];            /* Leak rate and hottest thread of the process */
+    char what[ALERT_WHAT];      /* Handed to scripts in place of the command */
+    char msg[ALERT_MSG];
+}backend_note;
+
+/* Only the analyzer thread queues and flushes notes */
+static backend_note outbox[OUTBOX_MAX];
+static int noutbox = 0;
+
+/* What sending needs from the configuration, copied as the first note
+ * of a cycle is queued so that flushing does not need pconfig_mutex.
+ */
+static char outbox_mta[PATH_MAX];
+static char outbox_to[PATH_MAX];
+static char outbox_warnscript[PATH_MAX];
+static char outbox_alarmscript[PATH_MAX];
+
+static void outbox_config(procan_config *pc)
+{
+    if (noutbox > 0)
+        return;
+    snprintf(outbox_mta, PATH_MAX, "%s -t %s", pc->mtapath, pc->adminemail);
+    snprintf(outbox_to, PATH_MAX, "%s", pc->adminemail);
+    snprintf(outbox_warnscript, PATH_MAX, "%s", pc->warnscript);
+    snprintf(outbox_alarmscript, PATH_MAX, "%s", pc->alarmscript);
+}
+
+int backend_queue(procan_config *pc, int level, char *what, int value, char *msg)
+{
+    backend_note *bn;
+
+    if (noutbox >= OUTBOX_MAX)
+        return -1;
+    outbox_config(pc);
+    bn = &outbox[noutbox++];
+    bn->backend = 0;
+    bn->level = level;
+    bn->value = value;
+    bn->pid = 0;
+    snprintf(bn->what, ALERT_WHAT, "%s", what);
+    snprintf(bn->msg, ALERT_MSG, "%s", msg);
+    return 0;
+}
+
+void backend_escalate(procan_config *pc, int *level, int newlevel, char *what, int value, char *msg)
+{
+    if (newlevel > *level && backend_queue(pc, newlevel, what, value, msg) != 0)
+        return;   /* Try again next cycle */
+    *level = newlevel;
+}
+
+/* Queue a warning or alarm about a tracked process for one backend,
+ * its command line is looked up when the note is sent.  The caller
+ * must hold pconfig_mutex and procchart_mutex.  Returns -1 if the
+ * outbox is full, try again next cycle.
+ */
+static int queue_proc(procan_config *pc, int backend, int level, int slot, int score)
+{
+    proc_averages *pav = &procavs[slot];
+    thread_table *tt = threads_get(slot);
+    thread_usage *tu;
+    backend_note *bn;
+    int n = 0;
+
+    if (noutbox >= OUTBOX_MAX)
+        return -1;
+    outbox_config(pc);
+    bn = &outbox[noutbox++];
+    bn->backend = backend;
+    bn->level = level;
+    bn->value = score;
+    bn->pid = pav->lastpid;
+    snprintf(bn->name, NAME_LEN + 1, "%s", name_text(pav->name));
+    snprintf(bn->what, ALERT_WHAT, "%s", name_text(pav->name));
+    bn->detail[0] = '\0';
+    if (pav->leak_rate > 0)
+        n = snprintf(bn->detail, 80, " (leaking %lld KB/hour)", pav->leak_rate / 1024);
+    if (tt != NULL && tt->nhot > 0 && n >= 0 && n < 80)
+        {
+            tu = &tt->threads[tt->hot[0]];
+            snprintf(bn->detail + n, 80 - n, " (thread %s [%i] at %i%%)", tu->name, tu->tid, tu->percent);
+        }
+    if (backend == MAIL_BACKEND)
+        snprintf(bn->msg, ALERT_MSG, (level == ALERT_ALARM) ? " has triggered an alarm condition (%d)" :
+                 " has been warned by ProcAn (%d)", score);
+    else
+        snprintf(bn->msg, ALERT_MSG, (level == ALERT_ALARM) ? " has triggered an alarm for being too interesting (%d)" :
+                 " has triggered a warning for being too interesting (%d)", score);
+    return 0;
+}
+
+/* Describe the process of a note, including its full command line
+ * when the collector can get it to us in time, how fast it is leaking
+ * if it looks like it is and its hottest thread if its threads are
+ * followed.  Can wait on the command line, so hold no locks.
+ */
+static void describe_note(backend_note *bn, char *buf, int len)
+{
+    char cmdline[100];
+
+    if (get_cmdline(bn->pid, cmdline, 100) == 0)
+        snprintf(buf, len, "%s [%s]%s", bn->name, cmdline, bn->detail);
+    else
+        snprintf(buf, len, "%s%s", bn->name, bn->detail);
+}
+
+/* Send the text of a note through one backend */
+static int send_note(int backend, backend_note *bn, char *text)
+{
+    FILE *mailpipe;
+    char *script;
+
+    switch (backend)
+        {
+        case SYSLOG_BACKEND:
+            openlog("procan", LOG_CONS, LOG_DAEMON);
+            if (bn->level == ALERT_ALARM)
+                syslog(LOG_ALERT, "ALERT: %s", text);
+            else
+                syslog(LOG_NOTICE, "WARNING: %s", text);
+            closelog();
+            break;
+        case MAIL_BACKEND:
+            {
+                char uname[MAXLOGNAME];
+
+                if ((mailpipe = popen(outbox_mta,"w")) == NULL)
+                    {
+                        printf("Could not send mail with mail backend.\n");
+                        return BACKEND_ERROR;
+                    }
+                getlogin_r(uname, MAXLOGNAME);
+                fprintf(mailpipe, "From: %s\n", uname);
+                fprintf(mailpipe, "To: %s\n", outbox_to);
+                fprintf(mailpipe, "Subject: Procan %s\n", (bn->level == ALERT_ALARM) ? "Alarm" : "Warning");
+                fprintf(mailpipe, "%s", text);
+                pclose(mailpipe);
+            }
+            break;
+        case SCRIPT_BACKEND:
+            script = (bn->level == ALERT_ALARM) ? outbox_alarmscript : outbox_warnscript;
+            if (strcmp(script, "") == 0)
+                return BACKEND_ERROR;
+            pid_t cp = fork();
+            if (cp < 0)
+                return BACKEND_ERROR;
+            if (cp == 0)
+                {
+                    char sargs[PATH_MAX + ALERT_WHAT + 20];
+
+                    snprintf(sargs, PATH_MAX + ALERT_WHAT + 20, "%s 0 %s %d 0", script, bn->what, bn->value);
+                    system(sargs);
+                    _exit(1);
+                }
+            break;
+        default:
+            break;
+        }
+    return BACKEND_NORMAL;
+}
+
+void backend_flush(int *bes)
+{
+    char text[ALERT_MSG + 150];
+    int i, b;
+
+    for (i = 0; i < noutbox; i++)
+        {
+            backend_note *bn = &outbox[i];
+
+            if (bn->pid > 0)
+                {
+                    int n;
+
+                    describe_note(bn, text, 150);
+                    n = strlen(text);
+                    snprintf(text + n, ALERT_MSG + 150 - n, "%s", bn->msg);
+                }
+            else
+                snprintf(text, ALERT_MSG + 150, "%s", bn->msg);
+            for (b = 0; b < 3; b++)
+                {
+                    if (bes[b] == 0 || (bn->backend != 0 && bes[b] != bn->backend))
+                        continue;
+                    if (send_note(bes[b], bn, text) == BACKEND_ERROR)
+                        bes[b] = 0;
+                    if (bn->backend != 0)
+                        break;      /* It was queued by this backend, once */
+                }
+        }
+    noutbox = 0;
+}
+
 /* Syslog backend, LOG_NOTICE might bother some people
  * but it is easier than teaching people how to use syslog
  * in the future I would like to add more syslog configuration
@@ -71,36 +278,22 @@ int syslog_backend(procan_config *pc, struct timeval *schedtime)
             closelog();
         }
 
-    pthread_mutex_lock(&procchart_mutex);
+    instr_lock(&procchart_mutex, INSTR_PROCCHART_WAIT);
     int *inds = (int *)calloc(numprocavs, sizeof(int));
     int n = get_warns(inds, pc, SYSLOG_BACKEND);
-    if (n > 0)
-        openlog("procan", LOG_CONS, LOG_DAEMON);
     for (i = 0; i < n; i++)
         {
-            if (!procavs[inds[i]].dwarned)
-                {
-                    syslog(LOG_NOTICE, "WARNING: %s has triggered a warning for being too interesting (%d)",
-                           procavs[inds[i]].command, procavs[inds[i]].intrest_score);
-                    procavs[inds[i]].dwarned = 1;
-                }
+            if (!(procavs[inds[i]].notified & NOTIFY_DWARNED) &&
+                queue_proc(pc, SYSLOG_BACKEND, ALERT_WARNING, inds[i], hcols.intrest_score[inds[i]]) == 0)
+                procavs[inds[i]].notified |= NOTIFY_DWARNED;
         }
-    if (n > 0)
-        closelog();
     n = get_alarms(inds, pc, SYSLOG_BACKEND);
-    if (n > 0)
-        openlog("procan", LOG_CONS, LOG_DAEMON);
     for (i = 0; i < n; i++)
         {
-            if (!procavs[inds[i]].dalarmed)
-                {
-                    syslog(LOG_ALERT, "ALERT: %s has triggered an alarm for being too interesting (%d)",
-                           procavs[inds[i]].command, procavs[inds[i]].intrest_score           );
-                    procavs[inds[i]].dalarmed = 1;
-                }
+            if (!(procavs[inds[i]].notified & NOTIFY_DALARMED) &&
+                queue_proc(pc, SYSLOG_BACKEND, ALERT_ALARM, inds[i], hcols.intrest_score[inds[i]]) == 0)
+                procavs[inds[i]].notified |= NOTIFY_DALARMED;
         }
-    if (n > 0)
-        closelog();
     pthread_mutex_unlock(&procchart_mutex);
     free(inds);
     return BACKEND_NORMAL;
@@ -153,66 +346,22 @@ int mail_backend(procan_config *pc, struct timeval *schedtime)
                 }
         }
 
-    pthread_mutex_lock(&procchart_mutex);
-    char mta[PATH_MAX];
-
-    snprintf(mta,PATH_MAX,"%s -t %s", pc->mtapath, pc->adminemail);
+    instr_lock(&procchart_mutex, INSTR_PROCCHART_WAIT);
     int *inds = (int *)calloc(numprocavs, sizeof(int));
     int n = get_warns(inds, pc, MAIL_BACKEND);
-    if (n > 0)
-        {
-            if ((mailpipe = popen(mta,"w")) == NULL)
-                {
-                    printf("Could not send mail with mail backend.\n");
-                    free(inds);
-                    pthread_mutex_unlock(&procchart_mutex);
-                    return BACKEND_ERROR;
-                }
-        }
     for (i = 0; i < n; i++)
         {
-            if (!procavs[inds[i]].mwarned)
-                {
-                    char uname[MAXLOGNAME];
-
-                    getlogin_r(uname, MAXLOGNAME);
-                    fprintf(mailpipe, "From: %s\n", uname);
-                    fprintf(mailpipe, "Subject: Procan Warning\n");
-                    fprintf(mailpipe, "%s has been warned by ProcAn (%d)",
-                            procavs[inds[i]].command, procavs[inds[i]].intrest_score);
-                    procavs[inds[i]].mwarned = 1;
-                }
+            if (!(procavs[inds[i]].notified & NOTIFY_MWARNED) &&
+                queue_proc(pc, MAIL_BACKEND, ALERT_WARNING, inds[i], hcols.intrest_score[inds[i]]) == 0)
+                procavs[inds[i]].notified |= NOTIFY_MWARNED;
         }
-    if (n > 0)
-        pclose(mailpipe);
     n = get_alarms(inds, pc, MAIL_BACKEND);
-    if (n > 0)
-        {
-            if ((mailpipe = popen(mta,"w")) == NULL)
-                {
-                    printf("Could not send mail with mail backend.\n");
-                    free(inds);
-                    pthread_mutex_unlock(&procchart_mutex);
-                    return BACKEND_ERROR;
-                }
-        }
     for (i = 0; i < n; i++)
         {
-            if (!procavs[inds[i]].malarmed)
-                {
-                    char uname[MAXLOGNAME];
-
-                    getlogin_r(uname, MAXLOGNAME);
-                    fprintf(mailpipe, "From: %s\n", uname);
-                    fprintf(mailpipe, "To: %s\n", pc->adminemail);
-                    fprintf(mailpipe, "Subject: Procan Alarm\n");
-                    fprintf(mailpipe, "%s has triggered an alarm condition (%d)",
-                            procavs[inds[i]].command, procavs[inds[i]].intrest_score);
-                    procavs[inds[i]].malarmed = 1;
-                }
+            if (!(procavs[inds[i]].notified & NOTIFY_MALARMED) &&
+                queue_proc(pc, MAIL_BACKEND, ALERT_ALARM, inds[i], hcols.intrest_score[inds[i]]) == 0)
+                procavs[inds[i]].notified |= NOTIFY_MALARMED;
         }
-    if (n > 0)
-        pclose(mailpipe);
     pthread_mutex_unlock(&procchart_mutex);
 
     free(inds);
@@ -223,7 +372,7 @@ int mail_backend(procan_config *pc, struct timeval *schedtime)
 int script_backend(procan_config *pc)
 {
     int *inds = (int *)calloc(numprocavs, sizeof(int));
-    pthread_mutex_lock(&procchart_mutex);
+    instr_lock(&procchart_mutex, INSTR_PROCCHART_WAIT);
     int n = get_warns(inds, pc, SCRIPT_BACKEND);
     int i;
     if (n > 0)
@@ -247,15 +396,15 @@ int script_backend(procan_config *pc)
                             snprintf(sargs, 100*sizeof(char), "%s %d %s %d %d",
                                      pc->warnscript,
                                      procavs[inds[i]].lastpid,
-                                     procavs[inds[i]].command,
-                                     procavs[inds[i]].intrest_score,
+                                     name_text(procavs[inds[i]].name),
+                                     hcols.intrest_score[inds[i]],
                                      procavs[inds[i]].num_intrests);
                             system(sargs);
                             _exit(1);
                         }
                     else
                         {
-                            procavs[inds[i]].swarned = 1;
+                            procavs[inds[i]].notified |= NOTIFY_SWARNED;
                             continue;
                         }
                 }
@@ -288,15 +437,15 @@ int script_backend(procan_config *pc)
                             snprintf(sargs, 100*sizeof(char), "%s %d %s %d %d",
                                      pc->alarmscript,
                                      procavs[inds[i]].lastpid,
-                                     procavs[inds[i]].command,
-                                     procavs[inds[i]].intrest_score,
+                                     name_text(procavs[inds[i]].name),
+                                     hcols.intrest_score[inds[i]],
                                      procavs[inds[i]].num_intrests);
                             system(sargs);
                             _exit(1);
                         }
                     else
                         {
-                            procavs[inds[i]].salarmed = 1;
+                            procavs[inds[i]].notified |= NOTIFY_SALARMED;
                             continue;
                         }
                 }
@@ -313,23 +462,28 @@ int script_backend(procan_config *pc)
 int get_warns(int *indcs, procan_config *pc, int backendtype)
 {
     int nwarns = 0;
-    int i;
-    for (i = 0; i < numprocavs; i++)
+    int i, d, ndue;
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    ndue = due_slots(indcs, now.tv_sec);
+    for (d = 0; d < ndue; d++)
         {
+            i = indcs[d];
             if (procavs[i].num_intrests > pc->warnlevel)
                 {
                     switch (backendtype)
                         {
                         case MAIL_BACKEND:
-                            if (procavs[i].mwarned)
+                            if (procavs[i].notified & NOTIFY_MWARNED)
                                 continue;
                             break;
                         case SYSLOG_BACKEND:
-                            if (procavs[i].dwarned)
+                            if (procavs[i].notified & NOTIFY_DWARNED)
                                 continue;
                             break;
                         case SCRIPT_BACKEND:
-                            if (procavs[i].swarned)
+                            if (procavs[i].notified & NOTIFY_SWARNED)
                                 continue;
                             break;
                         default:
@@ -350,23 +504,28 @@ int get_warns(int *indcs, procan_config *pc, int backendtype)
 int get_alarms(int *indcs, procan_config *pc, int backendtype)
 {
     int nalarms = 0;
-    int i;
-    for (i = 0; i < numprocavs; i++)
+    int i, d, ndue;
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    ndue = due_slots(indcs, now.tv_sec);
+    for (d = 0; d < ndue; d++)
         {
+            i = indcs[d];
             if (procavs[i].num_intrests > pc->alarmlevel)
                 {
                     switch (backendtype)
                         {
                         case MAIL_BACKEND:
-                            if (procavs[i].malarmed)
+                            if (procavs[i].notified & NOTIFY_MALARMED)
                                 continue;
                             break;
                         case SYSLOG_BACKEND:
-                            if (procavs[i].dalarmed)
+                            if (procavs[i].notified & NOTIFY_DALARMED)
                                 continue;
                             break;
                         case SCRIPT_BACKEND:
-                            if (procavs[i].salarmed)
+                            if (procavs[i].notified & NOTIFY_SALARMED)
                                 continue;
                             break;
                         default:
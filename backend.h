@@ -1,9 +1,35 @@
+#define OUTBOX_MAX 64                 /* Alerts sent per analysis cycle */
+#define ALERT_WHAT 280                /* Longest subject handed to alert scripts */
+#define ALERT_MSG 400                 /* Longest alert text */
+
 extern pthread_mutex_t procchart_mutex;
 extern proc_averages *procavs;
+extern history_columns hcols;
 extern int numprocavs;
 
 int syslog_backend(procan_config *pc, struct timeval *schedtime);
 int mail_backend(procan_config *pc, struct timeval *schedtime);
 int script_backend(procan_config *pc);
+
+/* Queue an alert that is not tied to a single tracked process (such as
+ * memory running out) for every backend.  what names the subject,
+ * handed to scripts where the command would be, value stands in for
+ * the score.  Called from the analyzer with pconfig_mutex held, and
+ * usually procchart_mutex too, backend_flush sends it once they are
+ * let go.  Returns -1 if the outbox is full.
+ */
+int backend_queue(procan_config *pc, int level, char *what, int value, char *msg);
+
+/* Move *level to newlevel, queueing an alert only when it goes up.  A
+ * level that falls is lowered quietly so the next rise alerts again.
+ * If the outbox is full *level is left for the next cycle to try.
+ */
+void backend_escalate(procan_config *pc, int *level, int newlevel, char *what, int value, char *msg);
+
+/* Send everything queued this cycle through the backends in bes, a
+ * backend that fails is switched off.  Called with no locks held.
+ */
+void backend_flush(int *bes);
+
 int get_warns(int *indcs, procan_config *pc, int backendtype);
 int get_alarms(int *indcs, procan_config *pc, int backendtype);
@@ -0,0 +1,518 @@
+/* Copyright (c) 2007, Matthew W. Jones
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* ProcAn micro-benchmarks
+ * Built and run by "make bench", each benchmark reports the mean ns/op,
+ * the p50/p90/p99 of the individual operations and the number of
+ * allocations made per operation as counted by instrument.c.
+ *
+ * An optional argument caps the table sizes used, the statistics sorts
+ * are quadratic and the 100000 entry runs take minutes.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <pthread.h>
+#include "procan.h"
+#include "cgroup.h"
+#include "linux_collector.h"
+#include "instrument.h"
+#include "anomaly.h"
+#include "names.h"
+
+#define BENCH_BUDGET_NS 500000000LL  /* Time spent on each benchmark */
+#define BENCH_MAX_OPS 100000         /* Upper bound on timed operations */
+#define BENCH_WARMUP 3               /* Untimed operations before measuring */
+
+extern pthread_mutex_t pconfig_mutex;
+extern procan_config *pc;
+extern int scriptoutput;
+extern history_columns hcols;
+
+/* Results go to a copy of the original stdout since the pipe mode
+ * benchmark redirects stdout itself.
+ */
+static FILE *out;
+
+static long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int cmp_ll(const void *a, const void *b)
+{
+    long long x = *(const long long *)a;
+    long long y = *(const long long *)b;
+    return (x > y) - (x < y);
+}
+
+/* Time op() until the budget is used up and print one result line */
+static void run_bench(const char *name, long n, void (*op)(long), long arg)
+{
+    static long long samples[BENCH_MAX_OPS];
+    long long start, total = 0;
+    long allocs;
+    int i, nops = 0;
+
+    start = now_ns();
+    for (i = 0; i < BENCH_WARMUP && now_ns() - start < BENCH_BUDGET_NS; i++)
+        op(arg);
+
+    allocs = instr_allocs();
+    while (nops < BENCH_MAX_OPS && (total < BENCH_BUDGET_NS || nops < 1))
+        {
+            start = now_ns();
+            op(arg);
+            samples[nops] = now_ns() - start;
+            total += samples[nops];
+            nops++;
+        }
+    allocs = instr_allocs() - allocs;
+
+    qsort(samples, nops, sizeof(long long), cmp_ll);
+    fprintf(out, "%-28s %7li %12lli %10lli %10lli %10lli %9.2f %7i\n",
+           name, n, total / nops,
+           samples[nops / 2],
+           samples[(nops * 90) / 100],
+           samples[(nops * 99) / 100],
+           (double)allocs / nops, nops);
+    fflush(out);
+}
+
+/* Synthetic data */
+
+static void free_tables(void)
+{
+    free_history();
+    free(procsnap);
+    procsnap = NULL;
+    numprocsnap = 0;
+}
+
+/* Fill procavs with n synthetic entries */
+static void fake_history(long n)
+{
+    int i;
+    free_tables();
+    reserve_history(n);
+    for (i = 0; i < n; i++)
+        {
+            proc_statistics ps;
+            char command[20];
+
+            memset(&ps, 0, sizeof(ps));
+            snprintf(command, 20, "proc%i", i % 97);
+            ps._name = name_intern(command);
+            ps._pid = 1000 + i;
+            ps._uid = 1000 + (i % 50);
+            initialize_slot(i, &ps, time(NULL));
+            procavs[i].num_intrests = rand() % 300;
+            hcols.intrest_score[i] = rand() % 200 - 50;
+            hcols.interest_threshold[i] = DEFAULT_INTEREST_THRESHOLD;
+        }
+    numprocavs = n;
+}
+
+/* Fill procsnap with n synthetic processes */
+static int nfake = 0;
+
+static void fake_snapshot(long n)
+{
+    int i;
+    char command[20];
+    if (procsnap == NULL)
+        procsnap = calloc(MAXPROCAVS, sizeof(proc_statistics));
+    for (i = 0; i < n; i++)
+        {
+            snprintf(command, 20, "proc%i", i % 97);
+            procsnap[i]._name = name_intern(command);
+            procsnap[i]._pid = 1000 + i;
+            procsnap[i]._uid = 1000 + (i % 50);
+            procsnap[i]._rssize = 1000 + rand() % 100;
+            procsnap[i]._size = 5000 + rand() % 100;
+            procsnap[i]._perc = 0;
+            procsnap[i]._cputime = rand() % 1000;
+            procsnap[i]._sampletime = instr_now();
+            procsnap[i]._read = 0;
+        }
+    numprocsnap = nfake = n;
+}
+
+/* The scoring pass as it was before the history table was split into
+ * columns, one struct per process with every field side by side.  It
+ * is kept here so score_history() can be measured against it.
+ */
+typedef struct
+{
+    char *command;
+    int uid;
+    int lastpid;
+    long last_measure_time;
+    long last_interest_time;
+    int num_seen;
+    int last_seen;
+    int mov_percent;
+    int last_percent;
+    int avg_size_gain;
+    int last_size;
+    int avg_rssize_gain;
+    int last_rssize;
+    int times_measured;
+    int intrest_score;
+    int ticks_interesting;
+    int ticks_since_interesting;
+    int num_intrests;
+    int mintrests;
+    int pintrests;
+    int interest_threshold;
+    int dwarned;
+    int dalarmed;
+    int mwarned;
+    int malarmed;
+    int swarned;
+    int salarmed;
+}legacy_averages;
+
+static legacy_averages *legacy = NULL;
+static proc_statistics *samples = NULL;
+
+static void legacy_modify(legacy_averages *pav, int change)
+{
+    pav->intrest_score = pav->intrest_score + change;
+    pav->mintrests++;
+}
+
+static void legacy_score(legacy_averages *pav, proc_statistics *ps)
+{
+    if (ps->_perc > 0 && pav->last_percent > 0)
+        pav->mov_percent++;
+    else if (ps->_perc == 0 && pav->last_percent == 0)
+        {
+            pav->intrest_score = pav->intrest_score - 5 * pav->mov_percent;
+            pav->mov_percent = 0;
+        }
+    if (pav->mov_percent >= 5)
+        {
+            legacy_modify(pav, 5);
+            pav->pintrests++;
+            pav->mov_percent = 0;
+        }
+    pav->last_percent = ps->_perc;
+    pav->avg_size_gain = ps->_size - pav->last_size;
+    pav->last_size = ps->_size;
+    if (pav->avg_size_gain > 0)
+        legacy_modify(pav, 1);
+    if (pav->avg_size_gain < 0)
+        legacy_modify(pav, -1);
+    pav->avg_rssize_gain = ps->_rssize - pav->last_rssize;
+    pav->last_rssize = ps->_rssize;
+    if (pav->avg_rssize_gain > 0)
+        legacy_modify(pav, 1);
+    if (pav->avg_rssize_gain < 0)
+        legacy_modify(pav, -1);
+    if (pav->intrest_score > pav->interest_threshold)
+        {
+            pav->ticks_interesting++;
+            pav->ticks_since_interesting = 0;
+            pav->num_intrests++;
+        }
+    else
+        {
+            pav->ticks_since_interesting+=1;
+            pav->ticks_interesting = 0;
+        }
+    if (pav->ticks_since_interesting > ADAPTIVE_THRESHOLD*2)
+        {
+            pav->interest_threshold = pav->intrest_score + 1;
+            pav->ticks_since_interesting = 0;
+        }
+    if (pav->ticks_interesting > ADAPTIVE_THRESHOLD)
+        pav->interest_threshold = pav->intrest_score + ADAPTIVE_THRESHOLD;
+    pav->times_measured = pav->times_measured + 1;
+}
+
+/* n samples with a mix of idle, busy, growing and shrinking processes */
+static void fake_samples(long n)
+{
+    int i;
+    free(samples);
+    free(legacy);
+    samples = calloc(n, sizeof(proc_statistics));
+    legacy = calloc(n, sizeof(legacy_averages));
+    for (i = 0; i < n; i++)
+        {
+            samples[i]._perc = (i % 3 == 0) ? rand() % 50 : 0;
+            samples[i]._size = 5000 + rand() % 3;
+            samples[i]._rssize = 1000 + rand() % 3;
+            legacy[i].interest_threshold = DEFAULT_INTEREST_THRESHOLD;
+        }
+}
+
+/* Benchmarked operations */
+
+static void op_score_legacy(long arg)
+{
+    int i;
+    for (i = 0; i < arg; i++)
+        {
+            samples[i]._size ^= 1;
+            legacy_score(&legacy[i], &samples[i]);
+        }
+}
+
+static void op_score_columns(long arg)
+{
+    int i;
+    for (i = 0; i < arg; i++)
+        {
+            samples[i]._size ^= 1;
+            hcols.new_percent[i] = samples[i]._perc;
+            hcols.new_size[i] = samples[i]._size;
+            hcols.new_rssize[i] = samples[i]._rssize;
+            hcols.fresh[i] = 1;
+        }
+    score_history(arg);
+}
+
+static int *ewmaslots = NULL;
+
+static void op_score_ewma(long arg)
+{
+    int i;
+    for (i = 0; i < arg; i++)
+        {
+            samples[i]._size ^= 1;
+            hcols.new_percent[i] = samples[i]._perc;
+            hcols.new_size[i] = samples[i]._size;
+            hcols.new_rssize[i] = samples[i]._rssize;
+            ewmaslots[i] = i;
+        }
+    score_ewma(ewmaslots, arg);
+}
+
+static void op_scan(long arg)
+{
+    collector_scan();
+}
+
+static void op_locate(long arg)
+{
+    procsnap[0]._pid = 1000 + (rand() % arg);
+    pthread_mutex_lock(&procchart_mutex);
+    locate_history(0);
+    pthread_mutex_unlock(&procchart_mutex);
+}
+
+static void op_analyze(long arg)
+{
+    analyzer_times an_time;
+    int i;
+    memset(&an_time, 0, sizeof(an_time));
+    numprocsnap = nfake;
+    for (i = 0; i < numprocsnap; i++)
+        {
+            procsnap[i]._rssize += (rand() % 3) - 1;
+            procsnap[i]._size += (rand() % 3) - 1;
+            procsnap[i]._cputime += rand() % 3;
+            procsnap[i]._sampletime = instr_now();
+        }
+    gettimeofday(&an_time.atimev, NULL);
+    pthread_mutex_lock(&procsnap_mutex);
+    analyze_snapshot(&an_time);
+    pthread_mutex_unlock(&procsnap_mutex);
+}
+
+static void op_statistics(long arg)
+{
+    int *mis = malloc(numprocavs * sizeof(int));
+    int *uis = malloc(numprocavs * sizeof(int));
+    int *numints = malloc(numprocavs * sizeof(int));
+    get_statistics(mis, uis, numints);
+    free(mis);
+    free(uis);
+    free(numints);
+}
+
+static void op_statistics_str(long arg)
+{
+    free(get_statistics_str());
+}
+
+static unsigned int ignore_miss, ignore_hit;
+
+/* The verdict is cached with the name, a new generation makes every
+ * call walk the exclusion list again.
+ */
+static void op_ignore(long arg)
+{
+    pc->generation++;
+    should_ignore_proc((arg & 1) ? ignore_miss : ignore_hit);
+}
+
+static void op_emit(long arg)
+{
+    notify_interest(rand() % numprocavs, "rss", 1, 1);
+}
+
+/* Spawn n idle children so the process scan sees a fixed extra load */
+static pid_t* spawn_children(int n)
+{
+    pid_t *kids = calloc(n + 1, sizeof(pid_t));
+    int i;
+    for (i = 0; i < n; i++)
+        {
+            if ((kids[i] = fork()) == 0)
+                {
+                    pause();
+                    _exit(0);
+                }
+        }
+    return kids;
+}
+
+static void reap_children(pid_t *kids, int n)
+{
+    int i;
+    for (i = 0; i < n; i++)
+        {
+            if (kids[i] > 0)
+                {
+                    kill(kids[i], SIGKILL);
+                    waitpid(kids[i], NULL, 0);
+                }
+        }
+    free(kids);
+}
+
+int main(int argc, char *argv[])
+{
+    long sizes[] = {1000, 10000, 100000};
+    int nexcl[] = {1, 10, 20};          /* The configuration holds at most 20 exclusions */
+    int scans[] = {0, 100, 400};
+    char name[40];
+    long maxsize = 100000;
+    int i, devnull, saved;
+
+    if (argc > 1)
+        maxsize = strtol(argv[1], (char **)NULL, 10);
+
+    srand(1);
+    signal(SIGCHLD, SIG_DFL);
+    pthread_mutex_init(&procsnap_mutex, NULL);
+    pthread_mutex_init(&procchart_mutex, NULL);
+    pthread_mutex_init(&hangup_mutex, NULL);
+    pthread_mutex_init(&pconfig_mutex, NULL);
+    pc = calloc(1, sizeof(procan_config));
+    out = fdopen(dup(STDOUT_FILENO), "w");
+
+    fprintf(out, "%-28s %7s %12s %10s %10s %10s %9s %7s\n",
+           "benchmark", "n", "ns/op", "p50", "p90", "p99", "allocs/op", "ops");
+
+    for (i = 0; i < 3; i++)
+        {
+            pid_t *kids = spawn_children(scans[i]);
+            collector_scan();
+            run_bench("collector_scan", numprocsnap, op_scan, 0);
+            reap_children(kids, scans[i]);
+        }
+    free_tables();
+
+    for (i = 0; i < 2 && sizes[i] <= maxsize; i++)
+        {
+            fake_history(sizes[i]);
+            fake_snapshot(1);
+            run_bench("locate_history", sizes[i], op_locate, sizes[i]);
+        }
+    free_tables();
+
+    for (i = 1; i < 3 && sizes[i] <= maxsize; i++)
+        {
+            fake_history(sizes[i]);
+            fake_samples(sizes[i]);
+            run_bench("score_legacy", sizes[i], op_score_legacy, sizes[i]);
+            run_bench("score_history", sizes[i], op_score_columns, sizes[i]);
+            ewmaslots = realloc(ewmaslots, sizes[i] * sizeof(int));
+            run_bench("score_ewma", sizes[i], op_score_ewma, sizes[i]);
+        }
+    free(samples);
+    free(legacy);
+    free(ewmaslots);
+    free_tables();
+
+    fake_snapshot(MAXPROCAVS - 1);
+    op_analyze(0);
+    run_bench("analyze_snapshot", nfake, op_analyze, 0);
+    free_tables();
+
+    for (i = 0; i < 3 && sizes[i] <= maxsize; i++)
+        {
+            fake_history(sizes[i]);
+            run_bench("get_statistics", sizes[i], op_statistics, 0);
+            run_bench("get_statistics_str", sizes[i], op_statistics_str, 0);
+        }
+
+    for (i = 0; i < 3; i++)
+        {
+            int j, n = nexcl[i];
+            for (j = 0; j < n; j++)
+                snprintf(pc->exclusions[j], 20, "excl%i", j);
+            strncpy(pc->exclusions[n - 1], "proc", 20);   /* The last entry is what proc42 hits */
+            pc->nclusions = n;
+            ignore_miss = name_intern("zzzz-not-excluded");
+            ignore_hit = name_intern("proc42");
+            snprintf(name, 40, "should_ignore_proc/miss");
+            run_bench(name, n, op_ignore, 1);
+            snprintf(name, 40, "should_ignore_proc/hit");
+            run_bench(name, n, op_ignore, 0);
+        }
+
+    /* Pipe mode writes to stdout, send it somewhere harmless */
+    fake_history(1000);
+    fflush(stdout);
+    saved = dup(STDOUT_FILENO);
+    devnull = open("/dev/null", O_WRONLY);
+    dup2(devnull, STDOUT_FILENO);
+    scriptoutput = 1;
+    run_bench("pipe_mode_emit", 1, op_emit, 0);
+    scriptoutput = 0;
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(devnull);
+    close(saved);
+    free_tables();
+
+    free(pc);
+    fclose(out);
+    return 0;
+}
@@ -0,0 +1,524 @@
+/* Copyright (c) 2008, Matthew W. Jones
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, 
+ *   this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice, 
+ *   this list of conditions and the following disclaimer in the documentation 
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* ProcAn system memory and cgroup access */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <dirent.h>
+#include "cgroup.h"
+#include "pidmap.h"
+#include "instrument.h"
+
+#if defined (linux)
+static pthread_mutex_t cgroup_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Interned directories, id i lives at cgdirs[i].  cgbucket holds the
+ * first id of each hash chain and cgnext the id after it.
+ */
+static char *cgdirs[CGROUP_MAX + 1];
+static char *cgretired[CGROUP_MAX + 1];   /* What cgdirs held before the id was reused */
+static unsigned int cghash[CGROUP_MAX + 1];
+static unsigned int cgbucket[CGROUP_HASH];
+static unsigned int cgnext[CGROUP_MAX + 1];
+static unsigned int cgserial[CGROUP_MAX + 1];
+static unsigned int ncgroups = 1;   /* Id 0 is never handed out */
+
+/* Ids with no processes, when they were first seen empty and a list
+ * of those empty for CGROUP_REUSE seconds.  An id on the list that
+ * got processes back is skipped when it comes off.
+ */
+static unsigned long long cgempty[CGROUP_MAX + 1];
+static unsigned int cgspare[CGROUP_MAX];
+static int cgspared[CGROUP_MAX + 1];
+static int ncgspare = 0;
+
+/* The collector's cache of pid to cgroup id, when each pid was last
+ * read and how many cached pids each cgroup has.
+ */
+static pidmap pid_cgroup;
+static pidmap pid_checked;
+static int cgmembers[CGROUP_MAX + 1];
+
+int read_meminfo(long long *total, long long *available)
+{
+    FILE *meminfo;
+    char line[100];
+    long long kb;
+    int found = 0;
+
+    if ((meminfo = fopen("/proc/meminfo", "r")) == NULL)
+        return -1;
+    while (found != 3 && fgets(line, 100, meminfo) != NULL)
+        {
+            if (sscanf(line, "MemTotal: %lld", &kb) == 1)
+                {
+                    *total = kb * 1024;
+                    found |= 1;
+                }
+            else if (sscanf(line, "MemAvailable: %lld", &kb) == 1)
+                {
+                    *available = kb * 1024;
+                    found |= 2;
+                }
+        }
+    fclose(meminfo);
+    return (found == 3) ? 0 : -1;
+}
+
+/* /proc/pid/cgroup has a hierarchy-id:controllers:path line per
+ * hierarchy.  A v1 memory controller wins, otherwise the unified (v2)
+ * hierarchy's "0::" line is used.
+ */
+int cgroup_of(int pid, char *dir, int len)
+{
+    FILE *cgfile;
+    char path[40];
+    char line[CGROUP_PATH_LEN + 40];
+    char *controllers, *cgpath, *nl;
+    int found = 0;
+
+    snprintf(path, 40, "/proc/%d/cgroup", pid);
+    if ((cgfile = fopen(path, "r")) == NULL)
+        return -1;
+    while (fgets(line, CGROUP_PATH_LEN + 40, cgfile) != NULL)
+        {
+            if ((controllers = strchr(line, ':')) == NULL ||
+                (cgpath = strchr(controllers + 1, ':')) == NULL)
+                continue;
+            *cgpath++ = '\0';
+            controllers++;
+            if ((nl = strchr(cgpath, '\n')) != NULL)
+                *nl = '\0';
+            if (strcmp(controllers, "memory") == 0 || strncmp(controllers, "memory,", 7) == 0
+                || strstr(controllers, ",memory") != NULL)
+                {
+                    snprintf(dir, len, "%s/memory%s", CGROUP_ROOT, cgpath);
+                    found = 2;
+                    break;
+                }
+            if (controllers[0] == '\0' && !found)
+                {
+                    snprintf(dir, len, "%s%s", CGROUP_ROOT, cgpath);
+                    found = 1;
+                }
+        }
+    fclose(cgfile);
+    return found ? 0 : -1;
+}
+
+/* Read a single number (or "max") from a cgroup file */
+static int read_cgroup_value(const char *dir, const char *file, long long *value)
+{
+    FILE *cgfile;
+    char path[CGROUP_PATH_LEN + 40];
+    char text[40];
+
+    snprintf(path, CGROUP_PATH_LEN + 40, "%s/%s", dir, file);
+    if ((cgfile = fopen(path, "r")) == NULL)
+        return -1;
+    if (fgets(text, 40, cgfile) == NULL)
+        {
+            fclose(cgfile);
+            return -1;
+        }
+    fclose(cgfile);
+    if (strncmp(text, "max", 3) == 0)
+        *value = -1;
+    else
+        *value = strtoll(text, (char **)NULL, 10);
+    return 0;
+}
+
+int cgroup_memory(const char *dir, long long *limit, long long *usage)
+{
+    long long total, available;
+
+    if (read_cgroup_value(dir, "memory.max", limit) == 0 &&
+        read_cgroup_value(dir, "memory.current", usage) == 0)
+        return 0;
+    if (read_cgroup_value(dir, "memory.limit_in_bytes", limit) == 0 &&
+        read_cgroup_value(dir, "memory.usage_in_bytes", usage) == 0)
+        {
+            /* v1 spells "no limit" as a number near LLONG_MAX */
+            if (read_meminfo(&total, &available) == 0 && *limit >= total)
+                *limit = -1;
+            return 0;
+        }
+    return -1;
+}
+
+int cgroup_limited(char *dir, long long *limit, long long *usage)
+{
+    size_t root = strlen(CGROUP_ROOT);
+    char *cut;
+
+    if (strncmp(dir, CGROUP_ROOT, root) != 0)
+        return -1;
+    while (strlen(dir) > root)
+        {
+            if ((cut = strrchr(dir, '/')) != NULL && cut[1] == '\0')
+                {
+                    *cut = '\0';   /* The root of a hierarchy ends in a slash */
+                    continue;
+                }
+            if (cgroup_memory(dir, limit, usage) != 0)
+                return -1;
+            if (*limit >= 0)
+                return 0;
+            if (cut == NULL || (size_t)(cut - dir) < root)
+                break;
+            *cut = '\0';
+        }
+    return -1;
+}
+
+static unsigned int dir_hash(const char *dir)
+{
+    unsigned int h = 2166136261U;   /* FNV-1a */
+    while (*dir)
+        h = (h ^ (unsigned char)*dir++) * 16777619U;
+    return h;
+}
+
+/* Take an id that has been empty long enough off the spare list and
+ * unhook it from its chain.  Returns 0 if there is none.
+ */
+static unsigned int reuse_id(void)
+{
+    unsigned int id, *link;
+
+    while (ncgspare > 0)
+        {
+            id = cgspare[--ncgspare];
+            cgspared[id] = 0;
+            if (cgmembers[id] > 0 || cgempty[id] == 0)
+                continue;   /* It got processes back */
+            for (link = &cgbucket[cghash[id] & (CGROUP_HASH - 1)]; *link != id; link = &cgnext[*link])
+                ;
+            *link = cgnext[id];
+            free(cgretired[id]);
+            cgretired[id] = cgdirs[id];
+            cgempty[id] = 0;
+            cgserial[id]++;
+            return id;
+        }
+    return 0;
+}
+
+unsigned int cgroup_intern(const char *dir)
+{
+    unsigned int h = dir_hash(dir);
+    unsigned int id;
+    char *copy;
+
+    pthread_mutex_lock(&cgroup_mutex);
+    for (id = cgbucket[h & (CGROUP_HASH - 1)]; id != 0; id = cgnext[id])
+        {
+            if (cghash[id] == h && strcmp(cgdirs[id], dir) == 0)
+                {
+                    pthread_mutex_unlock(&cgroup_mutex);
+                    return id;
+                }
+        }
+    if (ncgroups <= CGROUP_MAX)
+        id = ncgroups++;
+    else if ((id = reuse_id()) == 0)
+        {
+            pthread_mutex_unlock(&cgroup_mutex);
+            return 0;
+        }
+    if ((copy = strdup(dir)) == NULL)
+        {
+            printf("malloc error, can not allocate memory.\n");
+            exit(-1);
+        }
+    cgdirs[id] = copy;
+    cghash[id] = h;
+    cgnext[id] = cgbucket[h & (CGROUP_HASH - 1)];
+    cgbucket[h & (CGROUP_HASH - 1)] = id;
+    pthread_mutex_unlock(&cgroup_mutex);
+    return id;
+}
+
+const char* cgroup_dir(unsigned int id)
+{
+    if (id == 0 || id > CGROUP_MAX || cgdirs[id] == NULL)
+        return "";
+    return cgdirs[id];
+}
+
+unsigned int cgroup_lookup(int pid, long now)
+{
+    char dir[CGROUP_PATH_LEN];
+    int id = pidmap_get(&pid_cgroup, pid);
+    int newid;
+
+    if (id >= 0 && now - pidmap_get(&pid_checked, pid) < CGROUP_RECHECK)
+        return id;
+    newid = (cgroup_of(pid, dir, CGROUP_PATH_LEN) == 0) ? cgroup_intern(dir) : 0;
+    if (id != newid)
+        {
+            if (id > 0)
+                cgmembers[id]--;
+            if (newid > 0 && cgmembers[newid]++ == 0)
+                cgempty[newid] = 0;
+            pidmap_put(&pid_cgroup, pid, newid);
+        }
+    pidmap_put(&pid_checked, pid, (int)now);
+    return newid;
+}
+
+void cgroup_forget(int pid)
+{
+    int id = pidmap_get(&pid_cgroup, pid);
+
+    if (id < 0)
+        return;
+    if (id > 0)
+        cgmembers[id]--;
+    pidmap_del(&pid_cgroup, pid);
+    pidmap_del(&pid_checked, pid);
+}
+
+int read_pressure(const char *path, float *some, float *full)
+{
+    FILE *psfile;
+    char line[120];
+
+    *some = -1;
+    *full = -1;
+    if ((psfile = fopen(path, "r")) == NULL)
+        return -1;
+    while (fgets(line, 120, psfile) != NULL)
+        {
+            if (sscanf(line, "some avg10=%f", some) != 1)
+                sscanf(line, "full avg10=%f", full);
+        }
+    fclose(psfile);
+    return (*some < 0) ? -1 : 0;
+}
+
+/* Read the keyed counters of cpu.stat and memory.events */
+static void read_counters(const char *dir, cgroup_sample *cs)
+{
+    FILE *cgfile;
+    char path[CGROUP_PATH_LEN + 40];
+    char line[120];
+    char key[40];
+    long long value;
+
+    snprintf(path, CGROUP_PATH_LEN + 40, "%s/cpu.stat", dir);
+    if ((cgfile = fopen(path, "r")) != NULL)
+        {
+            while (fgets(line, 120, cgfile) != NULL)
+                {
+                    if (sscanf(line, "usage_usec %lld", &value) == 1)
+                        {
+                            cs->cpu_usec = value;
+                            break;
+                        }
+                }
+            fclose(cgfile);
+        }
+    snprintf(path, CGROUP_PATH_LEN + 40, "%s/memory.events", dir);
+    if ((cgfile = fopen(path, "r")) != NULL)
+        {
+            while (fgets(line, 120, cgfile) != NULL)
+                {
+                    if (sscanf(line, "%39s %lld", key, &value) != 2)
+                        continue;
+                    if (strcmp(key, "high") == 0 || strcmp(key, "max") == 0)
+                        cs->high_events += value;
+                    else if (strcmp(key, "oom_kill") == 0)
+                        cs->oom_kills = value;
+                }
+            fclose(cgfile);
+        }
+}
+
+/* Walk a cgroup directory and the ones below it */
+static int walk_procs(const char *dir, void (*add)(int pid))
+{
+    char path[CGROUP_PATH_LEN + 20];
+    FILE *procs;
+    DIR *cgdir;
+    struct dirent *ent;
+    int pid;
+
+    snprintf(path, CGROUP_PATH_LEN + 20, "%s/cgroup.procs", dir);
+    if ((procs = fopen(path, "r")) == NULL)
+        return -1;
+    while (fscanf(procs, "%d", &pid) == 1)
+        add(pid);
+    fclose(procs);
+    if ((cgdir = opendir(dir)) == NULL)
+        return 0;
+    while ((ent = readdir(cgdir)) != NULL)
+        {
+            if (ent->d_type != DT_DIR || ent->d_name[0] == '.')
+                continue;
+            if (snprintf(path, CGROUP_PATH_LEN, "%s/%s", dir, ent->d_name) < CGROUP_PATH_LEN)
+                walk_procs(path, add);
+        }
+    closedir(cgdir);
+    return 0;
+}
+
+int cgroup_procs(const char *dir, void (*add)(int pid))
+{
+    char path[CGROUP_PATH_LEN];
+
+    if (strncmp(dir, CGROUP_ROOT, strlen(CGROUP_ROOT)) == 0)
+        snprintf(path, CGROUP_PATH_LEN, "%s", dir);
+    else
+        snprintf(path, CGROUP_PATH_LEN, "%s/%s", CGROUP_ROOT, (dir[0] == '/') ? dir + 1 : dir);
+    return walk_procs(path, add);
+}
+
+int cgroup_sample_all(cgroup_sample *samples, int max)
+{
+    static const char *pressure_files[PRESSURE_KINDS] = {"cpu.pressure", "memory.pressure", "io.pressure"};
+    char path[CGROUP_PATH_LEN + 40];
+    cgroup_sample *cs;
+    unsigned int id;
+    unsigned long long now = instr_now();
+    float full;
+    int n = 0, k;
+
+    for (id = 1; id < ncgroups && n < max; id++)
+        {
+            if (cgmembers[id] <= 0)
+                {
+                    if (cgempty[id] == 0)
+                        cgempty[id] = now;
+                    else if (!cgspared[id] && now - cgempty[id] > CGROUP_REUSE * 1000000000ULL)
+                        {
+                            pthread_mutex_lock(&cgroup_mutex);
+                            cgspare[ncgspare++] = id;
+                            cgspared[id] = 1;
+                            pthread_mutex_unlock(&cgroup_mutex);
+                        }
+                    continue;
+                }
+            cs = &samples[n++];
+            memset(cs, 0, sizeof(cgroup_sample));
+            cs->id = id;
+            cs->serial = cgserial[id];
+            cs->members = cgmembers[id];
+            cs->sampletime = instr_now();
+            cs->cpu_usec = -1;
+            if (cgroup_memory(cgdirs[id], &cs->limit, &cs->usage) != 0)
+                {
+                    cs->limit = -1;
+                    cs->usage = -1;
+                }
+            read_counters(cgdirs[id], cs);
+            for (k = 0; k < PRESSURE_KINDS; k++)
+                {
+                    snprintf(path, CGROUP_PATH_LEN + 40, "%s/%s", cgdirs[id], pressure_files[k]);
+                    read_pressure(path, &cs->pressure[k], &full);
+                }
+        }
+    return n;
+}
+
+void cgroup_free(void)
+{
+    unsigned int id;
+
+    for (id = 1; id < ncgroups; id++)
+        {
+            free(cgdirs[id]);
+            free(cgretired[id]);
+            cgdirs[id] = NULL;
+            cgretired[id] = NULL;
+        }
+    ncgroups = 1;
+    ncgspare = 0;
+    memset(cgmembers, 0, sizeof(cgmembers));
+    memset(cgempty, 0, sizeof(cgempty));
+    memset(cgspared, 0, sizeof(cgspared));
+    memset(cgbucket, 0, sizeof(cgbucket));
+    pidmap_free(&pid_cgroup);
+    pidmap_free(&pid_checked);
+}
+#else
+int read_meminfo(long long *total, long long *available)
+{
+    return -1;
+}
+
+int read_pressure(const char *path, float *some, float *full)
+{
+    *some = -1;
+    *full = -1;
+    return -1;
+}
+
+int cgroup_of(int pid, char *dir, int len)
+{
+    return -1;
+}
+
+int cgroup_memory(const char *dir, long long *limit, long long *usage)
+{
+    return -1;
+}
+
+unsigned int cgroup_intern(const char *dir)
+{
+    return 0;
+}
+
+const char* cgroup_dir(unsigned int id)
+{
+    return "";
+}
+
+unsigned int cgroup_lookup(int pid, long now)
+{
+    return 0;
+}
+
+void cgroup_forget(int pid)
+{
+}
+
+int cgroup_procs(const char *dir, void (*add)(int pid))
+{
+    return -1;
+}
+
+int cgroup_sample_all(cgroup_sample *samples, int max)
+{
+    return 0;
+}
+
+void cgroup_free(void)
+{
+}
+#endif
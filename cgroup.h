@@ -0,0 +1,101 @@
+/* ProcAn system memory and cgroup access
+ * Reads the host's memory figures and the memory limits of the cgroups
+ * processes live in, under cgroup v1 or v2.  Cgroup directories are
+ * interned to small ids like command names, and the collector caches
+ * the cgroup of each pid so /proc/<pid>/cgroup is read once per
+ * process rather than once per sample.  (Linux only, the other
+ * platforms get stubs that report nothing.)
+ */
+
+#define CGROUP_PATH_LEN 256           /* Longest cgroup directory we keep */
+#define CGROUP_ROOT "/sys/fs/cgroup"
+#define CGROUP_MAX 1024               /* Cgroups told apart at once, processes in more get id 0 */
+#define CGROUP_HASH 2048              /* Buckets of the directory lookup, a power of 2 */
+#define CGROUP_REUSE 300              /* Seconds an id stays empty before another cgroup may get it */
+#define CGROUP_RECHECK 60             /* Seconds before the cgroup of a pid is read again */
+
+/* Pressure stall figures, the order of cgroup_sample.pressure */
+#define PRESSURE_CPU 0
+#define PRESSURE_MEMORY 1
+#define PRESSURE_IO 2
+#define PRESSURE_KINDS 3
+
+/* One read of a cgroup's own files, taken once per cycle */
+typedef struct
+{
+    unsigned int id;          /* See cgroup_intern() */
+    unsigned int serial;      /* Changes when the id is handed to another directory */
+    int members;              /* Processes the collector placed in it */
+    unsigned long long sampletime;  /* Monotonic ns when it was read */
+    long long usage;          /* memory.current in bytes, -1 if unknown */
+    long long limit;          /* memory.max in bytes, -1 if unlimited or unknown */
+    long long cpu_usec;       /* usage_usec of cpu.stat, -1 if unknown */
+    long long high_events;    /* high and max counts of memory.events */
+    long long oom_kills;      /* oom_kill count of memory.events */
+    float pressure[PRESSURE_KINDS];  /* "some" avg10 of the *.pressure files, -1 if unknown */
+}cgroup_sample;
+
+/* Fetch MemTotal and MemAvailable from /proc/meminfo in bytes,
+ * returns -1 if they can not be read.
+ */
+int read_meminfo(long long *total, long long *available);
+
+/* Fetch the "some" and "full" avg10 figures of a pressure file, either
+ * may be -1 if the file lacks it.  Returns -1 if there is no "some".
+ */
+int read_pressure(const char *path, float *some, float *full);
+
+/* Fetch the directory of the memory cgroup pid belongs to,
+ * returns -1 if there is none.
+ */
+int cgroup_of(int pid, char *dir, int len);
+
+/* Fetch the memory limit and usage of a cgroup directory in bytes,
+ * limit is -1 if the cgroup has none.  Returns -1 if neither the v2
+ * nor the v1 files can be read.
+ */
+int cgroup_memory(const char *dir, long long *limit, long long *usage);
+
+/* Walk up from the cgroup directory in dir to the nearest one with a
+ * memory limit, as a limit set on a parent slice caps everything under
+ * it.  dir is cut down to that cgroup and its limit and usage fetched
+ * like cgroup_memory().  Returns -1 if no cgroup up to CGROUP_ROOT has
+ * a limit.
+ */
+int cgroup_limited(char *dir, long long *limit, long long *usage);
+
+/* Fetch the id of a cgroup directory, adding it if it is new.  Ids
+ * start at 1.  Once an id has had no processes for CGROUP_REUSE
+ * seconds it may be handed to a new directory when the table is full,
+ * and the serial of its samples changes.  The old directory text is
+ * kept until the id is reused again, so it can be read without a lock
+ * for a while after the id has been handed over.  Returns 0 when the
+ * table is full.
+ */
+unsigned int cgroup_intern(const char *dir);
+
+/* Fetch the directory of an id, "" for 0 */
+const char* cgroup_dir(unsigned int id);
+
+/* Fetch the cgroup id of a pid, reading /proc/<pid>/cgroup only when
+ * the pid is new or its entry is CGROUP_RECHECK seconds old.  Only
+ * called by the collector.  Returns 0 if the pid's cgroup is unknown.
+ */
+unsigned int cgroup_lookup(int pid, long now);
+
+/* Drop a pid that exited from the cache */
+void cgroup_forget(int pid);
+
+/* Hand every pid in the cgroup.procs of dir, and of every cgroup below
+ * it, to add().  dir is taken under CGROUP_ROOT unless it starts with
+ * it.  Returns -1 if dir can not be read.
+ */
+int cgroup_procs(const char *dir, void (*add)(int pid));
+
+/* Read every cgroup with processes in it into samples, up to max.
+ * Returns how many were read.
+ */
+int cgroup_sample_all(cgroup_sample *samples, int max);
+
+/* Free the cache and the directory table */
+void cgroup_free(void);
@@ -0,0 +1,230 @@
+/* Copyright (c) 2008, Matthew W. Jones
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, 
+ *   this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice, 
+ *   this list of conditions and the following disclaimer in the documentation 
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* ProcAn cgroup scoring */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include "procan.h"
+#include "backend.h"
+#include "instrument.h"
+#include "cgroup.h"
+#include "cgscore.h"
+
+static cgroup_history *cghist = NULL;   /* Indexed by cgroup id */
+static long last_alert = 0;
+
+static int round_decayed(float v)
+{
+    return (v < 0) ? (int)(v - 0.5f) : (int)(v + 0.5f);
+}
+
+static void decay(cgroup_history *h, long now)
+{
+    float f;
+
+    if (now <= h->last_decay_time)
+        return;
+    f = decay_factor(now - h->last_decay_time);
+    h->last_decay_time = now;
+    if (h->decayed_score == 0 && h->decayed_intrests == 0)
+        return;
+    h->decayed_score *= f;
+    h->decayed_intrests *= f;
+    h->score = round_decayed(h->decayed_score);
+    h->intrests = round_decayed(h->decayed_intrests);
+    if (h->score == 0 && h->intrests == 0)
+        {
+            h->decayed_score = 0;
+            h->decayed_intrests = 0;
+            h->threshold = DEFAULT_INTEREST_THRESHOLD;
+        }
+}
+
+/* Score one sample against the one before it, the rules follow the
+ * process scorer: 5 busy cycles in a row add 5, growing or shrinking
+ * memory moves the score by 1 and the threshold adapts to scores that
+ * stay put.  Memory events and pressure stalls add on top.
+ */
+static void score(cgroup_history *h, cgroup_sample *cs)
+{
+    long long dt = (cs->sampletime - h->last.sampletime) / 1000;
+    int percent = 0, change = 0, up, k;
+
+    if (cs->cpu_usec >= 0 && h->last.cpu_usec >= 0 && dt > 0)
+        percent = (int)((cs->cpu_usec - h->last.cpu_usec) * 100 / dt);
+    if (percent >= CGSCORE_BUSY && h->percent >= CGSCORE_BUSY)
+        h->mov_percent++;
+    else if (percent < CGSCORE_BUSY)
+        h->mov_percent = 0;
+    if (h->mov_percent >= 5)
+        {
+            change += 5;
+            h->mov_percent = 0;
+        }
+    if (cs->usage >= 0 && h->last.usage >= 0)
+        change += (cs->usage > h->last.usage) - (cs->usage < h->last.usage);
+    if (cs->high_events > h->last.high_events)
+        change++;
+    if (cs->oom_kills > h->last.oom_kills)
+        change += CGSCORE_OOM;
+    for (k = 0; k < PRESSURE_KINDS; k++)
+        {
+            if (cs->pressure[k] >= CGSCORE_PRESSURE)
+                {
+                    change++;
+                    break;
+                }
+        }
+    h->percent = percent;
+
+    h->decayed_score += change;
+    h->score = round_decayed(h->decayed_score);
+    up = (h->score > h->threshold);
+    h->ticks_interesting = (h->ticks_interesting + 1) * up;
+    h->ticks_since_interesting = (h->ticks_since_interesting + 1) * (1 - up);
+    if (h->ticks_interesting > ADAPTIVE_THRESHOLD)
+        h->threshold = h->score + ADAPTIVE_THRESHOLD;
+    else if (h->ticks_since_interesting > ADAPTIVE_THRESHOLD*2)
+        {
+            h->threshold = h->score + 1;
+            h->ticks_since_interesting = 0;
+        }
+    h->decayed_intrests += up;
+    h->intrests = round_decayed(h->decayed_intrests);
+}
+
+void cgscore_update(cgroup_sample *samples, int n, long now)
+{
+    cgroup_history *h;
+    unsigned int id;
+    int i;
+
+    if (cghist == NULL && (cghist = calloc(CGROUP_MAX + 1, sizeof(cgroup_history))) == NULL)
+        {
+            printf("malloc error, can not allocate memory.\n");
+            exit(-1);
+        }
+    for (id = 1; id <= CGROUP_MAX; id++)
+        {
+            if (cghist[id].last.id == 0)
+                continue;
+            if (now - cghist[id].last_seen > CGROUP_REUSE)   /* The id may go to another cgroup */
+                memset(&cghist[id], 0, sizeof(cgroup_history));
+            else
+                decay(&cghist[id], now);
+        }
+    for (i = 0; i < n; i++)
+        {
+            if ((id = samples[i].id) == 0 || id > CGROUP_MAX)
+                continue;
+            h = &cghist[id];
+            if (h->last.id != 0 && h->last.serial != samples[i].serial)
+                memset(h, 0, sizeof(cgroup_history));
+            if (h->last.id == 0)
+                {
+                    h->threshold = DEFAULT_INTEREST_THRESHOLD;
+                    h->last_decay_time = now;
+                }
+            else
+                score(h, &samples[i]);
+            h->last = samples[i];
+            h->last_seen = now;
+        }
+}
+
+cgroup_history* cgscore_get(unsigned int id)
+{
+    if (cghist == NULL || id == 0 || id > CGROUP_MAX || cghist[id].last.id == 0)
+        return NULL;
+    return &cghist[id];
+}
+
+int cgscore_top(unsigned int *order, int max, long now)
+{
+    unsigned int id;
+    int i, n = 0;
+
+    if (cghist == NULL)
+        return 0;
+    for (id = 1; id <= CGROUP_MAX; id++)
+        {
+            if (cghist[id].last.id == 0 || now - cghist[id].last_seen > CGSCORE_IDLE)
+                continue;
+            if (n < max)
+                i = n++;
+            else if (max > 0 && cghist[order[max-1]].score < cghist[id].score)
+                i = max - 1;
+            else
+                continue;
+            for (; i > 0 && cghist[order[i-1]].score < cghist[id].score; i--)
+                order[i] = order[i-1];
+            order[i] = id;
+        }
+    return n;
+}
+
+void cgscore_alert(procan_config *pc, long now)
+{
+    char what[CGROUP_PATH_LEN + 10];
+    char msg[CGROUP_PATH_LEN + 100];
+    cgroup_history *h;
+    unsigned int id;
+    int level;
+
+    if (cghist == NULL || now - last_alert < CGSCORE_ALERT_INTERVAL)
+        return;
+    last_alert = now;
+
+    instr_lock(&procchart_mutex, INSTR_PROCCHART_WAIT);
+    for (id = 1; id <= CGROUP_MAX; id++)
+        {
+            h = &cghist[id];
+            if (h->last.id == 0)
+                continue;
+            level = 0;
+            if (h->intrests > pc->alarmlevel)
+                level = ALERT_ALARM;
+            else if (h->intrests > pc->warnlevel)
+                level = ALERT_WARNING;
+            if (level > h->level)
+                {
+                    snprintf(what, CGROUP_PATH_LEN + 10, "cgroup:%s", cgroup_dir(id));
+                    snprintf(msg, CGROUP_PATH_LEN + 100, "cgroup %s has an interest of %i "
+                             "(score %i, %i processes)",
+                             cgroup_dir(id), h->intrests, h->score, h->last.members);
+                }
+            backend_escalate(pc, &h->level, level, what, h->intrests, msg);
+        }
+    pthread_mutex_unlock(&procchart_mutex);
+}
+
+void cgscore_free(void)
+{
+    free(cghist);
+    cghist = NULL;
+}
@@ -0,0 +1,50 @@
+/* ProcAn cgroup scoring
+ * Scores every cgroup the collector placed a process in from one read
+ * of its own files per cycle, next to the per process scores.  Load
+ * that stays up, memory that grows, memory.high and OOM kill events
+ * and pressure stalls raise a cgroup's score, which adapts its
+ * threshold and decays by the same half-life as process scores.  Only
+ * touched with procchart_mutex held.
+ */
+
+#define CGSCORE_BUSY 50               /* Percent of a CPU that counts as busy */
+#define CGSCORE_PRESSURE 10.0f        /* "some" avg10 that counts as stalling */
+#define CGSCORE_OOM 5                 /* Score added for a cycle with OOM kills */
+#define CGSCORE_IDLE 30               /* Seconds without a sample before a cgroup is not listed */
+#define CGSCORE_ALERT_INTERVAL 10     /* Seconds between alert checks */
+
+typedef struct
+{
+    cgroup_sample last;       /* Newest sample, last.id is 0 before the first */
+    int percent;              /* Processor load over the last cycle, percent of one CPU */
+    int mov_percent;          /* Busy cycles in a row */
+    int score;
+    int threshold;
+    int ticks_interesting;
+    int ticks_since_interesting;
+    int intrests;
+    float decayed_score;      /* score before rounding */
+    float decayed_intrests;   /* intrests before rounding */
+    long last_decay_time;
+    long last_seen;
+    int level;                /* ALERT_* level last delivered, 0 if none */
+}cgroup_history;
+
+/* Score a cycle's samples and decay every cgroup up to now */
+void cgscore_update(cgroup_sample *samples, int n, long now);
+
+/* Fetch the history of a cgroup id, NULL if it has none */
+cgroup_history* cgscore_get(unsigned int id);
+
+/* Fill order with up to max cgroups sampled in the last CGSCORE_IDLE
+ * seconds, highest score first.  Returns how many were filled.
+ */
+int cgscore_top(unsigned int *order, int max, long now);
+
+/* Raise warnings and alarms for cgroups whose interest passes the
+ * levels.  Called from the analyzer with pconfig_mutex held.
+ */
+void cgscore_alert(procan_config *pc, long now);
+
+/* Forget every cgroup's history */
+void cgscore_free(void);
@@ -0,0 +1,235 @@
+/* Copyright (c) 2008, Matthew W. Jones
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, 
+ *   this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice, 
+ *   this list of conditions and the following disclaimer in the documentation 
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* ProcAn fork and exit churn */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include "procan.h"
+#include "backend.h"
+#include "instrument.h"
+#include "names.h"
+#include "aggregate.h"
+#include "churn.h"
+
+extern pthread_mutex_t procchart_mutex;
+extern proc_averages *procavs;
+extern procan_config *pc;
+
+static churn_state *slots = NULL;
+static int *listed = NULL;            /* Slots with spawns in this window or the last */
+static int nlisted = 0;
+static int maxlisted = 0;
+
+/* Command aggregates, indexed by aggregate id */
+static churn_state commands[AGG_MAX + 1];
+
+static long started = 0;              /* When counting was first asked for */
+static long window_start = 0;
+static long long host_forks = -1;     /* /proc/stat processes at the start of the window */
+static long long host_last = -1;
+static float host_rate = 0;
+static int host_level = 0;
+
+void churn_reserve(int oldn, int n)
+{
+    if ((slots = realloc(slots, n * sizeof(churn_state))) == NULL ||
+        (listed = realloc(listed, n * sizeof(int))) == NULL)
+        {
+            printf("malloc error, can not allocate memory.\n");
+            exit(-1);
+        }
+    memset(&slots[oldn], 0, (n - oldn) * sizeof(churn_state));
+    maxlisted = n;
+}
+
+void churn_free(void)
+{
+    free(slots);
+    free(listed);
+    slots = NULL;
+    listed = NULL;
+    nlisted = maxlisted = 0;
+    memset(commands, 0, sizeof(commands));
+    started = window_start = 0;
+    host_forks = host_last = -1;
+    host_rate = 0;
+    host_level = 0;
+}
+
+void churn_init(int slot)
+{
+    int listedbefore = slots[slot].listed;
+
+    memset(&slots[slot], 0, sizeof(churn_state));
+    slots[slot].listed = listedbefore;   /* Dropped from the list at the next settle */
+}
+
+/* Counts before the processes already running have all been seen
+ * would be mistaken for spawns.
+ */
+static int warming(long now)
+{
+    if (started == 0)
+        started = now;
+    return now - started < CHURN_WARMUP;
+}
+
+void churn_parent(int slot, int spawns, int exits, long now)
+{
+    if (slot < 0 || slots == NULL || warming(now))
+        return;
+    slots[slot].spawns += spawns;
+    slots[slot].exits += exits;
+    if (!slots[slot].listed && nlisted < maxlisted)
+        {
+            slots[slot].listed = 1;
+            listed[nlisted++] = slot;
+        }
+}
+
+void churn_command(int agg, int spawns, int exits, long now)
+{
+    if (agg <= 0 || agg > AGG_MAX || warming(now))
+        return;
+    commands[agg].spawns += spawns;
+    commands[agg].exits += exits;
+}
+
+void churn_host(long long forks, long now)
+{
+    warming(now);
+    if (host_forks < 0)
+        host_forks = forks;
+    host_last = forks;
+}
+
+int churn_settle(long now, int *raised, int max)
+{
+    int warn = (pc == NULL || pc->churnwarn == 0) ? DEFAULT_CHURN_WARN : pc->churnwarn;
+    float secs;
+    int i, j, n = 0, was;
+    churn_state *cs;
+
+    if (window_start == 0)
+        window_start = now;
+    if (now - window_start < CHURN_WINDOW)
+        return 0;
+    secs = now - window_start;
+    window_start = now;
+    for (i = 0, j = 0; i < nlisted; i++)
+        {
+            cs = &slots[listed[i]];
+            was = (warn > 0 && cs->spawn_rate >= warn);
+            cs->spawn_rate = cs->spawns / secs;
+            cs->exit_rate = cs->exits / secs;
+            cs->spawns = cs->exits = 0;
+            if (warn > 0 && cs->spawn_rate >= warn && !was && n < max)
+                raised[n++] = listed[i];
+            if (cs->spawn_rate > 0 || cs->exit_rate > 0)
+                listed[j++] = listed[i];
+            else
+                {
+                    cs->listed = 0;
+                    cs->level = 0;
+                }
+        }
+    nlisted = j;
+    for (i = 1; i <= AGG_MAX; i++)
+        {
+            cs = &commands[i];
+            if (cs->spawns == 0 && cs->exits == 0 && cs->spawn_rate == 0 && cs->exit_rate == 0)
+                continue;
+            cs->spawn_rate = cs->spawns / secs;
+            cs->exit_rate = cs->exits / secs;
+            cs->spawns = cs->exits = 0;
+        }
+    if (host_forks >= 0)
+        {
+            host_rate = (host_last - host_forks) / secs;
+            host_forks = host_last;
+        }
+    return n;
+}
+
+churn_state* churn_get(int slot)
+{
+    return &slots[slot];
+}
+
+/* Queue an alert if a rate moved up a level, like the OOM forecasts */
+static void escalate(procan_config *pc, int *level, float rate, int warn, int alarm, char *what, char *msg)
+{
+    int newlevel = 0;
+
+    if (alarm > 0 && rate >= alarm)
+        newlevel = ALERT_ALARM;
+    else if (warn > 0 && rate >= warn)
+        newlevel = ALERT_WARNING;
+    backend_escalate(pc, level, newlevel, what, (int)rate, msg);
+}
+
+void churn_alert(procan_config *pc, long now)
+{
+    int warn = (pc->churnwarn != 0) ? pc->churnwarn : DEFAULT_CHURN_WARN;
+    int alarm = (pc->churnalarm != 0) ? pc->churnalarm : DEFAULT_CHURN_ALARM;
+    int host = (pc->churnhost != 0) ? pc->churnhost : DEFAULT_CHURN_HOST;
+    char what[40];
+    char msg[150];
+    churn_state *cs;
+    command_aggregate *ca;
+    int i;
+
+    instr_lock(&procchart_mutex, INSTR_PROCCHART_WAIT);
+    for (i = 0; slots != NULL && i < nlisted; i++)
+        {
+            cs = &slots[listed[i]];
+            snprintf(what, 40, "churn:%s", name_text(procavs[listed[i]].name));
+            snprintf(msg, 150, "%s (%i) is spawning %.1f processes a second, %.1f exit",
+                     name_text(procavs[listed[i]].name), procavs[listed[i]].lastpid,
+                     cs->spawn_rate, cs->exit_rate);
+            escalate(pc, &cs->level, cs->spawn_rate, warn, alarm, what, msg);
+        }
+    for (i = 1; i <= AGG_MAX; i++)
+        {
+            cs = &commands[i];
+            if (cs->spawn_rate == 0 && cs->level == 0)
+                continue;
+            if ((ca = agg_get(i)) == NULL)
+                continue;
+            snprintf(what, 40, "churn:%s", name_text(ca->name));
+            snprintf(msg, 150, "%s is being started %.1f times a second, %.1f exit",
+                     name_text(ca->name), cs->spawn_rate, cs->exit_rate);
+            escalate(pc, &cs->level, cs->spawn_rate, warn, alarm, what, msg);
+        }
+    if (host > 0)
+        {
+            snprintf(msg, 150, "the host is forking %.1f processes a second", host_rate);
+            escalate(pc, &host_level, host_rate, host, host * 4, "churn:host", msg);
+        }
+    pthread_mutex_unlock(&procchart_mutex);
+}
@@ -0,0 +1,60 @@
+/* ProcAn fork and exit churn
+ * Counts the processes each parent spawns and reaps, and how often each
+ * command is started and exits, over CHURN_WINDOW second windows.  On
+ * Linux the collector listens to the proc connector for fork and exit
+ * events when it is allowed to, catching processes too short lived to
+ * be sampled, otherwise spawns are worked out from the pids coming and
+ * going.  The host's fork count comes from /proc/stat.  Parents and
+ * commands spawning churnwarn processes a second get "churn" interest,
+ * and spawn rates past churnwarn, churnalarm and churnhost are alerted on.
+ */
+
+#define CHURN_WINDOW 10               /* Seconds spawns are counted over */
+#define CHURN_WARMUP 20               /* Seconds after startup no spawns are counted */
+#define CHURN_SCORE 5                 /* Score added to a parent spawning too fast */
+#define DEFAULT_CHURN_WARN 2          /* Spawns a second of one parent or command that warn */
+#define DEFAULT_CHURN_ALARM 10        /* Spawns a second that alarm */
+#define DEFAULT_CHURN_HOST 200        /* Forks a second of the whole host that warn, 4 times that alarm */
+#define CHURN_ALERT_MAX 16            /* Parents given churn interest per window */
+
+typedef struct
+{
+    int spawns;               /* Counted in the current window */
+    int exits;
+    float spawn_rate;         /* A second, over the last window */
+    float exit_rate;
+    int level;                /* ALERT_* level of the last alert, 0 if none */
+    int listed;               /* In the list of slots with spawns */
+}churn_state;
+
+/* Make room for churn counts in slots [oldn, n) */
+void churn_reserve(int oldn, int n);
+
+/* Forget the churn counts */
+void churn_free(void);
+
+/* Start a slot's counts over, it holds a new process */
+void churn_init(int slot);
+
+/* Count spawns and exits of a parent, slot -1 is an untracked parent */
+void churn_parent(int slot, int spawns, int exits, long now);
+
+/* Count starts and exits of a command aggregate */
+void churn_command(int agg, int spawns, int exits, long now);
+
+/* Note the host's fork count so far, from /proc/stat */
+void churn_host(long long forks, long now);
+
+/* Close the window once CHURN_WINDOW seconds have gone by and work out
+ * the rates.  The slots of parents that just passed churnwarn are put
+ * in raised for the analyzer to score, their number is returned.
+ */
+int churn_settle(long now, int *raised, int max);
+
+/* Fetch the churn of a slot */
+churn_state* churn_get(int slot);
+
+/* Raise warnings and alarms for parents, commands and the host spawning
+ * too fast.  Called from the analyzer with pconfig_mutex held.
+ */
+void churn_alert(procan_config *pc, long now);
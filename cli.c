@@ -39,7 +39,35 @@
 #include <signal.h>
 #include <sys/ioctl.h>
 #include "procan.h"
+#include "cgroup.h"
 #include "cli.h"
+#include "instrument.h"
+#include "rollup.h"
+#include "names.h"
+#include "aggregate.h"
+#include "tree.h"
+#include "cgscore.h"
+#include "threads.h"
+
+/* Draw the processor load a slot averaged over its last CLI_TREND
+ * minutes, oldest on the left.
+ */
+static void format_trend(int slot, char *buf)
+{
+  const char *levels = " .:-=+*#";
+  rollup_point points[CLI_TREND];
+  int i, n, l;
+
+  n = rollup_recent(slot, 1, points, CLI_TREND);
+  for (i = 0; i < CLI_TREND; i++)
+    buf[i] = ' ';
+  for (i = 0; i < n; i++)
+    {
+      l = (int)(points[i].mean[ROLLUP_CPU] * 8 / 100);
+      buf[CLI_TREND - n + i] = levels[(l < 0) ? 0 : (l > 7) ? 7 : l];
+    }
+  buf[CLI_TREND] = '\0';
+}
 
 /* Interactive mode remains in the foreground and recieves commands from stdin
  * it has the same functionality as far as backends as the daemon mode
@@ -48,21 +76,27 @@ int interactive_mode()
 {
   WINDOW *proc_win;
   WINDOW *user_win;
+  WINDOW *stats_win;
   PANEL *procpanel;
   PANEL *userpanel;
+  PANEL *statspanel;
 
   pthread_t *threads;
   char procline[100];
+  char trend[CLI_TREND+1];
   int i,e, inp;
   int startx, starty, width, height;
 
   int refreshcounter = 0;
+  int showstats = 0;
+  int view = CLI_PROCESSES;
 
-  /* The 3 signals we watch for, and ignore the return value of children */
+  /* The 4 signals we watch for, and ignore the return value of children */
   signal(SIGCHLD, SIG_IGN);
   signal(SIGHUP, handle_sig);
   signal(SIGTERM, handle_sig);
   signal(SIGUSR1, handle_sig);
+  signal(SIGUSR2, handle_sig);
 
   pthread_mutex_init(&procsnap_mutex,NULL);
   pthread_mutex_init(&procchart_mutex,NULL);
@@ -95,9 +129,12 @@ int interactive_mode()
   /* Create and set up the windows */
   proc_win = newwin(height-6, width, starty, startx);
   user_win = newwin(6, width, starty+(height-6), startx);
+  stats_win = newwin(INSTR_NHISTS+4, width, starty, startx);
 
   procpanel = new_panel(proc_win);
   userpanel = new_panel(user_win);
+  statspanel = new_panel(stats_win);
+  hide_panel(statspanel);
 
   update_panels();
   doupdate();
@@ -106,13 +143,28 @@ int interactive_mode()
 
   while ((inp = wgetch(proc_win)) != 113 && m_hangup != 1)
     {
+      if (inp == 's')
+        {
+          showstats = !showstats;
+          if (showstats)
+            show_panel(statspanel);
+          else
+            hide_panel(statspanel);
+          refreshcounter = 0;
+        }
+      if (inp == 'c' || inp == 't' || inp == 'g' || inp == 'h')
+        {
+          int chosen = (inp == 'c') ? CLI_COMMANDS : (inp == 't') ? CLI_TREES :
+            (inp == 'g') ? CLI_CGROUPS : CLI_THREADS;
+          view = (view == chosen) ? CLI_PROCESSES : chosen;
+          werase(proc_win);
+          refreshcounter = 0;
+        }
       if (refreshcounter == 0)
         {
-          pthread_mutex_lock(&procchart_mutex);
+          instr_lock(&procchart_mutex, INSTR_PROCCHART_WAIT);
 
-          mvwaddstr(proc_win, 1, 1, "Active Processes:");
           mvwaddstr(user_win, 1, 1, "Active Users:");
-          mvwaddstr(proc_win, 2, 1, "       command | lpid | cpu |  rssz | cpugn | szgn | rsszgn | score");
 
           int mis[numprocavs];
           int uis[numprocavs];
@@ -120,17 +172,117 @@ int interactive_mode()
 
           int numids = get_statistics(mis, uis, numints);
 
-          for (i = 0; i < numprocavs; i++)
+          if (view == CLI_COMMANDS)
+            {
+              mvwaddstr(proc_win, 1, 1, "Active Commands:");
+              mvwaddstr(proc_win, 2, 1, "       command |   uid | inst |  cpu |     rssz |  usual rssz | score | intr");
+              int ncmds = agg_top(mis, numprocavs);
+              for (i = 0; i < ncmds; i++)
+                {
+                  command_aggregate *ca = agg_get(mis[i]);
+                  snprintf(procline, 100, "%15s %7i %6i %6i %10lli %13lli %7i %6i",
+                           name_text(ca->name),
+                           ca->uid,
+                           ca->instances,
+                           ca->percent,
+                           ca->rssize,
+                           (long long)ca->base_rssize,
+                           ca->score,
+                           ca->intrests);
+                  mvwaddstr(proc_win, (i+3), 1, procline);
+                }
+            }
+          else if (view == CLI_TREES)
+            {
+              mvwaddstr(proc_win, 1, 1, "Process Trees:");
+              mvwaddstr(proc_win, 2, 1, "       command |   lpid | procs |  cpu |     rssz | score | intr");
+              int ntrees = tree_top(mis, numprocavs);
+              for (i = 0; i < ntrees; i++)
+                {
+                  tree_node *tn = tree_get(mis[i]);
+                  snprintf(procline, 100, "%15s %8i %7i %6i %10lli %7i %6i",
+                           name_text(procavs[mis[i]].name),
+                           procavs[mis[i]].lastpid,
+                           tn->sub.count,
+                           tn->sub.percent,
+                           tn->sub.rssize,
+                           tn->sub.score,
+                           tn->sub.intrests);
+                  mvwaddstr(proc_win, (i+3), 1, procline);
+                }
+            }
+          else if (view == CLI_THREADS)
+            {
+              int row = 3, t, k;
+
+              mvwaddstr(proc_win, 1, 1, "Hot Threads:");
+              mvwaddstr(proc_win, 2, 1, "       command |   lpid | threads |    tid | thread           |  cpu");
+              for (t = 0; t < MAX_THREAD_PROCS; t++)
+                {
+                  thread_table *tt = threads_at(t);
+                  if (tt == NULL)
+                    continue;
+                  for (k = 0; k < tt->nhot || (k == 0 && tt->nhot == 0); k++)
+                    {
+                      thread_usage *tu = (tt->nhot > 0) ? &tt->threads[tt->hot[k]] : NULL;
+                      snprintf(procline, 100, "%15s %8i %9i %8i %-18s %5i",
+                               (k == 0) ? name_text(procavs[tt->slot].name) : "",
+                               tt->pid,
+                               tt->nthreads,
+                               (tu != NULL) ? tu->tid : 0,
+                               (tu != NULL) ? tu->name : "-",
+                               (tu != NULL) ? tu->percent : 0);
+                      mvwaddstr(proc_win, row++, 1, procline);
+                    }
+                }
+            }
+          else if (view == CLI_CGROUPS)
             {
-                snprintf(procline, 100, "%15s %6i %5i %7i %7i %6i %8i %7i",
-                         procavs[mis[i]].command,
+              unsigned int cgs[CGROUP_MAX];
+              struct timeval tv;
+              const char *dir;
+
+              gettimeofday(&tv, NULL);
+              mvwaddstr(proc_win, 1, 1, "Active Cgroups:");
+              mvwaddstr(proc_win, 2, 1, "                        cgroup | procs |  cpu |  mem MB | limit MB | psi mem | score | intr");
+              int ncgs = cgscore_top(cgs, CGROUP_MAX, tv.tv_sec);
+              for (i = 0; i < ncgs; i++)
+                {
+                  cgroup_history *ch = cgscore_get(cgs[i]);
+                  dir = cgroup_dir(cgs[i]);
+                  if (strlen(dir) > 30)
+                    dir = dir + strlen(dir) - 30;
+                  snprintf(procline, 100, "%30s %7i %6i %9lli %10lli %9.1f %7i %6i",
+                           dir,
+                           ch->last.members,
+                           ch->percent,
+                           (ch->last.usage < 0) ? -1 : ch->last.usage / 1048576,
+                           (ch->last.limit < 0) ? -1 : ch->last.limit / 1048576,
+                           ch->last.pressure[PRESSURE_MEMORY],
+                           ch->score,
+                           ch->intrests);
+                  mvwaddstr(proc_win, (i+3), 1, procline);
+                }
+            }
+          else
+            {
+              mvwaddstr(proc_win, 1, 1, "Active Processes:");
+              mvwaddstr(proc_win, 2, 1, "       command | lpid | cpu |  rssz | cpugn | szgn | rsszgn | score | trend");
+            }
+
+          for (i = 0; i < numprocavs && view == CLI_PROCESSES; i++)
+            {
+                format_trend(mis[i], trend);
+                snprintf(procline, 100, "%15s %6i %5i %7i %7i %6i %8i %7i   %s",
+                         name_text(procavs[mis[i]].name),
                          procavs[mis[i]].lastpid,
-                         procavs[mis[i]].last_percent,
-                         procavs[mis[i]].last_rssize,
-                         procavs[mis[i]].mov_percent,
-                         procavs[mis[i]].avg_size_gain,
-                         procavs[mis[i]].avg_rssize_gain,
-                         procavs[mis[i]].intrest_score);
+                         hcols.last_percent[mis[i]],
+                         hcols.last_rssize[mis[i]],
+                         hcols.mov_percent[mis[i]],
+                         hcols.avg_size_gain[mis[i]],
+                         hcols.avg_rssize_gain[mis[i]],
+                         hcols.intrest_score[mis[i]],
+                         trend);
                 mvwaddstr(proc_win, (i+3), 1, procline);
             }
 
@@ -140,11 +292,25 @@ int interactive_mode()
               mvwaddstr(user_win, (i+2), 1, procline);
             }
 
-          wnoutrefresh(proc_win);
-          wnoutrefresh(user_win);
-          doupdate();
-
           pthread_mutex_unlock(&procchart_mutex);
+
+          if (showstats)
+            {
+              werase(stats_win);
+              box(stats_win, 0, 0);
+              mvwaddstr(stats_win, 1, 1, "Instrumentation:");
+              snprintf(procline, 100, "%-18s %9s %11s %11s %11s %11s %11s",
+                       "histogram", "count", "mean", "p50", "p90", "p99", "max");
+              mvwaddnstr(stats_win, 2, 1, procline, width-2);
+              for (i = 0; i < INSTR_NHISTS; i++)
+                {
+                  instr_format(i, procline, 100);
+                  mvwaddnstr(stats_win, (i+3), 1, procline, width-2);
+                }
+            }
+
+          update_panels();
+          doupdate();
           refreshcounter = 2000;
         }
       refreshcounter--;
@@ -164,20 +330,12 @@ int interactive_mode()
   pthread_mutex_destroy(&pconfig_mutex);
   free(threads);
 
-#if defined (linux)
-  for (i = 0; i < numprocsnap; i++)
-    {
-      if (procsnap[i]._command != NULL)
-	free(procsnap[i]._command);
-    }
-#endif
   free(procsnap);
-  for (i = 0; i < numprocavs; i++)
-    {
-      if (procavs[i].command != NULL)
-          free(procavs[i].command);
-    }
-  free(procavs);
+  free(procgone);
+  free(cgroupsnap);
+  free_history();
+  name_free();
+  cgroup_free();
 
   return 0;
 }
@@ -1,12 +1,25 @@
+#define CLI_TREND 8                   /* Minutes of processor load drawn per process */
+
+/* What the process window lists */
+#define CLI_PROCESSES 0
+#define CLI_COMMANDS 1                /* Command aggregates, toggled with c */
+#define CLI_TREES 2                   /* Process trees, toggled with t */
+#define CLI_CGROUPS 3                 /* Cgroups, toggled with g */
+#define CLI_THREADS 4                 /* Hot threads of followed processes, toggled with h */
+
 extern pthread_mutex_t hangup_mutex;
 extern int m_hangup;
 
 extern pthread_mutex_t procsnap_mutex;
 extern proc_statistics *procsnap;
 extern int numprocsnap;
+extern pid_t *procgone;
+extern int numprocgone;
+extern cgroup_sample *cgroupsnap;
 
 extern pthread_mutex_t procchart_mutex;
 extern proc_averages *procavs;
+extern history_columns hcols;
 extern int numprocavs;
 
 extern pthread_mutex_t pconfig_mutex;
@@ -30,12 +30,15 @@
 #include <ctype.h>
 #include "procan.h"
 
+#define CONFIG_LINE 512      /* Longest configuration line read */
+
 /* Will search for, process and load procan configuration
  * returns a procan_config structure that the caller should free
  * invoked at startup and when a SIGHUP is recieved
  */
 procan_config* get_config()
 {
+  static int generation = 0;
   FILE *cfile = NULL;
   char *cfiles[] = {"/etc/procan.conf", "/etc/procan/procan.conf",
 		     "/usr/etc/procan.conf","/usr/etc/procan/procan.conf",
@@ -55,8 +58,8 @@ procan_config* get_config()
   procan_config *pc = (procan_config *)calloc(1, sizeof(procan_config));
   while (!feof(cfile))
     {
-      char *line = (char *)calloc(100, sizeof(char));
-      fgets(line, 100, cfile);
+      char *line = (char *)calloc(CONFIG_LINE, sizeof(char));
+      fgets(line, CONFIG_LINE, cfile);
       if (line[0] == '#' || isspace(line[0]))
 	{
 	  free(line);
@@ -121,6 +124,31 @@ procan_config* get_config()
 		}
 	      pc->nclusions = i;
 	    }
+	  else if (strcmp(fptr,"threadprocs") == 0)
+	    {
+	      i = 0;
+	      for (toks = strtok_r(midptr, " \t\n", &brk);
+		   toks && i < MAX_THREAD_NAMES;
+		   toks = strtok_r(NULL, " \t\n", &brk))
+		{
+		  strncpy(pc->threadprocs[i], toks, 19);
+		  i++;
+		}
+	      pc->nthreadprocs = i;
+	    }
+	  else if (strcmp(fptr,"monitorcgroups") == 0)
+	    {
+	      i = 0;
+	      pc->cgroupscope = calloc(MAX_CGROUP_SCOPE, sizeof(char *));
+	      for (toks = strtok_r(midptr, " \t\n", &brk);
+		   toks && i < MAX_CGROUP_SCOPE;
+		   toks = strtok_r(NULL, " \t\n", &brk))
+		{
+		  pc->cgroupscope[i] = strdup(toks);
+		  i++;
+		}
+	      pc->ncgroupscope = i;
+	    }
 	  else if (strcmp(fptr,"adminemail") == 0)
 	    {
 	      pc->adminemail = malloc(40*sizeof(char));
@@ -137,6 +165,74 @@ procan_config* get_config()
 	    pc->mailfrequency = (int)strtol(midptr, (char **)NULL, 10);
 	  else if (strcmp(fptr,"logfrequency") == 0)
 	    pc->logfrequency = (int)strtol(midptr, (char **)NULL, 10);
+	  else if (strcmp(fptr,"stalltimeout") == 0)
+	    pc->stalltimeout = (int)strtol(midptr, (char **)NULL, 10);
+	  else if (strcmp(fptr,"samplebudget") == 0)
+	    pc->samplebudget = (int)strtol(midptr, (char **)NULL, 10);
+	  else if (strcmp(fptr,"coldinterval") == 0)
+	    pc->coldinterval = (int)strtol(midptr, (char **)NULL, 10);
+	  else if (strcmp(fptr,"interval") == 0)
+	    pc->interval = (int)strtol(midptr, (char **)NULL, 10);
+	  else if (strcmp(fptr,"scorer") == 0)
+	    pc->scorer = (strncmp(midptr, "ewma", 4) == 0) ? SCORER_EWMA : SCORER_ADAPTIVE;
+	  else if (strcmp(fptr,"zscore") == 0)
+	    pc->zscore = (int)strtol(midptr, (char **)NULL, 10);
+	  else if (strcmp(fptr,"leakrate") == 0)
+	    pc->leakrate = (int)strtol(midptr, (char **)NULL, 10);
+	  else if (strcmp(fptr,"oomwarn") == 0)
+	    pc->oomwarn = (int)strtol(midptr, (char **)NULL, 10);
+	  else if (strcmp(fptr,"oomalarm") == 0)
+	    pc->oomalarm = (int)strtol(midptr, (char **)NULL, 10);
+	  else if (strcmp(fptr,"rollupseconds") == 0)
+	    pc->rollupseconds = (int)strtol(midptr, (char **)NULL, 10);
+	  else if (strcmp(fptr,"rollupminutes") == 0)
+	    pc->rollupminutes = (int)strtol(midptr, (char **)NULL, 10);
+	  else if (strcmp(fptr,"rolluphours") == 0)
+	    pc->rolluphours = (int)strtol(midptr, (char **)NULL, 10);
+	  else if (strcmp(fptr,"halflife") == 0)
+	    pc->halflife = (int)strtol(midptr, (char **)NULL, 10);
+	  else if (strcmp(fptr,"cgroupstats") == 0)
+	    pc->cgroupstats = (int)strtol(midptr, (char **)NULL, 10);
+	  else if (strcmp(fptr,"psiweight") == 0)
+	    pc->psiweight = (int)strtol(midptr, (char **)NULL, 10);
+	  else if (strcmp(fptr,"psiwarn") == 0)
+	    pc->psiwarn = (int)strtol(midptr, (char **)NULL, 10);
+	  else if (strcmp(fptr,"psialarm") == 0)
+	    pc->psialarm = (int)strtol(midptr, (char **)NULL, 10);
+	  else if (strcmp(fptr,"smapstop") == 0)
+	    pc->smapstop = (int)strtol(midptr, (char **)NULL, 10);
+	  else if (strcmp(fptr,"smapsbudget") == 0)
+	    pc->smapsbudget = (int)strtol(midptr, (char **)NULL, 10);
+	  else if (strcmp(fptr,"iostats") == 0)
+	    pc->iostats = (int)strtol(midptr, (char **)NULL, 10);
+	  else if (strcmp(fptr,"iobusy") == 0)
+	    pc->iobusy = (int)strtol(midptr, (char **)NULL, 10);
+	  else if (strcmp(fptr,"iowarnlevel") == 0)
+	    pc->iowarnlevel = (int)strtol(midptr, (char **)NULL, 10);
+	  else if (strcmp(fptr,"ioalarmlevel") == 0)
+	    pc->ioalarmlevel = (int)strtol(midptr, (char **)NULL, 10);
+	  else if (strcmp(fptr,"ctxtstats") == 0)
+	    pc->ctxtstats = (int)strtol(midptr, (char **)NULL, 10);
+	  else if (strcmp(fptr,"faultbusy") == 0)
+	    pc->faultbusy = (int)strtol(midptr, (char **)NULL, 10);
+	  else if (strcmp(fptr,"ctxswbusy") == 0)
+	    pc->ctxswbusy = (int)strtol(midptr, (char **)NULL, 10);
+	  else if (strcmp(fptr,"fdevery") == 0)
+	    pc->fdevery = (int)strtol(midptr, (char **)NULL, 10);
+	  else if (strcmp(fptr,"fdwarn") == 0)
+	    pc->fdwarn = (int)strtol(midptr, (char **)NULL, 10);
+	  else if (strcmp(fptr,"fdalarm") == 0)
+	    pc->fdalarm = (int)strtol(midptr, (char **)NULL, 10);
+	  else if (strcmp(fptr,"threadcpu") == 0)
+	    pc->threadcpu = (int)strtol(midptr, (char **)NULL, 10);
+	  else if (strcmp(fptr,"churnevents") == 0)
+	    pc->churnevents = (int)strtol(midptr, (char **)NULL, 10);
+	  else if (strcmp(fptr,"churnwarn") == 0)
+	    pc->churnwarn = (int)strtol(midptr, (char **)NULL, 10);
+	  else if (strcmp(fptr,"churnalarm") == 0)
+	    pc->churnalarm = (int)strtol(midptr, (char **)NULL, 10);
+	  else if (strcmp(fptr,"churnhost") == 0)
+	    pc->churnhost = (int)strtol(midptr, (char **)NULL, 10);
 	  else if (strcmp(fptr,"warnscript") == 0)
 	    {
 	      pc->warnscript = malloc(100*sizeof(char));
@@ -165,6 +261,7 @@ procan_config* get_config()
 	}
       free(line);
     }
+  pc->generation = ++generation;
 #if defined (__FreeBSD__)  /* FreeBSD lists cpu idles in the process list, which can really screw us up.*/
   strncpy(pc->exclusions[pc->nclusions], "idle: cpu", 9);
   pc->nclusions++;
@@ -180,6 +277,7 @@ procan_config* get_config()
 
 void free_config(procan_config *pc)
 {
+  int i;
   if (!(!pc->euids))
     free(pc->euids);
   if (!(!pc->iuids))
@@ -192,5 +290,9 @@ void free_config(procan_config *pc)
     free(pc->alarmscript);
   if (!(!pc->mtapath))
     free(pc->mtapath);
+  for (i = 0; i < pc->ncgroupscope; i++)
+    free(pc->cgroupscope[i]);
+  if (!(!pc->cgroupscope))
+    free(pc->cgroupscope);
   free(pc);
 }
@@ -0,0 +1,129 @@
+/* Copyright (c) 2008, Matthew W. Jones
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, 
+ *   this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice, 
+ *   this list of conditions and the following disclaimer in the documentation 
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* ProcAn kernel counters */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include "procan.h"
+#include "counters.h"
+
+extern procan_config *pc;
+
+static const char *kind_names[COUNTER_KINDS] = {"majflt", "ctxsw", "threads"};
+
+static counter_state *counters = NULL;
+
+void counters_reserve(int oldn, int n)
+{
+    if ((counters = realloc(counters, n * sizeof(counter_state))) == NULL)
+        {
+            printf("malloc error, can not allocate memory.\n");
+            exit(-1);
+        }
+    memset(&counters[oldn], 0, (n - oldn) * sizeof(counter_state));
+}
+
+void counters_free(void)
+{
+    free(counters);
+    counters = NULL;
+}
+
+void counters_init(int slot, proc_statistics *ps)
+{
+    counter_state *cs = &counters[slot];
+
+    memset(cs, 0, sizeof(counter_state));
+    cs->majflt = ps->_majflt;
+    cs->minflt = ps->_minflt;
+    cs->vcsw = ps->_vcsw;
+    cs->ivcsw = ps->_ivcsw;
+    cs->threads = ps->_threads;
+}
+
+/* Per second rate of a counter that went from last to now over dt ns,
+ * 0 when either is unknown or the counter went backwards.
+ */
+static int rate(long long last, long long now, unsigned long long dt)
+{
+    if (last < 0 || now < last || dt == 0)
+        return 0;
+    return (int)((double)(now - last) * 1000000000.0 / dt);
+}
+
+/* Count a busy sample towards a streak, a whole streak is worth COUNTER_SCORE */
+static void streak(counter_state *cs, int kind, int busy, unsigned long long dt)
+{
+    if (busy)
+        cs->streak[kind]++;
+    else if (dt > 0)
+        cs->streak[kind] = 0;
+    if (cs->streak[kind] >= COUNTER_STREAK)
+        {
+            cs->streak[kind] = 0;
+            cs->change[kind] = COUNTER_SCORE;
+        }
+}
+
+void counters_update(int slot, proc_statistics *ps, unsigned long long lastsample)
+{
+    counter_state *cs = &counters[slot];
+    int faultbusy = (pc == NULL || pc->faultbusy == 0) ? DEFAULT_FAULT_BUSY : pc->faultbusy;
+    int ctxswbusy = (pc == NULL || pc->ctxswbusy == 0) ? DEFAULT_CTXSW_BUSY : pc->ctxswbusy;
+    unsigned long long dt = (ps->_sampletime > lastsample) ? ps->_sampletime - lastsample : 0;
+
+    cs->majflt_rate = rate(cs->majflt, ps->_majflt, dt);
+    cs->minflt_rate = rate(cs->minflt, ps->_minflt, dt);
+    cs->vcsw_rate = rate(cs->vcsw, ps->_vcsw, dt);
+    cs->ivcsw_rate = rate(cs->ivcsw, ps->_ivcsw, dt);
+    streak(cs, COUNTER_MAJFLT, faultbusy > 0 && cs->majflt_rate >= faultbusy, dt);
+    streak(cs, COUNTER_CTXSW, ctxswbusy > 0 && cs->vcsw_rate + cs->ivcsw_rate >= ctxswbusy, dt);
+    streak(cs, COUNTER_THREADS, cs->threads > 0 && ps->_threads > cs->threads, dt);
+    cs->majflt = ps->_majflt;
+    cs->minflt = ps->_minflt;
+    cs->vcsw = ps->_vcsw;
+    cs->ivcsw = ps->_ivcsw;
+    cs->threads = ps->_threads;
+}
+
+int counters_change(int slot, int kind)
+{
+    int change = counters[slot].change[kind];
+    counters[slot].change[kind] = 0;
+    return change;
+}
+
+const char* counters_name(int kind)
+{
+    return kind_names[kind];
+}
+
+counter_state* counters_get(int slot)
+{
+    return &counters[slot];
+}
@@ -0,0 +1,57 @@
+/* ProcAn kernel counters
+ * Page faults, context switches and thread counts come along with the
+ * stat and status reads the collector already makes.  The analyzer
+ * turns the totals into rates between samples: a major fault storm or
+ * a run of context switches that lasts COUNTER_STREAK samples raises
+ * "majflt" or "ctxsw" interest, and so does a thread count that grows
+ * on that many samples in a row, for "threads".  A pool that grows and
+ * shrinks as work comes and goes is left alone.
+ */
+
+#define COUNTER_MAJFLT 0              /* Interest kinds */
+#define COUNTER_CTXSW 1
+#define COUNTER_THREADS 2
+#define COUNTER_KINDS 3
+
+#define DEFAULT_FAULT_BUSY 100        /* Major faults a second that count as a storm */
+#define DEFAULT_CTXSW_BUSY 10000      /* Context switches a second that count as busy */
+#define COUNTER_STREAK 3              /* Busy samples in a row that raise interest */
+#define COUNTER_SCORE 5               /* Score added each time */
+
+typedef struct
+{
+    long long majflt;         /* Totals of the last sample, -1 if unknown */
+    long long minflt;
+    long long vcsw;           /* Voluntary context switches, waiting on locks and io */
+    long long ivcsw;          /* Involuntary ones, preempted for the processor */
+    int threads;              /* 0 if unknown */
+    int majflt_rate;          /* Per second between the last two samples */
+    int minflt_rate;
+    int vcsw_rate;
+    int ivcsw_rate;
+    int streak[COUNTER_KINDS];
+    int change[COUNTER_KINDS];   /* Score from the sample being scored */
+}counter_state;
+
+/* Make room for counters in slots [oldn, n) */
+void counters_reserve(int oldn, int n);
+
+/* Free the counters slab */
+void counters_free(void);
+
+/* Start a slot's counters from its first sample */
+void counters_init(int slot, proc_statistics *ps);
+
+/* Work out a slot's rates from a new sample taken lastsample ns after
+ * the one before, and the score each kind of interest should get.
+ */
+void counters_update(int slot, proc_statistics *ps, unsigned long long lastsample);
+
+/* Take the score a kind of interest got from the last update, 0 if none */
+int counters_change(int slot, int kind);
+
+/* Name of an interest kind, as reported */
+const char* counters_name(int kind);
+
+/* Fetch the counters of a slot */
+counter_state* counters_get(int slot);
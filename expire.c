@@ -0,0 +1,159 @@
+/* Copyright (c) 2008, Matthew W. Jones
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, 
+ *   this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice, 
+ *   this list of conditions and the following disclaimer in the documentation 
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* ProcAn history expiry */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "expire.h"
+
+#define EXPIRE_BUCKETS (2 * EXPIRE_WHEEL)
+
+/* Buckets are doubly linked lists threaded through the per-slot arrays */
+static int buckets[EXPIRE_BUCKETS];
+static int *enext = NULL;
+static int *eprev = NULL;
+static int *ebucket = NULL;    /* Bucket a slot is on, -1 if none */
+static long *ewhen = NULL;
+static long wheel_now = 0;     /* Last second the wheel was turned to */
+static int wheel_ready = 0;
+
+void expire_reserve(int oldn, int n)
+{
+    int i;
+
+    if ((enext = realloc(enext, n * sizeof(int))) == NULL ||
+        (eprev = realloc(eprev, n * sizeof(int))) == NULL ||
+        (ebucket = realloc(ebucket, n * sizeof(int))) == NULL ||
+        (ewhen = realloc(ewhen, n * sizeof(long))) == NULL)
+        {
+            printf("malloc error, can not allocate memory.\n");
+            exit(-1);
+        }
+    if (!wheel_ready)
+        {
+            for (i = 0; i < EXPIRE_BUCKETS; i++)
+                buckets[i] = -1;
+            wheel_ready = 1;
+        }
+    for (i = oldn; i < n; i++)
+        ebucket[i] = -1;
+}
+
+void expire_free(void)
+{
+    free(enext);
+    free(eprev);
+    free(ebucket);
+    free(ewhen);
+    enext = eprev = ebucket = NULL;
+    ewhen = NULL;
+    wheel_ready = 0;
+    wheel_now = 0;
+}
+
+void expire_cancel(int slot)
+{
+    int b = ebucket[slot];
+
+    if (b < 0)
+        return;
+    if (eprev[slot] >= 0)
+        enext[eprev[slot]] = enext[slot];
+    else
+        buckets[b] = enext[slot];
+    if (enext[slot] >= 0)
+        eprev[enext[slot]] = eprev[slot];
+    ebucket[slot] = -1;
+}
+
+/* Hang a slot on the bucket its time falls in, a time too far out for
+ * the second level is pulled in to the last second it can hold.  The
+ * time may be the current second while a second level bucket is being
+ * spread out, the first level bucket for it is turned right after.
+ */
+static void insert(int slot, long when)
+{
+    long delta;
+    int b;
+
+    delta = when - wheel_now;
+    if (delta >= EXPIRE_WHEEL * EXPIRE_WHEEL)
+        when = wheel_now + EXPIRE_WHEEL * EXPIRE_WHEEL - 1;
+    if (delta < EXPIRE_WHEEL)
+        b = when % EXPIRE_WHEEL;
+    else
+        b = EXPIRE_WHEEL + (when / EXPIRE_WHEEL) % EXPIRE_WHEEL;
+    ewhen[slot] = when;
+    ebucket[slot] = b;
+    eprev[slot] = -1;
+    enext[slot] = buckets[b];
+    if (enext[slot] >= 0)
+        eprev[enext[slot]] = slot;
+    buckets[b] = slot;
+}
+
+void expire_schedule(int slot, long when)
+{
+    if (wheel_now == 0)   /* Not turned yet */
+        wheel_now = when - 1;
+    expire_cancel(slot);
+    insert(slot, (when > wheel_now) ? when : wheel_now + 1);
+}
+
+void expire_advance(long now, void (*fire)(int slot, long now))
+{
+    int b, slot;
+
+    if (wheel_now == 0)
+        wheel_now = now;
+    if (now <= wheel_now)
+        return;
+    /* Far behind (the clock jumped), everything is due anyway */
+    if (now - wheel_now > EXPIRE_WHEEL * EXPIRE_WHEEL)
+        wheel_now = now - EXPIRE_WHEEL * EXPIRE_WHEEL;
+    while (wheel_now < now)
+        {
+            wheel_now++;
+            if (wheel_now % EXPIRE_WHEEL == 0)   /* Spread the next second level bucket out */
+                {
+                    b = EXPIRE_WHEEL + (wheel_now / EXPIRE_WHEEL) % EXPIRE_WHEEL;
+                    while ((slot = buckets[b]) >= 0)
+                        {
+                            expire_cancel(slot);
+                            insert(slot, ewhen[slot]);
+                        }
+                }
+            b = wheel_now % EXPIRE_WHEEL;
+            while ((slot = buckets[b]) >= 0)
+                {
+                    expire_cancel(slot);
+                    if (ewhen[slot] > wheel_now)
+                        insert(slot, ewhen[slot]);
+                    else
+                        fire(slot, wheel_now);
+                }
+        }
+}
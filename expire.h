@@ -0,0 +1,29 @@
+/* ProcAn history expiry
+ * A two level timer wheel of seconds that tells the analyzer when a
+ * history slot may have expired.  The first level has a bucket per
+ * second, the second a bucket per EXPIRE_WHEEL seconds that is spread
+ * over the first as it comes around.  Scheduling, cancelling and firing
+ * a slot are O(1).
+ */
+
+#define EXPIRE_WHEEL 64               /* Buckets per level */
+#define EXPIRE_IDLE 30                /* Seconds a slot may go unmeasured before it expires */
+#define EXPIRE_GRACE 10               /* Seconds the history of an exited process is kept */
+
+/* Make room for slots [oldn, n) on the wheel */
+void expire_reserve(int oldn, int n);
+
+/* Free the wheel */
+void expire_free(void);
+
+/* Fire a slot at when (wall clock seconds), replacing any earlier schedule */
+void expire_schedule(int slot, long when);
+
+/* Take a slot off the wheel */
+void expire_cancel(int slot);
+
+/* Turn the wheel up to now, handing every slot that is due to fire().
+ * fire() may schedule the slot again.  The first call sets the wheel's
+ * clock, it should come before anything is scheduled.
+ */
+void expire_advance(long now, void (*fire)(int slot, long now));
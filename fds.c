@@ -0,0 +1,161 @@
+/* Copyright (c) 2008, Matthew W. Jones
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, 
+ *   this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice, 
+ *   this list of conditions and the following disclaimer in the documentation 
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* ProcAn descriptor leak detector */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include "procan.h"
+#include "backend.h"
+#include "instrument.h"
+#include "names.h"
+#include "fds.h"
+
+extern pthread_mutex_t procchart_mutex;
+extern proc_averages *procavs;
+extern procan_config *pc;
+
+static fd_state *fdstates = NULL;
+static int *watched = NULL;           /* Slots near their limit or alerted on */
+static int nwatched = 0;
+
+void fds_reserve(int oldn, int n)
+{
+    int i;
+
+    if ((fdstates = realloc(fdstates, n * sizeof(fd_state))) == NULL ||
+        (watched = realloc(watched, n * sizeof(int))) == NULL)
+        {
+            printf("malloc error, can not allocate memory.\n");
+            exit(-1);
+        }
+    for (i = oldn; i < n; i++)
+        {
+            fdstates[i].watched = 0;
+            fds_init(i);
+        }
+}
+
+void fds_free(void)
+{
+    free(fdstates);
+    free(watched);
+    fdstates = NULL;
+    watched = NULL;
+    nwatched = 0;
+}
+
+/* A slot stays in the watched list until the next fds_alert finds it
+ * below its limits, even if the slot is handed to another process.
+ */
+void fds_init(int slot)
+{
+    fdstates[slot].fds = -1;
+    fdstates[slot].limit = -1;
+    fdstates[slot].streak = 0;
+    fdstates[slot].level = 0;
+}
+
+/* The lowest percent of the limit that alerts, 0 if none does */
+static int fd_lowest(procan_config *pc)
+{
+    int warn = (pc == NULL || pc->fdwarn == 0) ? DEFAULT_FD_WARN : pc->fdwarn;
+    int alarm = (pc == NULL || pc->fdalarm == 0) ? DEFAULT_FD_ALARM : pc->fdalarm;
+
+    if (warn > 0 && (alarm <= 0 || warn < alarm))
+        return warn;
+    return (alarm > 0) ? alarm : 0;
+}
+
+int fds_update(int slot, int fds, long limit)
+{
+    fd_state *fs = &fdstates[slot];
+    int lowest = fd_lowest(pc);
+    int change = 0;
+
+    if (fs->fds >= 0 && fds > fs->fds)
+        fs->streak++;
+    else if (fds < fs->fds)
+        fs->streak = 0;
+    if (fs->streak >= FD_STREAK)
+        {
+            fs->streak = 0;
+            change = FD_SCORE;
+        }
+    fs->fds = fds;
+    fs->limit = limit;
+    if (!fs->watched && lowest > 0 && limit > 0 && fds * 100LL / limit >= lowest)
+        {
+            fs->watched = 1;
+            watched[nwatched++] = slot;
+        }
+    return change;
+}
+
+fd_state* fds_get(int slot)
+{
+    return &fdstates[slot];
+}
+
+void fds_alert(procan_config *pc, long now)
+{
+    int warn = (pc->fdwarn != 0) ? pc->fdwarn : DEFAULT_FD_WARN;
+    int alarm = (pc->fdalarm != 0) ? pc->fdalarm : DEFAULT_FD_ALARM;
+    int lowest = fd_lowest(pc);
+    int i, j, slot, level, used;
+    char what[40];
+    char msg[150];
+    fd_state *fs;
+
+    instr_lock(&procchart_mutex, INSTR_PROCCHART_WAIT);
+    for (i = 0, j = 0; i < nwatched; i++)
+        {
+            slot = watched[i];
+            fs = &fdstates[slot];
+            used = 0;
+            if (fs->fds >= 0 && fs->limit > 0 && procavs[slot].gone_time == 0)
+                used = (int)(fs->fds * 100LL / fs->limit);
+            level = 0;
+            if (alarm > 0 && used >= alarm)
+                level = ALERT_ALARM;
+            else if (warn > 0 && used >= warn)
+                level = ALERT_WARNING;
+            if (level > fs->level)
+                {
+                    snprintf(what, 40, "fd:%s", name_text(procavs[slot].name));
+                    snprintf(msg, 150, "%s (%i) has %i descriptors open, %i%% of its limit of %li",
+                             name_text(procavs[slot].name), procavs[slot].lastpid, fs->fds, used, fs->limit);
+                }
+            backend_escalate(pc, &fs->level, level, what, fs->fds, msg);
+            if (fs->level > 0 || (lowest > 0 && used >= lowest))
+                watched[j++] = slot;
+            else
+                fs->watched = 0;
+        }
+    nwatched = j;
+    pthread_mutex_unlock(&procchart_mutex);
+}
@@ -0,0 +1,45 @@
+/* ProcAn descriptor leak detector
+ * Every fdevery cycles the collector counts the open descriptors of each
+ * process (a slice of the pids each cycle) and reads its RLIMIT_NOFILE.
+ * A count that keeps growing over FD_STREAK counts raises "fd" interest,
+ * and processes nearing their descriptor limit are alerted on directly,
+ * at fdwarn and fdalarm percent of the soft limit.
+ */
+
+#define DEFAULT_FD_EVERY 10           /* Cycles between counts of a process */
+#define FD_STREAK 3                   /* Counts in a row that must grow */
+#define FD_SCORE 5                    /* Score added for sustained growth */
+#define DEFAULT_FD_WARN 80            /* Percent of RLIMIT_NOFILE that raises a warning */
+#define DEFAULT_FD_ALARM 95           /* Percent that raises an alarm */
+
+typedef struct
+{
+    int fds;                  /* Last count, -1 before the first */
+    long limit;               /* Soft RLIMIT_NOFILE, -1 if unknown */
+    int streak;               /* Counts in a row that grew */
+    int level;                /* ALERT_* level of the last limit alert, 0 if none */
+    int watched;              /* In the list of slots near their limit */
+}fd_state;
+
+/* Make room for descriptor counts in slots [oldn, n) */
+void fds_reserve(int oldn, int n);
+
+/* Free the descriptor counts */
+void fds_free(void);
+
+/* Forget what a slot counted before */
+void fds_init(int slot);
+
+/* Add a new count for a slot.  Returns the score to add, 0 if the
+ * count is not growing steadily.
+ */
+int fds_update(int slot, int fds, long limit);
+
+/* Fetch the descriptor count of a slot */
+fd_state* fds_get(int slot);
+
+/* Raise warnings and alarms for processes close to their descriptor
+ * limit.  Only slots counted at or above fdwarn are looked at.  Called
+ * from the analyzer with pconfig_mutex held.
+ */
+void fds_alert(procan_config *pc, long now);
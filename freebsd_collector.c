@@ -41,6 +41,9 @@
 
 #include "procan.h"
 #include "freebsd_collector.h"
+#include "instrument.h"
+#include "ticker.h"
+#include "names.h"
 
 /* The collector thread is responsible
  * for collecting data about running processes
@@ -55,8 +58,12 @@ void* collector_thread(void *a)
   int numprocs;
   int i;
   int hangup = 0;
+  int interval = 0;
+  ticker cadence;
+  unsigned long long start;
 
-  pthread_mutex_lock(&procsnap_mutex);
+  ticker_init(&cadence, INSTR_COLLECT_INTERVAL);
+  instr_lock(&procsnap_mutex, INSTR_PROCSNAP_WAIT);
   
   /* Initialize access to the KVM Interface */
     if ((kaccess = kvm_openfiles(_PATH_DEVNULL,_PATH_DEVNULL,NULL,O_RDONLY, ebuffer)) == NULL)
@@ -66,6 +73,7 @@ void* collector_thread(void *a)
     }
   while (!hangup)    /* Thread run loop */
     {
+      start = instr_now();
       if ((kprocaccess = kvm_getprocs(kaccess, KERN_PROC_ALL, 
 				      (int)getuid(), &numprocs)) == NULL)
 	{
@@ -86,16 +94,31 @@ void* collector_thread(void *a)
       for (i = 0; i < numprocs; i++)
 	{ /* For each running process we do this and drop it into the array. */
 	  procsnap[i]._pid = kprocaccess->ki_pid;
+	  procsnap[i]._ppid = kprocaccess->ki_ppid;
 	  procsnap[i]._uid = kprocaccess->ki_uid;
-	  procsnap[i]._command = kprocaccess->ki_comm;
+	  procsnap[i]._cgroup = 0;
+	  procsnap[i]._name = name_intern(kprocaccess->ki_comm);
 	  procsnap[i]._rssize = kprocaccess->ki_rssize;
 	  procsnap[i]._size = kprocaccess->ki_size;
 	  procsnap[i]._perc = kprocaccess->ki_pctcpu;
 	  procsnap[i]._age = kprocaccess->ki_runtime;
 	  procsnap[i]._read = 0;
-	  //printf("%i -> %s\n",procsnap[i]._pid,procsnap[i]._command);
+	  procsnap[i]._cputime = (long)(kprocaccess->ki_runtime / 1000);
+	  procsnap[i]._sampletime = start;
+	  procsnap[i]._starttime = (unsigned long long)kprocaccess->ki_start.tv_sec * 1000000ULL
+	    + kprocaccess->ki_start.tv_usec;
+	  procsnap[i]._iobytes = -1;
+	  procsnap[i]._iocalls = kprocaccess->ki_rusage.ru_inblock + kprocaccess->ki_rusage.ru_oublock;
+	  procsnap[i]._majflt = kprocaccess->ki_rusage.ru_majflt;
+	  procsnap[i]._minflt = kprocaccess->ki_rusage.ru_minflt;
+	  procsnap[i]._vcsw = kprocaccess->ki_rusage.ru_nvcsw;
+	  procsnap[i]._ivcsw = kprocaccess->ki_rusage.ru_nivcsw;
+	  procsnap[i]._threads = kprocaccess->ki_numthreads;
+	  //printf("%i -> %s\n",procsnap[i]._pid,name_text(procsnap[i]._name));
 	  kprocaccess++;
 	}
+      instr_record(INSTR_COLLECT_TIME, instr_now() - start);
+      instr_record(INSTR_COLLECT_PROCS, numprocs);
       pthread_mutex_unlock(&procsnap_mutex);
       pthread_mutex_lock(&hangup_mutex);
       if(m_hangup)
@@ -103,10 +126,20 @@ void* collector_thread(void *a)
       pthread_mutex_unlock(&hangup_mutex);
       if (!hangup)
 	{
-	  sleep(1);
-	  pthread_mutex_lock(&procsnap_mutex);
+	  pthread_mutex_lock(&pconfig_mutex);
+	  interval = (pc != NULL) ? pc->interval : 0;
+	  pthread_mutex_unlock(&pconfig_mutex);
+	  ticker_wait(&cadence, cycle_interval(interval) * 1000000ULL);
+	  instr_lock(&procsnap_mutex, INSTR_PROCSNAP_WAIT);
 	}
     }
   kvm_close(kaccess);
+  ticker_free(&cadence);
   return NULL;
 }
+
+/* Command lines are only gathered by the Linux collector */
+int get_cmdline(int pid, char *buf, int len)
+{
+  return -1;
+}
@@ -0,0 +1,191 @@
+/* Copyright (c) 2008, Matthew W. Jones
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* ProcAn self-instrumentation */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <time.h>
+#include <pthread.h>
+#include "instrument.h"
+
+static instr_hist hists[INSTR_NHISTS];
+
+static const char *hist_names[INSTR_NHISTS] = {"collect_ns", "collect_procs",
+                                               "analyze_ns", "procsnap_wait_ns",
+                                               "procchart_wait_ns", "backend_ns",
+                                               "cycle_allocs", "collect_interval_ns",
+                                               "analyze_interval_ns", "overruns"};
+
+static long nallocs = 0;
+
+#if defined (linux)
+/* Allocation accounting, the Linux targets link with --wrap so every
+ * allocation made by procan's own objects passes through here.
+ */
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+    __sync_fetch_and_add(&nallocs, 1);
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size)
+{
+    __sync_fetch_and_add(&nallocs, 1);
+    return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    __sync_fetch_and_add(&nallocs, 1);
+    return __real_realloc(ptr, size);
+}
+#endif
+
+long instr_allocs(void)
+{
+    return nallocs;
+}
+
+unsigned long long instr_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Values below 2^INSTR_SUB_BITS get their own bucket, above that every
+ * power of two is split into 2^INSTR_SUB_BITS linear buckets.
+ */
+static int bucket_of(unsigned long long value)
+{
+    int shift;
+    if (value < (1ULL << INSTR_SUB_BITS))
+        return (int)value;
+    shift = (63 - __builtin_clzll(value)) - INSTR_SUB_BITS;
+    return ((shift + 1) << INSTR_SUB_BITS) +
+        (int)((value >> shift) & ((1ULL << INSTR_SUB_BITS) - 1));
+}
+
+/* The largest value that falls into a bucket */
+static unsigned long long bucket_top(int bucket)
+{
+    int shift;
+    unsigned long long mant;
+    if (bucket < (1 << INSTR_SUB_BITS))
+        return bucket;
+    shift = (bucket >> INSTR_SUB_BITS) - 1;
+    mant = (1ULL << INSTR_SUB_BITS) + (bucket & ((1 << INSTR_SUB_BITS) - 1));
+    return ((mant + 1) << shift) - 1;
+}
+
+void instr_record(int hist, unsigned long long value)
+{
+    instr_hist *h = &hists[hist];
+    __sync_fetch_and_add(&h->buckets[bucket_of(value)], 1);
+    __sync_fetch_and_add(&h->count, 1);
+    __sync_fetch_and_add(&h->total, value);
+    if (value > h->max)
+        h->max = value;
+}
+
+void instr_lock(pthread_mutex_t *m, int hist)
+{
+    unsigned long long start;
+    if (pthread_mutex_trylock(m) == 0)
+        {
+            instr_record(hist, 0);
+            return;
+        }
+    start = instr_now();
+    pthread_mutex_lock(m);
+    instr_record(hist, instr_now() - start);
+}
+
+unsigned long long instr_percentile(int hist, double pct)
+{
+    instr_hist *h = &hists[hist];
+    unsigned long want, seen = 0;
+    unsigned long long top;
+    int i;
+
+    if (h->count == 0)
+        return 0;
+    want = (unsigned long)((pct / 100.0) * h->count);
+    if (want < 1)
+        want = 1;
+    for (i = 0; i < INSTR_BUCKETS; i++)
+        {
+            seen += h->buckets[i];
+            if (seen >= want)
+                break;
+        }
+    top = bucket_top(i);
+    return (top > h->max) ? h->max : top;
+}
+
+void instr_format(int hist, char *buf, int len)
+{
+    instr_hist *h = &hists[hist];
+    snprintf(buf, len, "%-18s %9lu %11llu %11llu %11llu %11llu %11llu",
+             hist_names[hist], h->count,
+             (h->count > 0) ? h->total / h->count : 0,
+             instr_percentile(hist, 50.0),
+             instr_percentile(hist, 90.0),
+             instr_percentile(hist, 99.0),
+             h->max);
+}
+
+void instr_syslog(void)
+{
+    char line[120];
+    int i;
+    openlog("procan", LOG_CONS, LOG_DAEMON);
+    syslog(LOG_NOTICE, "Instrumentation: %-18s %9s %11s %11s %11s %11s %11s",
+           "histogram", "count", "mean", "p50", "p90", "p99", "max");
+    for (i = 0; i < INSTR_NHISTS; i++)
+        {
+            instr_format(i, line, 120);
+            syslog(LOG_NOTICE, "Instrumentation: %s", line);
+        }
+    closelog();
+}
+
+void instr_pipe(void)
+{
+    int i;
+    for (i = 0; i < INSTR_NHISTS; i++)
+        fprintf(stdout, "[stats,%s,%lu,%llu,%llu,%llu]\n", hist_names[i],
+                hists[i].count,
+                instr_percentile(i, 50.0),
+                instr_percentile(i, 99.0),
+                hists[i].max);
+    fflush(stdout);
+}
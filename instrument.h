@@ -0,0 +1,51 @@
+/* ProcAn self-instrumentation
+ * Fixed bucket log-linear histograms recording how long procan spends
+ * collecting, analyzing, waiting on its mutexes and running backends.
+ */
+
+#define INSTR_SUB_BITS 3              /* Linear sub-buckets per power of two (2^3) */
+#define INSTR_BUCKETS ((64 - INSTR_SUB_BITS + 1) << INSTR_SUB_BITS)
+
+#define INSTR_COLLECT_TIME 0          /* ns spent in one collector scan */
+#define INSTR_COLLECT_PROCS 1         /* Processes seen by one collector scan */
+#define INSTR_ANALYZE_TIME 2          /* ns spent in one analyzer pass */
+#define INSTR_PROCSNAP_WAIT 3         /* ns spent waiting on procsnap_mutex */
+#define INSTR_PROCCHART_WAIT 4        /* ns spent waiting on procchart_mutex */
+#define INSTR_BACKEND_TIME 5          /* ns spent dispatching to the backends */
+#define INSTR_CYCLE_ALLOCS 6          /* Allocations made during one analyzer cycle */
+#define INSTR_COLLECT_INTERVAL 7      /* Actual ns between collector ticks */
+#define INSTR_ANALYZE_INTERVAL 8      /* Actual ns between analyzer cycles */
+#define INSTR_OVERRUNS 9              /* Ticks missed each time a cycle overran */
+#define INSTR_NHISTS 10
+
+typedef struct
+{
+  unsigned long count;
+  unsigned long long total;
+  unsigned long long max;
+  unsigned long buckets[INSTR_BUCKETS];
+}instr_hist;
+
+/* Monotonic clock in nanoseconds */
+unsigned long long instr_now(void);
+
+/* Record a single value into one of the histograms */
+void instr_record(int hist, unsigned long long value);
+
+/* Lock a mutex, recording how long we waited for it */
+void instr_lock(pthread_mutex_t *m, int hist);
+
+/* Fetch the value below which pct percent of the recorded values fall */
+unsigned long long instr_percentile(int hist, double pct);
+
+/* Total allocations made by procan so far (Linux only, 0 elsewhere) */
+long instr_allocs(void);
+
+/* Format a one line summary of a histogram into buf */
+void instr_format(int hist, char *buf, int len);
+
+/* Dump every histogram to syslog */
+void instr_syslog(void);
+
+/* Write every histogram as a pipe mode stats record */
+void instr_pipe(void);
@@ -0,0 +1,155 @@
+/* Copyright (c) 2008, Matthew W. Jones
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, 
+ *   this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice, 
+ *   this list of conditions and the following disclaimer in the documentation 
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* ProcAn disk io accounting */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include "procan.h"
+#include "backend.h"
+#include "instrument.h"
+#include "names.h"
+#include "io.h"
+
+extern pthread_mutex_t procchart_mutex;
+extern proc_averages *procavs;
+extern procan_config *pc;
+
+static int *watched = NULL;           /* Slots with io interest or an io alert */
+static int nwatched = 0;
+
+void io_reserve(int oldn, int n)
+{
+    if ((watched = realloc(watched, n * sizeof(int))) == NULL)
+        {
+            printf("malloc error, can not allocate memory.\n");
+            exit(-1);
+        }
+}
+
+void io_free(void)
+{
+    free(watched);
+    watched = NULL;
+    nwatched = 0;
+}
+
+/* io_watched is left alone, a slot stays in the list until the next
+ * io_alert finds it quiet even if the slot goes to another process.
+ */
+void io_init(int slot, proc_statistics *ps)
+{
+    proc_averages *pav = &procavs[slot];
+
+    pav->last_iobytes = ps->_iobytes;
+    pav->last_iocalls = ps->_iocalls;
+    pav->io_rate = 0;
+    pav->io_calls = 0;
+    pav->io_busy = 0;
+    pav->io_change = 0;
+    pav->iintrests = 0;
+    pav->decayed_io = 0;
+    pav->io_level = 0;
+}
+
+/* Per second rate of a counter that went from last to now over dt ns,
+ * 0 when either is unknown or the counter went backwards.
+ */
+static int rate(long long last, long long now, unsigned long long dt, int unit)
+{
+    if (last < 0 || now < last || dt == 0)
+        return 0;
+    return (int)((double)(now - last) * 1000000000.0 / dt / unit);
+}
+
+int io_update(int slot, proc_statistics *ps)
+{
+    proc_averages *pav = &procavs[slot];
+    int busykb = (pc == NULL || pc->iobusy == 0) ? DEFAULT_IO_BUSY : pc->iobusy;
+    unsigned long long dt = 0;
+
+    pav->io_change = 0;
+    if (ps->_sampletime > pav->last_sample_time)
+        dt = ps->_sampletime - pav->last_sample_time;
+    pav->io_rate = rate(pav->last_iobytes, ps->_iobytes, dt, 1024);
+    pav->io_calls = rate(pav->last_iocalls, ps->_iocalls, dt, 1);
+    pav->last_iobytes = ps->_iobytes;
+    pav->last_iocalls = ps->_iocalls;
+    if ((busykb > 0 && pav->io_rate >= busykb) || pav->io_calls >= IO_CALLS_BUSY)
+        pav->io_busy++;
+    else if (dt > 0)
+        pav->io_busy = 0;
+    if (pav->io_busy >= IO_STREAK)
+        {
+            pav->io_busy = 0;
+            pav->io_change = IO_SCORE;
+            if (!pav->io_watched)
+                {
+                    pav->io_watched = 1;
+                    watched[nwatched++] = slot;
+                }
+        }
+    return pav->io_change;
+}
+
+void io_alert(procan_config *pc, long now)
+{
+    int warn = (pc->iowarnlevel != 0) ? pc->iowarnlevel : DEFAULT_IO_WARN;
+    int alarm = (pc->ioalarmlevel != 0) ? pc->ioalarmlevel : DEFAULT_IO_ALARM;
+    int i, j, slot, level, intrests;
+    char what[40];
+    char msg[150];
+    proc_averages *pav;
+
+    instr_lock(&procchart_mutex, INSTR_PROCCHART_WAIT);
+    for (i = 0, j = 0; i < nwatched; i++)
+        {
+            slot = watched[i];
+            pav = &procavs[slot];
+            decay_slot(slot, now);
+            intrests = (int)(pav->decayed_io + 0.5f);
+            level = 0;
+            if (alarm > 0 && intrests > alarm)
+                level = ALERT_ALARM;
+            else if (warn > 0 && intrests > warn)
+                level = ALERT_WARNING;
+            if (level > pav->io_level)
+                {
+                    snprintf(what, 40, "io:%s", name_text(pav->name));
+                    snprintf(msg, 150, "%s (%i) keeps disks busy, %i KB/s and %i calls/s "
+                             "with io interest %i", name_text(pav->name), pav->lastpid,
+                             pav->io_rate, pav->io_calls, intrests);
+                }
+            backend_escalate(pc, &pav->io_level, level, what, intrests, msg);
+            if (intrests > 0 || pav->io_level > 0)
+                watched[j++] = slot;
+            else
+                pav->io_watched = 0;
+        }
+    nwatched = j;
+    pthread_mutex_unlock(&procchart_mutex);
+}
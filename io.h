@@ -0,0 +1,37 @@
+/* ProcAn disk io accounting
+ * The collector reads how many bytes each process has read and written
+ * and how many read and write calls it has made (Linux /proc/<pid>/io,
+ * block operations on the BSDs).  The analyzer turns the totals into
+ * rates between samples, a process that keeps busy for IO_STREAK
+ * samples in a row gets "io" interest, and io interests past iowarnlevel
+ * and ioalarmlevel are alerted on separately from the overall score.
+ */
+
+#define DEFAULT_IO_BUSY 1024          /* KB a second of reads and writes that count as busy */
+#define IO_CALLS_BUSY 5000            /* Read and write calls a second that count as busy */
+#define IO_STREAK 5                   /* Busy samples in a row that raise io interest */
+#define IO_SCORE 5                    /* Score added each time */
+#define DEFAULT_IO_WARN 5             /* Decayed io interests that raise a warning */
+#define DEFAULT_IO_ALARM 15           /* Decayed io interests that raise an alarm */
+
+/* Make room in the list of slots with io interest for slots [oldn, n) */
+void io_reserve(int oldn, int n);
+
+/* Free the list of slots with io interest */
+void io_free(void);
+
+/* Start tracking the io of a slot from its first sample */
+void io_init(int slot, proc_statistics *ps);
+
+/* Work out the io rates of a slot from a new sample, before the slot's
+ * last_sample_time is moved on.  Returns the score the pass should add,
+ * which is also left in io_change.
+ */
+int io_update(int slot, proc_statistics *ps);
+
+/* Raise warnings and alarms for processes with too much io interest.
+ * Only slots that have had io interest since they last decayed to
+ * nothing are looked at.  Called from the analyzer with pconfig_mutex
+ * held.
+ */
+void io_alert(procan_config *pc, long now);
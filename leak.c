@@ -0,0 +1,274 @@
+/* Copyright (c) 2008, Matthew W. Jones
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, 
+ *   this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice, 
+ *   this list of conditions and the following disclaimer in the documentation 
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* ProcAn leak detector */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include "procan.h"
+#include "backend.h"
+#include "instrument.h"
+#include "leak.h"
+#include "names.h"
+
+extern pthread_mutex_t procchart_mutex;
+extern proc_averages *procavs;
+extern procan_config *pc;
+
+static const int window_secs[LEAK_WINDOWS] = {300, 3600, 21600};
+static const char *window_names[LEAK_WINDOWS] = {"5 minutes", "hour", "6 hours"};
+
+/* LEAK_WINDOWS windows per slot, along with when each slot started */
+static leak_window *windows = NULL;
+static unsigned long long *leak_base = NULL;
+
+/* Leaks found since the last leak_alert, per slot, and the slots that have one */
+static leak_news *news = NULL;
+static int *newslots = NULL;
+static int nnewslots = 0;
+
+const char* leak_window_name(int w)
+{
+    return window_names[w];
+}
+
+void leak_reserve(int oldn, int n)
+{
+    if ((windows = realloc(windows, n * LEAK_WINDOWS * sizeof(leak_window))) == NULL ||
+        (leak_base = realloc(leak_base, n * sizeof(unsigned long long))) == NULL ||
+        (news = realloc(news, n * sizeof(leak_news))) == NULL ||
+        (newslots = realloc(newslots, n * sizeof(int))) == NULL)
+        {
+            printf("malloc error, can not allocate memory.\n");
+            exit(-1);
+        }
+    memset(&windows[oldn * LEAK_WINDOWS], 0, (n - oldn) * LEAK_WINDOWS * sizeof(leak_window));
+    memset(&leak_base[oldn], 0, (n - oldn) * sizeof(unsigned long long));
+    memset(&news[oldn], 0, (n - oldn) * sizeof(leak_news));
+}
+
+void leak_free(void)
+{
+    free(windows);
+    free(leak_base);
+    free(news);
+    free(newslots);
+    windows = NULL;
+    leak_base = NULL;
+    news = NULL;
+    newslots = NULL;
+    nnewslots = 0;
+}
+
+void leak_init(int slot, unsigned long long now)
+{
+    memset(&windows[slot * LEAK_WINDOWS], 0, LEAK_WINDOWS * sizeof(leak_window));
+    leak_base[slot] = now;
+    news[slot].windows = 0;
+    procavs[slot].leaking = 0;
+    procavs[slot].leak_rate = 0;
+}
+
+/* Rebuild the sums from the points, so rounding left behind by the
+ * points that slid out of the window does not pile up.
+ */
+static void rebuild_sums(leak_window *lw)
+{
+    int i;
+    lw->st = lw->sx = lw->stt = lw->stx = lw->sxx = 0;
+    for (i = 0; i < lw->npoints; i++)
+        {
+            lw->st += lw->t[i];
+            lw->sx += lw->x[i];
+            lw->stt += (double)lw->t[i] * lw->t[i];
+            lw->stx += (double)lw->t[i] * lw->x[i];
+            lw->sxx += (double)lw->x[i] * lw->x[i];
+        }
+    lw->pushes = 0;
+}
+
+/* Slide a new point into a window, keeping the sums up to date */
+static void push_point(leak_window *lw, float t, float x)
+{
+    if (lw->npoints == LEAK_POINTS)
+        {
+            double ot = lw->t[lw->head];
+            double ox = lw->x[lw->head];
+            lw->st -= ot;
+            lw->sx -= ox;
+            lw->stt -= ot * ot;
+            lw->stx -= ot * ox;
+            lw->sxx -= ox * ox;
+        }
+    else
+        lw->npoints++;
+    lw->t[lw->head] = t;
+    lw->x[lw->head] = x;
+    lw->head = (lw->head + 1) % LEAK_POINTS;
+    lw->st += t;
+    lw->sx += x;
+    lw->stt += (double)t * t;
+    lw->stx += (double)t * x;
+    lw->sxx += (double)x * x;
+    if (++lw->pushes >= LEAK_POINTS)
+        rebuild_sums(lw);
+}
+
+/* Least squares slope (pages per second) and R^2 of a window.
+ * Returns 0 if the window can not be judged yet.
+ */
+static int fit_window(leak_window *lw, int secs, double *slope, double *r2)
+{
+    double n = lw->npoints;
+    double vt, vx, cov, oldest;
+
+    if (lw->npoints < LEAK_MIN_POINTS)
+        return 0;
+    oldest = lw->t[(lw->npoints == LEAK_POINTS) ? lw->head : 0];
+    if (lw->bucket_start - oldest < 0.8 * secs)
+        return 0;
+    vt = n * lw->stt - lw->st * lw->st;
+    vx = n * lw->sxx - lw->sx * lw->sx;
+    cov = n * lw->stx - lw->st * lw->sx;
+    if (vt <= 0)
+        return 0;
+    *slope = cov / vt;
+    *r2 = (vx > 0) ? (cov * cov) / (vt * vx) : 0;
+    return 1;
+}
+
+/* A window is leaking when its line climbs at leakrate or faster and
+ * explains at least LEAK_MIN_R2 of the variation.  With LEAK_MIN_POINTS
+ * points that fit puts the slope's t statistic near 10, far beyond
+ * chance, so no separate significance test is made.
+ */
+int leak_update(int slot, unsigned long long now, int rssize)
+{
+    leak_window *lw;
+    double t = (now - leak_base[slot]) / 1000000000.0;
+    double width, slope, r2, rate;
+    long long minrate = (pc != NULL && pc->leakrate > 0) ? pc->leakrate : DEFAULT_LEAK_RATE;
+    int w, change = 0;
+
+    procavs[slot].leak_rate = 0;
+    for (w = 0; w < LEAK_WINDOWS; w++)
+        {
+            lw = &windows[slot * LEAK_WINDOWS + w];
+            width = (double)window_secs[w] / LEAK_POINTS;
+            if (lw->bucket_n > 0 && t - lw->bucket_start >= width)
+                {
+                    push_point(lw, lw->bucket_t / lw->bucket_n, lw->bucket_x / lw->bucket_n);
+                    lw->bucket_n = 0;
+                }
+            if (lw->bucket_n == 0)
+                {
+                    lw->bucket_start = t;
+                    lw->bucket_t = 0;
+                    lw->bucket_x = 0;
+                }
+            lw->bucket_t += t;
+            lw->bucket_x += rssize;
+            lw->bucket_n++;
+
+            if (!fit_window(lw, window_secs[w], &slope, &r2))
+                continue;
+            rate = slope * 3600.0 * getpagesize();
+            if (slope > 0 && r2 >= LEAK_MIN_R2 && rate >= minrate * 1024.0)
+                {
+                    if (rate > procavs[slot].leak_rate)
+                        procavs[slot].leak_rate = (long long)rate;
+                    if (!(procavs[slot].leaking & (1 << w)))
+                        {
+                            procavs[slot].leaking |= (1 << w);
+                            change += LEAK_SCORE;
+                            if (news[slot].windows == 0)
+                                newslots[nnewslots++] = slot;
+                            news[slot].windows |= (1 << w);
+                            news[slot].rate[w] = (long long)rate;
+                            news[slot].r2[w] = r2;
+                        }
+                }
+            else if (slope <= 0 || r2 < LEAK_CLEAR_R2)
+                procavs[slot].leaking &= ~(1 << w);
+        }
+    return change;
+}
+
+/* Growth of a slot's resident set in bytes per second, taken from the
+ * shortest window that can be judged and climbs with a fair fit.  Zero
+ * when no window says the process is growing.
+ */
+double leak_growth(int slot)
+{
+    double slope, r2;
+    int w;
+
+    if (windows == NULL)
+        return 0;
+    for (w = 0; w < LEAK_WINDOWS; w++)
+        {
+            if (!fit_window(&windows[slot * LEAK_WINDOWS + w], window_secs[w], &slope, &r2))
+                continue;
+            if (slope > 0 && r2 >= LEAK_CLEAR_R2)
+                return slope * getpagesize();
+            return 0;
+        }
+    return 0;
+}
+
+void leak_alert(procan_config *pc, long now)
+{
+    char what[ALERT_WHAT];
+    char msg[ALERT_MSG];
+    leak_news *ln;
+    int i, j, slot, w;
+
+    instr_lock(&procchart_mutex, INSTR_PROCCHART_WAIT);
+    for (i = 0, j = 0; i < nnewslots; i++)
+        {
+            slot = newslots[i];
+            ln = &news[slot];
+            if (ln->windows == 0)    /* The slot was set up again since */
+                continue;
+            for (w = 0; !(ln->windows & (1 << w)); w++)
+                ;
+            snprintf(what, ALERT_WHAT, "leak:%s", name_text(procavs[slot].name));
+            snprintf(msg, ALERT_MSG, "%s (%i) looks like it is leaking, its resident set "
+                     "grew %lld KB per hour over the last %s (R^2 %.2f)",
+                     name_text(procavs[slot].name), procavs[slot].lastpid,
+                     ln->rate[w] / 1024, window_names[w], ln->r2[w]);
+            if (backend_queue(pc, ALERT_WARNING, what, (int)(ln->rate[w] / 1024), msg) < 0)
+                {
+                    newslots[j++] = slot;    /* The outbox is full, try next cycle */
+                    continue;
+                }
+            ln->windows = 0;
+        }
+    nnewslots = j;
+    pthread_mutex_unlock(&procchart_mutex);
+}
@@ -0,0 +1,60 @@
+/* ProcAn leak detector
+ * Every tracked process keeps its resident set over three sliding
+ * windows, each downsampled to LEAK_POINTS points.  A least squares
+ * line is kept through each window, a window whose line climbs steadily
+ * and fits well marks the process as leaking.
+ */
+
+#define LEAK_WINDOWS 3                /* 5 minutes, 1 hour and 6 hours */
+#define LEAK_POINTS 30                /* Points kept per window */
+#define LEAK_MIN_POINTS 24            /* Points needed before a window is judged */
+#define LEAK_MIN_R2 0.8               /* Fit a window must reach to be a leak */
+#define LEAK_CLEAR_R2 0.5             /* Fit below which a leak is forgotten */
+#define LEAK_SCORE 5                  /* Score added when a window starts leaking */
+#define DEFAULT_LEAK_RATE 1024        /* KB per hour a leak must grow by at least */
+
+typedef struct
+{
+    int windows;              /* Bit per window that started leaking */
+    long long rate[LEAK_WINDOWS];   /* Bytes per hour and fit it was found with */
+    double r2[LEAK_WINDOWS];
+}leak_news;
+
+typedef struct
+{
+    float t[LEAK_POINTS];     /* Seconds since the slot was set up */
+    float x[LEAK_POINTS];     /* Mean resident pages over the point */
+    int head;
+    int npoints;
+    int pushes;               /* Points added since the sums were last rebuilt */
+    double st, sx, stt, stx, sxx;
+    double bucket_start;      /* Start of the point being accumulated */
+    double bucket_t;
+    double bucket_x;
+    int bucket_n;
+}leak_window;
+
+/* Make room for leak tracking in slots [oldn, n) */
+void leak_reserve(int oldn, int n);
+
+/* Free the leak tracking slab */
+void leak_free(void);
+
+/* Start tracking a slot from scratch, now is the monotonic ns of its first sample */
+void leak_init(int slot, unsigned long long now);
+
+/* Add a resident set sample taken at now to a slot.  Returns the score
+ * to add for windows that just started leaking.
+ */
+int leak_update(int slot, unsigned long long now, int rssize);
+
+/* Name of a leak window, for messages */
+const char* leak_window_name(int w);
+
+/* Resident set growth of a slot in bytes per second, 0 if it is not growing */
+double leak_growth(int slot);
+
+/* Warn of the leaks found since the last call through the backends.
+ * Called from the analyzer with pconfig_mutex held.
+ */
+void leak_alert(procan_config *pc, long now);
@@ -29,75 +29,1236 @@
 #include <string.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <errno.h>
+#include <dirent.h>
+#include <syslog.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/connector.h>
+#include <linux/cn_proc.h>
 #include <pthread.h>
 #include <ctype.h>
 #include "procan.h"
+#include "cgroup.h"
 #include "linux_collector.h"
+#include "instrument.h"
+#include "pidmap.h"
+#include "sampler.h"
+#include "ticker.h"
+#include "names.h"
+#include "fds.h"
+#include "threads.h"
 
-/* The collector thread is responsible
- * for collecting data about running processes
- * and placing them in a structure that 
- * The analyzer thread can read quickly
+#define STALL_MAX 64         /* Pids remembered for stalling the collector */
+#define CMDLINE_CACHE 64     /* Command lines remembered */
+#define CMDLINE_LEN 128      /* Longest command line we keep */
+#define CMDLINE_STUCK_MAX 4  /* Hung readers we give up on before giving up on command lines */
+#define DEFAULT_STALL_TIMEOUT 1000   /* ms a /proc read may take by default */
+#define DIRENT_BUF 32768     /* Bytes getdents64() reads at a time */
+
+/* The collector fills scanbuf without holding procsnap_mutex and only
+ * takes the mutex to merge it into procsnap, so a slow /proc read never
+ * holds up the analyzer.  procsnap holds the newest sample of every pid
+ * read since the analyzer last drained it, snapindex finds them.
  */
-void* collector_thread(void *a)
+static proc_statistics *scanbuf = NULL;
+static int scancap = 0;
+static int snapcap = 0;
+static int gonecap = 0;
+static pidmap snapindex;
+static pid_t *scanpids = NULL;
+static pid_t *duepids = NULL;
+static pid_t *gonepids = NULL;
+static int maxscanpids = 0;
+static int nlisted = 0;      /* Pids list_pids() has put in scanpids */
+static long hertz = 0;
+static cgroup_sample *cgbuf = NULL;
+static proc_memory membuf[MAX_SMAPS_TOP];
+static proc_fds *fdbuf = NULL;
+static int fdbufcap = 0;
+static int fdsnapcap = 0;
+static char *direntbuf = NULL;   /* Reused for every getdents64() */
+static thread_sample *threadbuf = NULL;
+static int threadbufcap = 0;
+static int threadsnapcap = 0;
+
+/* Spawns and exits per parent heard from the proc connector since the
+ * last cycle, churnindex finds a parent's entry.
+ */
+static int cnsock = -1;
+static int cntried = 0;
+static proc_churn *churnbuf = NULL;
+static int nchurnbuf = 0;
+static int churnbufcap = 0;
+static int churnsnapcap = 0;
+static pidmap churnindex;
+
+/* The configuration keys the collector reads.  A SIGHUP frees pc
+ * under pconfig_mutex, so they are copied under it whenever the
+ * generation changes and the collector only ever reads the copy.
+ * All zeros means no configuration, which reads as the defaults.
+ */
+static struct
+{
+  int generation;
+  int interval;
+  int coldinterval;
+  int stalltimeout;
+  int samplebudget;
+  int cgroupstats;
+  int smapstop;
+  int smapsbudget;
+  int iostats;
+  int ctxtstats;
+  int fdevery;
+  int churnevents;
+  char **cgroupscope;
+  int ncgroupscope;
+  char exclusions[20][20];
+  int nclusions;
+  int euids[20];
+  int neuids;
+} cc;
+
+/* Copy the keys the collector reads when the configuration has been
+ * read again.  Once there is a copy, if the analyzer holds
+ * pconfig_mutex we keep it and look again next tick rather than wait.
+ */
+static void collector_config(void)
+{
+  int i;
+
+  if (cc.generation == 0)
+    pthread_mutex_lock(&pconfig_mutex);
+  else if (pthread_mutex_trylock(&pconfig_mutex) != 0)
+    return;
+  if (pc != NULL && pc->generation != cc.generation)
+    {
+      for (i = 0; i < cc.ncgroupscope; i++)
+	free(cc.cgroupscope[i]);
+      free(cc.cgroupscope);
+      cc.cgroupscope = NULL;
+      cc.ncgroupscope = 0;
+      if (pc->ncgroupscope > 0 &&
+	  (cc.cgroupscope = malloc(pc->ncgroupscope * sizeof(char*))) == NULL)
+	{
+	  printf("malloc error, can not allocate memory.\n");
+	  exit(-1);
+	}
+      for (i = 0; i < pc->ncgroupscope; i++)
+	{
+	  if ((cc.cgroupscope[i] = strdup(pc->cgroupscope[i])) == NULL)
+	    {
+	      printf("malloc error, can not allocate memory.\n");
+	      exit(-1);
+	    }
+	}
+      cc.ncgroupscope = pc->ncgroupscope;
+      cc.interval = pc->interval;
+      cc.coldinterval = pc->coldinterval;
+      cc.stalltimeout = pc->stalltimeout;
+      cc.samplebudget = pc->samplebudget;
+      cc.cgroupstats = pc->cgroupstats;
+      cc.smapstop = pc->smapstop;
+      cc.smapsbudget = pc->smapsbudget;
+      cc.iostats = pc->iostats;
+      cc.ctxtstats = pc->ctxtstats;
+      cc.fdevery = pc->fdevery;
+      cc.churnevents = pc->churnevents;
+      memcpy(cc.exclusions, pc->exclusions, sizeof(cc.exclusions));
+      cc.nclusions = pc->nclusions;
+      cc.neuids = (pc->euids != NULL) ? pc->nuids : 0;
+      for (i = 0; i < cc.neuids; i++)
+	cc.euids[i] = pc->euids[i];
+      cc.generation = pc->generation;
+    }
+  pthread_mutex_unlock(&pconfig_mutex);
+}
+
+/* The analyzer drops processes excluded by name or uid, so there is no
+ * point reading their extra files.  Matches should_ignore_proc() and
+ * should_ignore_uid() against the copy of the configuration.
+ */
+static int collector_ignores(const char *cmd, int uid)
+{
+  int i;
+
+  for (i = 0; i < cc.nclusions; i++)
+    {
+      if (strncmp(cc.exclusions[i], cmd, strlen(cc.exclusions[i])) == 0)
+	return 1;
+    }
+  for (i = 0; i < cc.neuids; i++)
+    {
+      if (uid == cc.euids[i])
+	return 1;
+    }
+  return 0;
+}
+
+/* Pids whose /proc entries stalled the collector, they are skipped
+ * until they go away.
+ */
+static pthread_mutex_t stall_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int stalled[STALL_MAX];
+static int stallseen[STALL_MAX];
+static int nstalled = 0;
+
+/* What the collector is reading right now, for the watchdog */
+static volatile int watch_pid = 0;
+static volatile unsigned long long watch_start = 0;
+
+/* Lazily read command lines */
+static pthread_mutex_t cmdline_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cmdline_request = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t cmdline_done = PTHREAD_COND_INITIALIZER;
+static int cmdline_pid = 0;
+static int cmdline_busy = 0;
+static int cmdline_started = 0;
+static int cmdline_reader = 0;      /* Which reader is in service, older ones were abandoned */
+static int cmdline_stuck = 0;       /* Abandoned readers still hung in a read */
+static int cmdline_next = 0;
+static struct
+{
+  int pid;
+  int ok;
+  char text[CMDLINE_LEN];
+} cmdlines[CMDLINE_CACHE];
+
+/* How long a single /proc read may take before we call it a stall */
+static int stall_timeout(void)
+{
+  return (cc.stalltimeout > 0) ? cc.stalltimeout : DEFAULT_STALL_TIMEOUT;
+}
+
+static int is_stalled(int pid)
+{
+  int i;
+  for (i = 0; i < nstalled; i++)
+    {
+      if (stalled[i] == pid)
+	{
+	  stallseen[i] = 1;
+	  return 1;
+	}
+    }
+  return 0;
+}
+
+/* Remember a pid that stalled us and tell syslog about it */
+static void add_stall(int pid, unsigned long long ms)
+{
+  pthread_mutex_lock(&stall_mutex);
+  if (!is_stalled(pid) && nstalled < STALL_MAX)
+    {
+      stalled[nstalled] = pid;
+      stallseen[nstalled] = 1;
+      nstalled++;
+      openlog("procan", LOG_CONS, LOG_DAEMON);
+      syslog(LOG_WARNING, "collector stalled for %llu ms reading /proc/%d, it will be skipped",
+	     ms, pid);
+      closelog();
+    }
+  pthread_mutex_unlock(&stall_mutex);
+}
+
+/* Append a pid to scanpids unless it stalled us, stall_mutex is held */
+static void list_pid(int pid)
+{
+  if (nlisted + 1 >= maxscanpids)
+    {
+      maxscanpids = maxscanpids + MAXPROCAVS;
+      scanpids = realloc(scanpids, maxscanpids * sizeof(pid_t));
+      duepids = realloc(duepids, maxscanpids * sizeof(pid_t));
+      gonepids = realloc(gonepids, maxscanpids * sizeof(pid_t));
+      if (scanpids == NULL || duepids == NULL || gonepids == NULL)
+	{
+	  printf("malloc error, can not allocate memory.\n");
+	  exit(-1);
+	}
+    }
+  if (!is_stalled(pid))
+    scanpids[nlisted++] = (pid_t)pid;
+}
+
+/* Build the list of pids to scan, from /proc or, when monitorcgroups
+ * is set, from the cgroup.procs of those cgroups and the ones below
+ * them, leaving out stalled pids.  Stalled pids that have exited are
+ * forgotten.
+ */
+static int list_pids(void)
+{
+  DIR *procdir;
+  struct dirent *ent;
+  int i, j;
+
+  nlisted = 0;
+  pthread_mutex_lock(&stall_mutex);
+  for (i = 0; i < nstalled; i++)
+    stallseen[i] = 0;
+  if (cc.ncgroupscope > 0)
+    {
+      for (i = 0; i < cc.ncgroupscope; i++)
+	cgroup_procs(cc.cgroupscope[i], list_pid);
+    }
+  else if ((procdir = opendir("/proc")) != NULL)
+    {
+      while ((ent = readdir(procdir)) != NULL)
+	{
+	  if (isdigit(ent->d_name[0]))
+	    list_pid((int)strtol(ent->d_name, (char **)NULL, 10));
+	}
+      closedir(procdir);
+    }
+  for (i = 0, j = 0; i < nstalled; i++)
+    {
+      if (stallseen[i])
+	stalled[j++] = stalled[i];
+    }
+  nstalled = j;
+  pthread_mutex_unlock(&stall_mutex);
+  if (scanpids == NULL)
+    return 0;
+  scanpids[nlisted] = 0;
+  return nlisted;
+}
+
+/* Make sure a snapshot buffer can hold want entries */
+static proc_statistics* grow_snap(proc_statistics *snap, int *cap, int want)
+{
+  int oldcap = *cap;
+  if (want <= oldcap)
+    return snap;
+  while (*cap < want)
+    *cap = *cap + MAXPROCAVS;
+  if ((snap = realloc(snap, *cap * sizeof(proc_statistics))) == NULL)
+    {
+      printf("Can not allocate memory.");
+      exit(-1);
+    }
+  memset(&snap[oldcap], 0, (*cap - oldcap) * sizeof(proc_statistics));
+  return snap;
+}
+
+/* Read the bytes a process has read and written (read_bytes and
+ * write_bytes, what actually went to or came from storage) and the
+ * read and write calls it made.  Only the owner and root may read
+ * /proc/<pid>/io, the figures are -1 for everyone else.
+ */
+static void read_io(int pid, proc_statistics *ps)
+{
+  FILE *iofile;
+  char path[32];
+  char line[64];
+  long long value;
+
+  ps->_iobytes = -1;
+  ps->_iocalls = -1;
+  snprintf(path, 32, "/proc/%d/io", pid);
+  if ((iofile = fopen(path, "r")) == NULL)
+    return;
+  ps->_iobytes = 0;
+  ps->_iocalls = 0;
+  while (fgets(line, 64, iofile) != NULL)
+    {
+      if (sscanf(line, "read_bytes: %lld", &value) == 1 ||
+	  sscanf(line, "write_bytes: %lld", &value) == 1)
+	ps->_iobytes += value;
+      else if (sscanf(line, "syscr: %lld", &value) == 1 ||
+	       sscanf(line, "syscw: %lld", &value) == 1)
+	ps->_iocalls += value;
+    }
+  fclose(iofile);
+}
+
+/* libproc 3.2.8 skips the context switch lines of status, so they are
+ * read here.  The file is in the page cache after readproc() read it.
+ */
+static void read_ctxt(int pid, proc_statistics *ps)
+{
+  FILE *status;
+  char path[32];
+  char line[64];
+  long long value;
+
+  ps->_vcsw = -1;
+  ps->_ivcsw = -1;
+  snprintf(path, 32, "/proc/%d/status", pid);
+  if ((status = fopen(path, "r")) == NULL)
+    return;
+  while (fgets(line, 64, status) != NULL)
+    {
+      if (sscanf(line, "voluntary_ctxt_switches: %lld", &value) == 1)
+	ps->_vcsw = value;
+      else if (sscanf(line, "nonvoluntary_ctxt_switches: %lld", &value) == 1)
+	ps->_ivcsw = value;
+    }
+  fclose(status);
+}
+
+/* Read the given 0 terminated list of pids into scanbuf.
+ * Identity comes from stat and status only, these never wait on the
+ * target's memory map the way cmdline does.  The analyzer works out
+ * CPU use from _cputime and the time each sample was taken.
+ */
+static int read_pids(pid_t *pids, int npids)
 {
   PROCTAB *proct;
   proc_t  *proc_info;
-  int hangup = 0;
-  
-  while (!hangup)
+  int next = 0, nscan = 0;
+  int timeout = stall_timeout();
+  int cgroups = (cc.cgroupstats >= 0);
+  int io = (cc.iostats >= 0);
+  int ctxt = (cc.ctxtstats >= 0);
+  unsigned long long took;
+  struct timeval now;
+
+  if (npids == 0)
+    return 0;
+  if (hertz <= 0 && (hertz = sysconf(_SC_CLK_TCK)) <= 0)
+    hertz = 100;
+  scanbuf = grow_snap(scanbuf, &scancap, npids);
+  gettimeofday(&now, NULL);
+  proct = openproc(PROC_FILLSTAT | PROC_FILLSTATUS | PROC_PID, pids);
+  watch_pid = pids[next];
+  watch_start = instr_now();
+  while(nscan < npids && (proc_info = readproc(proct,NULL)))
+    {
+      took = instr_now() - watch_start;
+      if (took > (unsigned long long)timeout * 1000000ULL)
+	add_stall(proc_info->tid, took / 1000000ULL);
+      while (next < npids && pids[next] != proc_info->tid)
+	next++;
+      next++;
+      watch_pid = (next < npids) ? pids[next] : 0;
+
+      scanbuf[nscan]._pid = proc_info->tid;
+      scanbuf[nscan]._ppid = proc_info->ppid;
+      scanbuf[nscan]._uid = proc_info->ruid;
+      scanbuf[nscan]._name = name_intern(proc_info->cmd);
+      scanbuf[nscan]._rssize = proc_info->rss;
+      scanbuf[nscan]._size = proc_info->vm_size;
+      scanbuf[nscan]._perc = 0;
+      scanbuf[nscan]._cputime = (long)(((proc_info->utime + proc_info->stime) * 1000ULL) / hertz);
+      scanbuf[nscan]._sampletime = instr_now();
+      scanbuf[nscan]._age = 0;
+      scanbuf[nscan]._starttime = proc_info->start_time;   /* Ticks after boot, field 22 of stat */
+      scanbuf[nscan]._majflt = proc_info->maj_flt;
+      scanbuf[nscan]._minflt = proc_info->min_flt;
+      scanbuf[nscan]._threads = proc_info->nlwp;
+      scanbuf[nscan]._read = 0;
+      scanbuf[nscan]._cgroup = cgroups ? cgroup_lookup(proc_info->tid, now.tv_sec) : 0;
+      if (io && !collector_ignores(proc_info->cmd, proc_info->ruid))
+	read_io(proc_info->tid, &scanbuf[nscan]);
+      else
+	scanbuf[nscan]._iobytes = scanbuf[nscan]._iocalls = -1;
+      if (ctxt)
+	read_ctxt(proc_info->tid, &scanbuf[nscan]);
+      else
+	scanbuf[nscan]._vcsw = scanbuf[nscan]._ivcsw = -1;
+      freep(proc_info);
+      nscan++;
+      watch_start = instr_now();
+    }
+  watch_start = 0;
+  closeproc(proct);
+  return nscan;
+}
+
+/* Merge the first nscan entries of scanbuf into procsnap, replacing
+ * any sample of the same pid the analyzer has not picked up yet.
+ */
+static void publish(int nscan)
+{
+  int i, idx;
+
+  instr_lock(&procsnap_mutex, INSTR_PROCSNAP_WAIT);
+  if (procsnap == NULL)
+    snapcap = 0;
+  for (i = 0; i < nscan; i++)
     {
-      pthread_mutex_lock(&procsnap_mutex);
-      proct = openproc(PROC_FILLARG | PROC_FILLSTAT | PROC_FILLSTATUS);//PROC_FILLMEM | PROC_FILLSTATUS | PROC_FILLSTAT | PROC_FILLARG);
-      if (procsnap == NULL)
+      idx = pidmap_get(&snapindex, scanbuf[i]._pid);
+      if (idx < 0 || idx >= numprocsnap || procsnap[idx]._pid != scanbuf[i]._pid)
 	{
-	  procsnap = (proc_statistics *) calloc(MAXPROCAVS, sizeof(proc_statistics));
-	  if (procsnap == NULL)
+	  procsnap = grow_snap(procsnap, &snapcap, numprocsnap + 1);
+	  idx = numprocsnap++;
+	  pidmap_put(&snapindex, scanbuf[i]._pid, idx);
+	}
+      procsnap[idx] = scanbuf[i];
+    }
+  pthread_mutex_unlock(&procsnap_mutex);
+}
+
+/* Hand the pids that left the process table to the analyzer, so their
+ * history can be expired without waiting for it to go stale.
+ */
+static void publish_gone(pid_t *gone, int ngone)
+{
+  int i;
+
+  if (ngone == 0)
+    return;
+  instr_lock(&procsnap_mutex, INSTR_PROCSNAP_WAIT);
+  if (procgone == NULL)
+    gonecap = 0;
+  if (numprocgone + ngone > gonecap)
+    {
+      gonecap = numprocgone + ngone + MAXPROCAVS;
+      if ((procgone = realloc(procgone, gonecap * sizeof(pid_t))) == NULL)
+	{
+	  printf("malloc error, can not allocate memory.\n");
+	  exit(-1);
+	}
+    }
+  for (i = 0; i < ngone; i++)
+    {
+      pidmap_del(&snapindex, gone[i]);
+      procgone[numprocgone++] = gone[i];
+    }
+  pthread_mutex_unlock(&procsnap_mutex);
+  for (i = 0; i < ngone; i++)
+    cgroup_forget(gone[i]);
+}
+
+/* Read every cgroup the processes live in once and hand the samples to
+ * the analyzer, a newer read replaces one it has not picked up yet.
+ */
+static void publish_cgroups(void)
+{
+  int n;
+
+  if (cc.cgroupstats < 0)
+    return;
+  if (cgbuf == NULL && (cgbuf = malloc(CGROUP_MAX * sizeof(cgroup_sample))) == NULL)
+    {
+      printf("malloc error, can not allocate memory.\n");
+      exit(-1);
+    }
+  n = cgroup_sample_all(cgbuf, CGROUP_MAX);
+  instr_lock(&procsnap_mutex, INSTR_PROCSNAP_WAIT);
+  if (cgroupsnap == NULL && (cgroupsnap = malloc(CGROUP_MAX * sizeof(cgroup_sample))) == NULL)
+    {
+      printf("malloc error, can not allocate memory.\n");
+      exit(-1);
+    }
+  memcpy(cgroupsnap, cgbuf, n * sizeof(cgroup_sample));
+  numcgroupsnap = n;
+  pthread_mutex_unlock(&procsnap_mutex);
+}
+
+/* Read Pss, unique (private) memory and Swap of a process from
+ * smaps_rollup.  Walking the memory map takes mmap_sem like cmdline
+ * does, so only the few pids the analyzer asked for are read.
+ */
+static int read_memory(int pid, proc_memory *pm)
+{
+  FILE *smaps;
+  char path[40];
+  char line[120];
+  long value;
+
+  snprintf(path, 40, "/proc/%d/smaps_rollup", pid);
+  if ((smaps = fopen(path, "r")) == NULL)
+    return -1;
+  pm->pid = pid;
+  pm->pss = pm->uss = pm->swap = 0;
+  while (fgets(line, 120, smaps) != NULL)
+    {
+      if (sscanf(line, "Pss: %ld", &value) == 1)
+	pm->pss = value;
+      else if (sscanf(line, "Private_Clean: %ld", &value) == 1 ||
+	       sscanf(line, "Private_Dirty: %ld", &value) == 1)
+	pm->uss += value;
+      else if (sscanf(line, "Swap: %ld", &value) == 1)
+	pm->swap = value;
+    }
+  fclose(smaps);
+  return 0;
+}
+
+/* Once a cycle read smaps_rollup for the processes the analyzer wants,
+ * highest score first, until the smapsbudget for the cycle runs out.
+ */
+static void collect_memory(void)
+{
+  pid_t want[MAX_SMAPS_TOP];
+  int nwant, i, n = 0, skip;
+  unsigned long long start, budget;
+
+  if (cc.smapstop <= 0)
+    return;
+  budget = (unsigned long long)(cc.smapsbudget > 0 ? cc.smapsbudget : DEFAULT_SMAPS_BUDGET) * 1000000ULL;
+  instr_lock(&procchart_mutex, INSTR_PROCCHART_WAIT);
+  nwant = nummemwant;
+  memcpy(want, memwant, nwant * sizeof(pid_t));
+  pthread_mutex_unlock(&procchart_mutex);
+
+  start = instr_now();
+  for (i = 0; i < nwant && instr_now() - start < budget; i++)
+    {
+      pthread_mutex_lock(&stall_mutex);
+      skip = is_stalled(want[i]);
+      pthread_mutex_unlock(&stall_mutex);
+      if (skip)
+	continue;
+      watch_pid = want[i];
+      watch_start = instr_now();
+      if (read_memory(want[i], &membuf[n]) == 0)
+	n++;
+      watch_start = 0;
+    }
+  watch_pid = 0;
+  if (n == 0)
+    return;
+  instr_lock(&procsnap_mutex, INSTR_PROCSNAP_WAIT);
+  memcpy(memsnap, membuf, n * sizeof(proc_memory));
+  nummemsnap = n;
+  pthread_mutex_unlock(&procsnap_mutex);
+}
+
+/* Count the entries of /proc/<pid>/fd with raw getdents64() into a
+ * buffer we keep, so there is no readdir() allocation and no stat of
+ * each descriptor.  Returns -1 if the directory can not be read.
+ */
+static int count_fds(int pid)
+{
+  char path[32];
+  int dir, count = 0;
+  long n, off;
+  unsigned short reclen;
+  char *name;
+
+  snprintf(path, 32, "/proc/%d/fd", pid);
+  if ((dir = open(path, O_RDONLY | O_DIRECTORY)) < 0)
+    return -1;
+  while ((n = syscall(SYS_getdents64, dir, direntbuf, DIRENT_BUF)) > 0)
+    {
+      for (off = 0; off < n; off += reclen)
+	{
+	  /* linux_dirent64: d_ino, d_off, d_reclen, d_type, d_name */
+	  memcpy(&reclen, direntbuf + off + 16, sizeof(reclen));
+	  name = direntbuf + off + 19;
+	  if (name[0] != '.')
+	    count++;
+	}
+    }
+  close(dir);
+  return (n < 0) ? -1 : count;
+}
+
+/* Every fdevery cycles count the descriptors of each listed process, a
+ * slice of the pids on each cycle so the work is spread out, along with
+ * their RLIMIT_NOFILE.
+ */
+static void collect_fds(long cycle, int npids)
+{
+  int every = (cc.fdevery == 0) ? DEFAULT_FD_EVERY : cc.fdevery;
+  int i, n = 0, fds, skip;
+  unsigned long long rl[2];   /* struct rlimit64, soft and hard */
+
+  if (every < 0)
+    return;
+  if (direntbuf == NULL && (direntbuf = malloc(DIRENT_BUF)) == NULL)
+    {
+      printf("malloc error, can not allocate memory.\n");
+      exit(-1);
+    }
+  for (i = 0; i < npids; i++)
+    {
+      if (scanpids[i] % every != cycle % every)
+	continue;
+      pthread_mutex_lock(&stall_mutex);
+      skip = is_stalled(scanpids[i]);
+      pthread_mutex_unlock(&stall_mutex);
+      if (skip)
+	continue;
+      watch_pid = scanpids[i];
+      watch_start = instr_now();
+      fds = count_fds(scanpids[i]);
+      watch_start = 0;
+      if (fds < 0)
+	continue;
+      if (n >= fdbufcap)
+	{
+	  fdbufcap = fdbufcap + MAXPROCAVS;
+	  if ((fdbuf = realloc(fdbuf, fdbufcap * sizeof(proc_fds))) == NULL)
 	    {
-	      printf("Can not allocate memory.");
+	      printf("malloc error, can not allocate memory.\n");
 	      exit(-1);
 	    }
 	}
-      numprocsnap = 0;
-      while((proc_info = readproc(proct,NULL)))
+      fdbuf[n].pid = scanpids[i];
+      fdbuf[n].fds = fds;
+      if (syscall(SYS_prlimit64, scanpids[i], RLIMIT_NOFILE, NULL, rl) == 0 && rl[0] != (unsigned long long)-1)
+	fdbuf[n].limit = (long)rl[0];
+      else
+	fdbuf[n].limit = -1;
+      n++;
+    }
+  watch_pid = 0;
+  if (n == 0)
+    return;
+  instr_lock(&procsnap_mutex, INSTR_PROCSNAP_WAIT);
+  if (fdsnap == NULL)
+    fdsnapcap = 0;
+  if (numfdsnap + n > fdsnapcap)
+    {
+      fdsnapcap = numfdsnap + n + MAXPROCAVS;
+      if ((fdsnap = realloc(fdsnap, fdsnapcap * sizeof(proc_fds))) == NULL)
+	{
+	  printf("malloc error, can not allocate memory.\n");
+	  exit(-1);
+	}
+    }
+  memcpy(&fdsnap[numfdsnap], fdbuf, n * sizeof(proc_fds));
+  numfdsnap += n;
+  pthread_mutex_unlock(&procsnap_mutex);
+}
+
+/* Read the name and processor time of one thread from its stat file */
+static int read_thread(int pid, int tid, thread_sample *ts)
+{
+  char path[48];
+  char buf[512];
+  char *lp, *rp;
+  unsigned long utime, stime;
+  int fd, n;
+
+  snprintf(path, 48, "/proc/%d/task/%d/stat", pid, tid);
+  if ((fd = open(path, O_RDONLY)) < 0)
+    return -1;
+  n = read(fd, buf, sizeof(buf) - 1);
+  close(fd);
+  if (n <= 0)
+    return -1;
+  buf[n] = '\0';
+  /* The name is in parentheses and may hold spaces and parentheses itself */
+  if ((lp = strchr(buf, '(')) == NULL || (rp = strrchr(buf, ')')) == NULL)
+    return -1;
+  if (sscanf(rp + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime) != 2)
+    return -1;
+  n = rp - lp - 1;
+  if (n >= THREAD_NAME)
+    n = THREAD_NAME - 1;
+  memcpy(ts->name, lp + 1, n);
+  ts->name[n] = '\0';
+  ts->pid = pid;
+  ts->tid = tid;
+  ts->cputime = (long)(((utime + stime) * 1000ULL) / hertz);
+  ts->sampletime = instr_now();
+  return 0;
+}
+
+/* Make room for one more thread in threadbuf */
+static void grow_threads(int want)
+{
+  if (want <= threadbufcap)
+    return;
+  threadbufcap = threadbufcap + MAXPROCAVS;
+  if ((threadbuf = realloc(threadbuf, threadbufcap * sizeof(thread_sample))) == NULL)
+    {
+      printf("malloc error, can not allocate memory.\n");
+      exit(-1);
+    }
+}
+
+/* Once a cycle walk /proc/<pid>/task of the busy processes the analyzer
+ * wants followed thread by thread, at most THREAD_MAX threads each.
+ */
+static void collect_threads(void)
+{
+  pid_t want[MAX_THREAD_PROCS];
+  char path[32];
+  char *name;
+  int nwant, i, dir, skip, tid, n = 0, nthreads;
+  long got, off;
+  unsigned short reclen;
+
+  instr_lock(&procchart_mutex, INSTR_PROCCHART_WAIT);
+  nwant = numthreadwant;
+  memcpy(want, threadwant, nwant * sizeof(pid_t));
+  pthread_mutex_unlock(&procchart_mutex);
+  if (nwant == 0)
+    return;
+  if (direntbuf == NULL && (direntbuf = malloc(DIRENT_BUF)) == NULL)
+    {
+      printf("malloc error, can not allocate memory.\n");
+      exit(-1);
+    }
+  if (hertz <= 0 && (hertz = sysconf(_SC_CLK_TCK)) <= 0)
+    hertz = 100;
+
+  for (i = 0; i < nwant; i++)
+    {
+      pthread_mutex_lock(&stall_mutex);
+      skip = is_stalled(want[i]);
+      pthread_mutex_unlock(&stall_mutex);
+      snprintf(path, 32, "/proc/%d/task", want[i]);
+      if (skip || (dir = open(path, O_RDONLY | O_DIRECTORY)) < 0)
+	continue;
+      watch_pid = want[i];
+      watch_start = instr_now();
+      nthreads = 0;
+      while (nthreads < THREAD_MAX && (got = syscall(SYS_getdents64, dir, direntbuf, DIRENT_BUF)) > 0)
 	{
-	  if (procsnap[numprocsnap]._command == NULL)
+	  for (off = 0; off < got && nthreads < THREAD_MAX; off += reclen)
 	    {
-	      if ((procsnap[numprocsnap]._command = (char*)malloc(20*sizeof(char))) == NULL)
+	      memcpy(&reclen, direntbuf + off + 16, sizeof(reclen));
+	      name = direntbuf + off + 19;
+	      if (name[0] == '.' || (tid = atoi(name)) <= 0)
+		continue;
+	      grow_threads(n + 1);
+	      if (read_thread(want[i], tid, &threadbuf[n]) == 0)
 		{
-		  printf("malloc error, can not allocate memory.\n");
-		  exit(-1);
+		  n++;
+		  nthreads++;
 		}
+	    }
+	}
+      watch_start = 0;
+      close(dir);
+    }
+  watch_pid = 0;
+  if (n == 0)
+    return;
+  instr_lock(&procsnap_mutex, INSTR_PROCSNAP_WAIT);
+  if (threadsnap == NULL)
+    threadsnapcap = 0;
+  if (numthreadsnap + n > threadsnapcap)
+    {
+      threadsnapcap = numthreadsnap + n + MAXPROCAVS;
+      if ((threadsnap = realloc(threadsnap, threadsnapcap * sizeof(thread_sample))) == NULL)
+	{
+	  printf("malloc error, can not allocate memory.\n");
+	  exit(-1);
+	}
+    }
+  memcpy(&threadsnap[numthreadsnap], threadbuf, n * sizeof(thread_sample));
+  numthreadsnap += n;
+  pthread_mutex_unlock(&procsnap_mutex);
+}
 
-	      if (procsnap[numprocsnap]._command == NULL)
-		{
-		  printf("Can not allocate memory.");
-		  exit(-1);
-		}
+/* Subscribe to fork, exec and exit events from the proc connector.
+ * Only root (CAP_NET_ADMIN) may listen, returns -1 when we can not.
+ */
+static int connector_open(void)
+{
+  struct sockaddr_nl addr;
+  char buf[NLMSG_SPACE(sizeof(struct cn_msg) + sizeof(enum proc_cn_mcast_op))];
+  struct nlmsghdr *nl = (struct nlmsghdr *)buf;
+  struct cn_msg *cn = (struct cn_msg *)NLMSG_DATA(nl);
+  enum proc_cn_mcast_op op = PROC_CN_MCAST_LISTEN;
+  int sock, rcvbuf = 1048576;
+
+  if ((sock = socket(PF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_CONNECTOR)) < 0)
+    return -1;
+  setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+  memset(&addr, 0, sizeof(addr));
+  addr.nl_family = AF_NETLINK;
+  addr.nl_groups = CN_IDX_PROC;
+  memset(buf, 0, sizeof(buf));
+  nl->nlmsg_len = NLMSG_LENGTH(sizeof(struct cn_msg) + sizeof(op));
+  nl->nlmsg_type = NLMSG_DONE;
+  cn->id.idx = CN_IDX_PROC;
+  cn->id.val = CN_VAL_PROC;
+  cn->len = sizeof(op);
+  memcpy(cn->data, &op, sizeof(op));
+  if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+      send(sock, buf, nl->nlmsg_len, 0) < 0)
+    {
+      close(sock);
+      return -1;
+    }
+  return sock;
+}
+
+/* Add to the spawns and exits of a parent */
+static void count_churn(int pid, int spawns, int exits)
+{
+  int idx = pidmap_get(&churnindex, pid);
+
+  if (idx < 0)
+    {
+      if (nchurnbuf == churnbufcap)
+	{
+	  churnbufcap = churnbufcap + MAXPROCAVS;
+	  if ((churnbuf = realloc(churnbuf, churnbufcap * sizeof(proc_churn))) == NULL)
+	    {
+	      printf("malloc error, can not allocate memory.\n");
+	      exit(-1);
+	    }
+	}
+      idx = nchurnbuf++;
+      churnbuf[idx].pid = pid;
+      churnbuf[idx].spawns = churnbuf[idx].exits = 0;
+      pidmap_put(&churnindex, pid, idx);
+    }
+  churnbuf[idx].spawns += spawns;
+  churnbuf[idx].exits += exits;
+}
+
+/* Read every event queued on the connector.  Thread creation and exit
+ * are left out, only whole processes count.  Events lost to a full
+ * socket buffer still show up in the host's fork count.
+ */
+static void connector_drain(void)
+{
+  long buf[2048];   /* Aligned for the netlink headers */
+  struct nlmsghdr *nl;
+  struct cn_msg *cn;
+  struct proc_event *ev;
+  int n;
+
+  while ((n = recv(cnsock, buf, sizeof(buf), 0)) != 0)
+    {
+      if (n < 0)
+	{
+	  if (errno == ENOBUFS || errno == EINTR)
+	    continue;
+	  break;
+	}
+      for (nl = (struct nlmsghdr *)buf; NLMSG_OK(nl, (unsigned int)n); nl = NLMSG_NEXT(nl, n))
+	{
+	  if (nl->nlmsg_type == NLMSG_ERROR || nl->nlmsg_type == NLMSG_NOOP)
+	    continue;
+	  cn = (struct cn_msg *)NLMSG_DATA(nl);
+	  if (cn->id.idx != CN_IDX_PROC || cn->id.val != CN_VAL_PROC)
+	    continue;
+	  ev = (struct proc_event *)cn->data;
+	  if (ev->what == PROC_EVENT_FORK &&
+	      ev->event_data.fork.child_pid == ev->event_data.fork.child_tgid)
+	    count_churn(ev->event_data.fork.parent_tgid, 1, 0);
+	  else if (ev->what == PROC_EVENT_EXIT &&
+		   ev->event_data.exit.process_pid == ev->event_data.exit.process_tgid &&
+		   ev->event_data.exit.parent_tgid > 0)
+	    count_churn(ev->event_data.exit.parent_tgid, 0, 1);
+	}
+    }
+}
+
+/* Forks since boot, the processes line of /proc/stat */
+static long long read_forks(void)
+{
+  FILE *stat;
+  char line[256];
+  long long forks = -1;
+
+  if ((stat = fopen("/proc/stat", "r")) == NULL)
+    return -1;
+  while (fgets(line, 256, stat) != NULL)
+    {
+      if (sscanf(line, "processes %lld", &forks) == 1)
+	break;
+    }
+  fclose(stat);
+  return forks;
+}
+
+/* Once a cycle hand the spawns heard from the connector and the host's
+ * fork count to the analyzer.
+ */
+static void publish_churn(void)
+{
+  long long forks = read_forks();
+  int i;
+
+  instr_lock(&procsnap_mutex, INSTR_PROCSNAP_WAIT);
+  if (churnsnap == NULL)
+    churnsnapcap = 0;
+  if (numchurnsnap + nchurnbuf > churnsnapcap)
+    {
+      churnsnapcap = numchurnsnap + nchurnbuf + MAXPROCAVS;
+      if ((churnsnap = realloc(churnsnap, churnsnapcap * sizeof(proc_churn))) == NULL)
+	{
+	  printf("malloc error, can not allocate memory.\n");
+	  exit(-1);
+	}
+    }
+  memcpy(&churnsnap[numchurnsnap], churnbuf, nchurnbuf * sizeof(proc_churn));
+  numchurnsnap += nchurnbuf;
+  hostforks = forks;
+  churnevents = (cnsock >= 0);
+  pthread_mutex_unlock(&procsnap_mutex);
+  for (i = 0; i < nchurnbuf; i++)
+    pidmap_del(&churnindex, churnbuf[i].pid);
+  nchurnbuf = 0;
+}
+
+/* Take a full snapshot of the process table and publish it.
+ * Returns the number of processes read.
+ */
+int collector_scan(void)
+{
+  int nscan = read_pids(scanpids, list_pids());
+  publish(nscan);
+  return nscan;
+}
+
+/* One tick of the sampling scheduler.  Once a cycle the pid list is
+ * refreshed, then only the pids that are due on this tick are read.
+ * Returns the number of processes read.
+ */
+int collector_tick(long tick)
+{
+  int npids, ngone, ndue, budget;
+
+  collector_config();
+  if (!cntried)
+    {
+      cntried = 1;
+      if (cc.churnevents >= 0)
+	cnsock = connector_open();
+    }
+  if (cnsock >= 0)
+    connector_drain();
+  if (tick % SAMPLE_TICKS_PER_CYCLE == 0 || scanpids == NULL)
+    {
+      npids = list_pids();   /* May move scanpids and gonepids */
+      ngone = sampler_sync(tick, scanpids, npids, gonepids);
+      publish_gone(gonepids, ngone);
+      publish_cgroups();
+      collect_memory();
+      collect_fds(tick / SAMPLE_TICKS_PER_CYCLE, npids);
+      collect_threads();
+      publish_churn();
+    }
+  if (duepids == NULL)
+    return 0;
+  budget = (int)((cc.samplebudget * sampler_quantum(cc.interval)) / 1000000000ULL);
+  if (budget <= 0 || budget > maxscanpids - 1)
+    budget = maxscanpids - 1;
+  ndue = sampler_due(tick, duepids, budget, cc.coldinterval, cc.interval);
+  ndue = read_pids(duepids, ndue);
+  publish(ndue);
+  return ndue;
+}
+
+/* The watchdog notices a collector that is stuck inside a /proc read
+ * while it is still stuck, so the pid gets reported and skipped even
+ * if the read never returns.
+ */
+static void* watchdog_thread(void *a)
+{
+  int hangup = 0;
+  int reported = 0;
+  unsigned long long start, now;
+
+  while (!hangup)
+    {
+      usleep(100000);
+      start = watch_start;
+      now = instr_now();
+      if (start != 0 && watch_pid != 0 && start < now &&
+	  now - start > (unsigned long long)stall_timeout() * 1000000ULL)
+	{
+	  if (reported != watch_pid)
+	    {
+	      add_stall(watch_pid, (now - start) / 1000000ULL);
+	      reported = watch_pid;
 	    }
-	  procsnap[numprocsnap]._pid = proc_info->tid;
-	  procsnap[numprocsnap]._uid = proc_info->ruid;
-	  strncpy(procsnap[numprocsnap]._command, proc_info->cmd, 20);
-	  procsnap[numprocsnap]._rssize = proc_info->rss;
-	  procsnap[numprocsnap]._size = proc_info->size;
-	  procsnap[numprocsnap]._perc = proc_info->pcpu;
-	  procsnap[numprocsnap]._age = 0;
-	  procsnap[numprocsnap]._read = 0;
-	  freep(proc_info);
-	  numprocsnap++;
-	}
-      closeproc(proct);
-      pthread_mutex_unlock(&procsnap_mutex);
+	}
+      else
+	reported = 0;
+      pthread_mutex_lock(&hangup_mutex);
+      if (m_hangup)
+	hangup = 1;
+      pthread_mutex_unlock(&hangup_mutex);
+    }
+  return NULL;
+}
+
+/* Reads command lines for get_cmdline, one at a time.  If a read hangs
+ * only this thread hangs with it, get_cmdline abandons it and starts
+ * another.  An abandoned reader exits as soon as its read returns.
+ */
+static void* cmdline_thread(void *a)
+{
+  char path[40];
+  char text[CMDLINE_LEN];
+  int me = (int)(long)a;
+  int pid, fd, n, i;
+
+  pthread_mutex_lock(&cmdline_mutex);
+  while (1)
+    {
+      while (cmdline_pid == 0 && me == cmdline_reader)
+	pthread_cond_wait(&cmdline_request, &cmdline_mutex);
+      if (me != cmdline_reader)
+	break;
+      pid = cmdline_pid;
+      cmdline_pid = 0;
+      pthread_mutex_unlock(&cmdline_mutex);
+
+      n = -1;
+      snprintf(path, 40, "/proc/%d/cmdline", pid);
+      if ((fd = open(path, O_RDONLY)) >= 0)
+	{
+	  n = read(fd, text, CMDLINE_LEN - 1);
+	  close(fd);
+	}
+      for (i = 0; i < n - 1; i++)
+	{
+	  if (text[i] == '\0')
+	    text[i] = ' ';
+	}
+
+      pthread_mutex_lock(&cmdline_mutex);
+      if (me != cmdline_reader)
+	break;
+      cmdlines[cmdline_next].pid = pid;
+      cmdlines[cmdline_next].ok = (n > 0);
+      if (n > 0)
+	{
+	  text[n] = '\0';
+	  strncpy(cmdlines[cmdline_next].text, text, CMDLINE_LEN);
+	}
+      cmdline_next = (cmdline_next + 1) % CMDLINE_CACHE;
+      cmdline_busy = 0;
+      pthread_cond_broadcast(&cmdline_done);
+    }
+  cmdline_stuck--;
+  pthread_mutex_unlock(&cmdline_mutex);
+  return NULL;
+}
+
+static int cached_cmdline(int pid, char *buf, int len)
+{
+  int i;
+  for (i = 0; i < CMDLINE_CACHE; i++)
+    {
+      if (cmdlines[i].pid == pid)
+	{
+	  if (!cmdlines[i].ok)
+	    return -1;
+	  strncpy(buf, cmdlines[i].text, len);
+	  buf[len - 1] = '\0';
+	  return 0;
+	}
+    }
+  return -2;
+}
+
+/* Fetch the full command line of a process.  Each pid is read at most
+ * once and we wait no longer than the stall timeout for it.  This can
+ * block that long, so call it without holding any of the global locks.
+ * Returns -1 if the command line is not available.
+ */
+int get_cmdline(int pid, char *buf, int len)
+{
+  pthread_t reader;
+  struct timespec deadline;
+  struct timeval now;
+  int timeout = stall_timeout();
+  int ret;
+
+  pthread_mutex_lock(&stall_mutex);
+  ret = is_stalled(pid);
+  pthread_mutex_unlock(&stall_mutex);
+  if (ret)
+    return -1;
+
+  pthread_mutex_lock(&cmdline_mutex);
+  if ((ret = cached_cmdline(pid, buf, len)) != -2 || cmdline_busy)
+    {
+      pthread_mutex_unlock(&cmdline_mutex);
+      return (ret == 0) ? 0 : -1;
+    }
+  if (!cmdline_started)
+    {
+      if (cmdline_stuck >= CMDLINE_STUCK_MAX ||
+	  pthread_create(&reader, NULL, cmdline_thread, (void*)(long)cmdline_reader) != 0)
+	{
+	  pthread_mutex_unlock(&cmdline_mutex);
+	  return -1;
+	}
+      pthread_detach(reader);
+      cmdline_started = 1;
+    }
+  cmdline_pid = pid;
+  cmdline_busy = 1;
+  pthread_cond_signal(&cmdline_request);
+
+  gettimeofday(&now, NULL);
+  deadline.tv_sec = now.tv_sec + timeout / 1000;
+  deadline.tv_nsec = now.tv_usec * 1000 + (timeout % 1000) * 1000000;
+  if (deadline.tv_nsec >= 1000000000)
+    {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000;
+    }
+  while (cmdline_busy)
+    {
+      if (pthread_cond_timedwait(&cmdline_done, &cmdline_mutex, &deadline) == ETIMEDOUT)
+	break;
+    }
+  if (cmdline_busy)
+    {
+      /* Leave the reader to its hung read, the next request gets a new one */
+      cmdline_reader++;
+      cmdline_stuck++;
+      cmdline_started = 0;
+      cmdline_busy = 0;
+      cmdline_pid = 0;
+      pthread_cond_broadcast(&cmdline_request);
+      pthread_mutex_unlock(&cmdline_mutex);
+      add_stall(pid, timeout);
+      return -1;
+    }
+  ret = cached_cmdline(pid, buf, len);
+  pthread_mutex_unlock(&cmdline_mutex);
+  return (ret == 0) ? 0 : -1;
+}
+
+/* The collector thread is responsible
+ * for collecting data about running processes
+ * and placing them in a structure that 
+ * The analyzer thread can read quickly
+ */
+void* collector_thread(void *a)
+{
+  pthread_t watchdog;
+  ticker cadence;
+  int hangup = 0;
+  int nscanned;
+  long tick = 0;
+  unsigned long long start;
+
+  ticker_init(&cadence, INSTR_COLLECT_INTERVAL);
+  if (pthread_create(&watchdog, NULL, watchdog_thread, NULL) != 0)
+    printf("collector could not start its watchdog.\n");
+  while (!hangup)
+    {
+      start = instr_now();
+      nscanned = collector_tick(tick++);
+      instr_record(INSTR_COLLECT_TIME, instr_now() - start);
+      instr_record(INSTR_COLLECT_PROCS, nscanned);
       pthread_mutex_lock(&hangup_mutex);
       if (m_hangup)
 	hangup = 1;
       pthread_mutex_unlock(&hangup_mutex);
       if (!hangup)
-	sleep(1);
+	ticker_wait(&cadence, sampler_quantum(cc.interval));
     }
+  ticker_free(&cadence);
+  pthread_join(watchdog, NULL);
+  free(scanbuf);
+  free(scanpids);
+  free(duepids);
+  free(gonepids);
+  free(cgbuf);
+  free(fdbuf);
+  free(direntbuf);
+  free(threadbuf);
+  free(churnbuf);
+  pidmap_free(&churnindex);
+  if (cnsock >= 0)
+    close(cnsock);
+  pidmap_free(&snapindex);
   return NULL;
 }
 
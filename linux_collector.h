@@ -6,10 +6,39 @@ extern int m_hangup;
 extern pthread_mutex_t procsnap_mutex;
 extern proc_statistics *procsnap;
 extern int numprocsnap;
+extern pid_t *procgone;
+extern int numprocgone;
+extern cgroup_sample *cgroupsnap;
+extern int numcgroupsnap;
+extern proc_memory memsnap[];
+extern int nummemsnap;
+extern proc_fds *fdsnap;
+extern int numfdsnap;
+extern thread_sample *threadsnap;
+extern int numthreadsnap;
+extern proc_churn *churnsnap;
+extern int numchurnsnap;
+extern long long hostforks;
+extern int churnevents;
 
 extern pthread_mutex_t procchart_mutex;
 extern proc_averages *procavs;
 extern int numprocavs;
+extern pid_t memwant[];
+extern int nummemwant;
+extern pid_t threadwant[];
+extern int numthreadwant;
+
+extern pthread_mutex_t pconfig_mutex;
+extern procan_config *pc;
+
+/* Take a full snapshot of the process table and publish it to procsnap.
+ * procsnap_mutex is only held while the new samples are merged in.
+ */
+int collector_scan(void);
+
+/* Read only the processes the sampling scheduler says are due this tick */
+int collector_tick(long tick);
 
 /* The collector thread is responsible
  * for collecting data about running processes
@@ -0,0 +1,189 @@
+/* Copyright (c) 2008, Matthew W. Jones
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, 
+ *   this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice, 
+ *   this list of conditions and the following disclaimer in the documentation 
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* ProcAn command name table */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "names.h"
+
+static pthread_mutex_t names_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Entry id lives at blocks[id / NAME_BLOCK][id % NAME_BLOCK] */
+static name_entry *blocks[NAME_MAX_BLOCKS];
+static unsigned int nnames = 1;   /* Id 0 is never handed out */
+
+/* Open addressing hash of ids, only touched under names_mutex */
+static unsigned int *index_ids = NULL;
+static unsigned int index_size = 0;
+
+/* Current chunk of the text arena, chunks are chained through their
+ * first bytes so they can be freed.
+ */
+static char *arena = NULL;
+static size_t arena_used = NAME_ARENA;
+
+static unsigned int name_hash(const char *text, int len)
+{
+    unsigned int h = 2166136261U;   /* FNV-1a */
+    int i;
+    for (i = 0; i < len; i++)
+        h = (h ^ (unsigned char)text[i]) * 16777619U;
+    return h;
+}
+
+static void index_insert(unsigned int id)
+{
+    unsigned int i = blocks[id / NAME_BLOCK][id % NAME_BLOCK].hash & (index_size - 1);
+    while (index_ids[i] != 0)
+        i = (i + 1) & (index_size - 1);
+    index_ids[i] = id;
+}
+
+static void index_grow(void)
+{
+    unsigned int id;
+
+    free(index_ids);
+    index_size = (index_size == 0) ? NAME_BLOCK : index_size * 2;
+    if ((index_ids = calloc(index_size, sizeof(unsigned int))) == NULL)
+        {
+            printf("malloc error, can not allocate memory.\n");
+            exit(-1);
+        }
+    for (id = 1; id < nnames; id++)
+        index_insert(id);
+}
+
+static const char* arena_copy(const char *text, int len)
+{
+    char *chunk;
+
+    if (arena_used + len + 1 > NAME_ARENA)
+        {
+            if ((chunk = malloc(NAME_ARENA)) == NULL)
+                {
+                    printf("malloc error, can not allocate memory.\n");
+                    exit(-1);
+                }
+            *(char **)chunk = arena;
+            arena = chunk;
+            arena_used = sizeof(char *);
+        }
+    chunk = arena + arena_used;
+    memcpy(chunk, text, len);
+    chunk[len] = '\0';
+    arena_used += len + 1;
+    return chunk;
+}
+
+unsigned int name_intern(const char *text)
+{
+    name_entry *e;
+    unsigned int h, i, id;
+    int len;
+
+    if (text == NULL)
+        return 0;
+    len = strnlen(text, NAME_LEN);
+    h = name_hash(text, len);
+    pthread_mutex_lock(&names_mutex);
+    if ((nnames + 1) * 2 > index_size)
+        index_grow();
+    for (i = h & (index_size - 1); (id = index_ids[i]) != 0; i = (i + 1) & (index_size - 1))
+        {
+            e = &blocks[id / NAME_BLOCK][id % NAME_BLOCK];
+            if (e->hash == h && strncmp(e->text, text, len) == 0 && e->text[len] == '\0')
+                {
+                    pthread_mutex_unlock(&names_mutex);
+                    return id;
+                }
+        }
+    if (nnames == NAME_BLOCK * NAME_MAX_BLOCKS)
+        {
+            pthread_mutex_unlock(&names_mutex);
+            return 0;
+        }
+    id = nnames;
+    if (blocks[id / NAME_BLOCK] == NULL &&
+        (blocks[id / NAME_BLOCK] = calloc(NAME_BLOCK, sizeof(name_entry))) == NULL)
+        {
+            printf("malloc error, can not allocate memory.\n");
+            exit(-1);
+        }
+    e = &blocks[id / NAME_BLOCK][id % NAME_BLOCK];
+    e->text = arena_copy(text, len);
+    e->hash = h;
+    e->ignoregen = -1;
+    e->ignore = 0;
+    index_ids[i] = id;
+    nnames++;
+    pthread_mutex_unlock(&names_mutex);
+    return id;
+}
+
+name_entry* name_lookup(unsigned int id)
+{
+    if (id == 0 || id >= NAME_BLOCK * NAME_MAX_BLOCKS || blocks[id / NAME_BLOCK] == NULL)
+        return NULL;
+    return &blocks[id / NAME_BLOCK][id % NAME_BLOCK];
+}
+
+const char* name_text(unsigned int id)
+{
+    name_entry *e = name_lookup(id);
+    return (e != NULL && e->text != NULL) ? e->text : "";
+}
+
+int name_count(void)
+{
+    return nnames - 1;
+}
+
+void name_free(void)
+{
+    char *next;
+    int b;
+
+    pthread_mutex_lock(&names_mutex);
+    for (b = 0; b < NAME_MAX_BLOCKS; b++)
+        {
+            free(blocks[b]);
+            blocks[b] = NULL;
+        }
+    while (arena != NULL)
+        {
+            next = *(char **)arena;
+            free(arena);
+            arena = next;
+        }
+    arena_used = NAME_ARENA;
+    free(index_ids);
+    index_ids = NULL;
+    index_size = 0;
+    nnames = 1;
+    pthread_mutex_unlock(&names_mutex);
+}
@@ -0,0 +1,37 @@
+/* ProcAn command name table
+ * Command names are interned once into an arena and referred to by a
+ * 32 bit id everywhere else, so comparing, grouping and excluding
+ * commands are integer operations.  Id 0 means no name.  Ids and the
+ * text behind them never move, so a name can be read without a lock
+ * once its id has been handed over.
+ */
+
+#define NAME_LEN 24                   /* Longest command name kept */
+#define NAME_BLOCK 1024               /* Names per block of the id table */
+#define NAME_MAX_BLOCKS 1024          /* Blocks of names, about a million names */
+#define NAME_ARENA 16384              /* Bytes per chunk of name text */
+
+typedef struct
+{
+    const char *text;
+    unsigned int hash;
+    int ignoregen;            /* Configuration generation ignore was worked out for */
+    int ignore;               /* Matches an excludeprocs entry */
+}name_entry;
+
+/* Fetch the id of a name, adding it if it is new.
+ * Returns 0 for a NULL name or when the table is full.
+ */
+unsigned int name_intern(const char *text);
+
+/* Fetch the text of an id, "" for 0 */
+const char* name_text(unsigned int id);
+
+/* Fetch the entry of an id, NULL for 0 */
+name_entry* name_lookup(unsigned int id);
+
+/* Number of names interned */
+int name_count(void);
+
+/* Free the table, every id is forgotten */
+void name_free(void);
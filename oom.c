@@ -0,0 +1,180 @@
+/* Copyright (c) 2008, Matthew W. Jones
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, 
+ *   this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice, 
+ *   this list of conditions and the following disclaimer in the documentation 
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* ProcAn out of memory forecaster */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include "procan.h"
+#include "backend.h"
+#include "instrument.h"
+#include "cgroup.h"
+#include "leak.h"
+#include "oom.h"
+
+static oom_group groups[OOM_MAX_GROUPS];
+static int ngroups = 0;
+static int hostlevel = 0;
+static long last_forecast = 0;
+
+/* Growing slots copied out from under procchart_mutex */
+static int *growpids = NULL;
+static unsigned int *growcgroups = NULL;
+static double *growrates = NULL;
+static int maxgrowers = 0;
+
+/* Move an alert to the level the forecast calls for, queueing it for
+ * every backend only when it gets worse.  A forecast that
+ * recovers quietly lowers the level so the next decline alerts again.
+ */
+static void escalate(procan_config *pc, int *level, double minutes, char *what, char *msg)
+{
+    int warn = (pc->oomwarn != 0) ? pc->oomwarn : DEFAULT_OOM_WARN;
+    int alarm = (pc->oomalarm != 0) ? pc->oomalarm : DEFAULT_OOM_ALARM;
+    int newlevel = 0;
+
+    if (alarm > 0 && minutes < alarm)
+        newlevel = ALERT_ALARM;
+    else if (warn > 0 && minutes < warn)
+        newlevel = ALERT_WARNING;
+    backend_escalate(pc, level, newlevel, what, (int)minutes, msg);
+}
+
+/* Find the forecast slot of a cgroup, adding it if there is room */
+static oom_group* find_group(const char *dir)
+{
+    int g;
+
+    for (g = 0; g < ngroups; g++)
+        {
+            if (strcmp(groups[g].dir, dir) == 0)
+                return &groups[g];
+        }
+    if (ngroups == OOM_MAX_GROUPS)
+        return NULL;
+    memset(&groups[ngroups], 0, sizeof(oom_group));
+    snprintf(groups[ngroups].dir, CGROUP_PATH_LEN, "%s", dir);
+    return &groups[ngroups++];
+}
+
+void forecast_oom(procan_config *pc, long now)
+{
+    char dir[CGROUP_PATH_LEN];
+    char what[CGROUP_PATH_LEN + 10];
+    char msg[CGROUP_PATH_LEN + 150];
+    long long total, available, limit, usage;
+    double hostgrowth = 0, rate, minutes;
+    oom_group *og;
+    int ngrowers = 0;
+    int j, g;
+
+    if (now - last_forecast < OOM_INTERVAL)
+        return;
+    last_forecast = now;
+    if (pc->oomwarn < 0 && pc->oomalarm < 0)
+        return;
+
+    instr_lock(&procchart_mutex, INSTR_PROCCHART_WAIT);
+    if (numprocavs > maxgrowers)
+        {
+            maxgrowers = numprocavs;
+            growpids = realloc(growpids, maxgrowers * sizeof(int));
+            growcgroups = realloc(growcgroups, maxgrowers * sizeof(unsigned int));
+            growrates = realloc(growrates, maxgrowers * sizeof(double));
+            if (growpids == NULL || growcgroups == NULL || growrates == NULL)
+                {
+                    printf("malloc error, can not allocate memory.\n");
+                    exit(-1);
+                }
+        }
+    for (j = 0; j < numprocavs; j++)
+        {
+            if (procavs[j].name == 0 || now - procavs[j].last_measure_time > OOM_RECENT)
+                continue;
+            if ((rate = leak_growth(j)) <= 0)
+                continue;
+            growpids[ngrowers] = procavs[j].lastpid;
+            growcgroups[ngrowers] = procavs[j].cgroup;
+            growrates[ngrowers++] = rate;
+            hostgrowth += rate;
+        }
+    pthread_mutex_unlock(&procchart_mutex);
+
+    if (read_meminfo(&total, &available) == 0)
+        {
+            if (hostgrowth > 0)
+                {
+                    minutes = available / hostgrowth / 60;
+                    snprintf(msg, CGROUP_PATH_LEN + 150, "the host will run out of memory in about %d "
+                             "minutes (%lld KB available, processes growing %lld KB/hour)",
+                             (int)minutes, available / 1024, (long long)(hostgrowth * 3600 / 1024));
+                    escalate(pc, &hostlevel, minutes, "oom:host", msg);
+                }
+            else
+                hostlevel = 0;
+        }
+
+    for (g = 0; g < ngroups; g++)
+        {
+            groups[g].growth = 0;
+            groups[g].seen = 0;
+        }
+    for (j = 0; j < ngrowers; j++)
+        {
+            /* The collector caches each process's cgroup unless cgroupstats is off */
+            if (growcgroups[j] != 0)
+                snprintf(dir, CGROUP_PATH_LEN, "%s", cgroup_dir(growcgroups[j]));
+            else if (cgroup_of(growpids[j], dir, CGROUP_PATH_LEN) != 0)
+                continue;
+            /* The growth counts against the nearest limit above it */
+            if (cgroup_limited(dir, &limit, &usage) != 0)
+                continue;
+            if ((og = find_group(dir)) == NULL)
+                continue;
+            og->growth += growrates[j];
+            og->seen = 1;
+        }
+    for (g = 0; g < ngroups; )
+        {
+            if (!groups[g].seen)   /* Nothing in it is growing any more */
+                {
+                    groups[g] = groups[--ngroups];
+                    continue;
+                }
+            if (cgroup_memory(groups[g].dir, &limit, &usage) == 0 && limit >= 0)
+                {
+                    minutes = (limit > usage) ? (limit - usage) / groups[g].growth / 60 : 0;
+                    snprintf(what, CGROUP_PATH_LEN + 10, "oom:%s", groups[g].dir);
+                    snprintf(msg, CGROUP_PATH_LEN + 150, "cgroup %s will reach its memory limit in "
+                             "about %d minutes (%lld of %lld KB used, growing %lld KB/hour)",
+                             groups[g].dir, (int)minutes, usage / 1024, limit / 1024,
+                             (long long)(groups[g].growth * 3600 / 1024));
+                    escalate(pc, &groups[g].level, minutes, what, msg);
+                }
+            g++;
+        }
+}
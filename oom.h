@@ -0,0 +1,27 @@
+/* ProcAn out of memory forecaster
+ * Adds up how fast the growing processes are taking resident memory and
+ * estimates when the host, and each memory cgroup with a limit, will run
+ * out.  A process counts against the nearest cgroup above it that has
+ * a limit, which is often a parent slice rather than its own.  Forecasts short enough raise warnings and alarms through the
+ * backends well ahead of the kernel's OOM killer.
+ */
+
+#define OOM_MAX_GROUPS 32             /* Cgroups forecast at once */
+#define OOM_INTERVAL 10               /* Seconds between forecasts */
+#define OOM_RECENT 30                 /* Seconds a slot's growth is trusted after its last sample */
+#define DEFAULT_OOM_WARN 60           /* Minutes left that trigger a warning */
+#define DEFAULT_OOM_ALARM 15          /* Minutes left that trigger an alarm */
+
+typedef struct
+{
+    char dir[CGROUP_PATH_LEN];
+    double growth;            /* Bytes per second the cgroup's members are growing by */
+    int level;                /* ALERT_* level last delivered, 0 if none */
+    int seen;                 /* Had a growing member in this forecast */
+}oom_group;
+
+/* Forecast memory exhaustion for the host and its cgroups and queue
+ * an alert when it comes too close.  Called from the analyzer with
+ * pconfig_mutex held.
+ */
+void forecast_oom(procan_config *pc, long now);
@@ -40,6 +40,9 @@
 
 #include "procan.h"
 #include "openbsd_collector.h"
+#include "instrument.h"
+#include "ticker.h"
+#include "names.h"
 
 /* The collector thread is responsible
  * for collecting data about running processes
@@ -58,14 +61,19 @@ void* collector_thread(void *a)
   int numprocs;
   int i, sstat;
   int hangup = 0;
+  int interval = 0;
+  ticker cadence;
   size_t psize;
+  unsigned long long start;
 
-  pthread_mutex_lock(&procsnap_mutex);
+  ticker_init(&cadence, INSTR_COLLECT_INTERVAL);
+  instr_lock(&procsnap_mutex, INSTR_PROCSNAP_WAIT);
 
   pthread_mutex_unlock(&procsnap_mutex);
   while (!hangup)    /* Thread run loop */
     {
-      pthread_mutex_lock(&procsnap_mutex);
+      instr_lock(&procsnap_mutex, INSTR_PROCSNAP_WAIT);
+      start = instr_now();
       /* We use the sysctl interface to gain access to the processes.
        * I have used code from OpenBSD top here */
       if ((sstat = sysctl(mib, 6, NULL, &psize,NULL,0)) == -1)
@@ -97,26 +105,51 @@ void* collector_thread(void *a)
       for (i = 0; i < numprocs; i++)
           { /* For each running process we do this and drop it into the array. */
               procsnap[i]._pid = kpptr->p_pid;
+              procsnap[i]._ppid = kpptr->p_ppid;
               procsnap[i]._uid = kpptr->p_uid;
-              if (procsnap[i]._command == NULL)
-                  procsnap[i]._command = malloc(KI_MAXCOMLEN + 1 * sizeof(char));
-              strlcpy(procsnap[i]._command, kpptr->p_comm, KI_MAXCOMLEN);
+              procsnap[i]._cgroup = 0;
+              procsnap[i]._name = name_intern(kpptr->p_comm);
               procsnap[i]._rssize = kpptr->p_vm_rssize;
               procsnap[i]._size = kpptr->p_uru_ixrss;
               procsnap[i]._perc = kpptr->p_pctcpu;
               procsnap[i]._age = kpptr->p_ustart_sec;
               procsnap[i]._read = 0;
+              procsnap[i]._cputime = -1;
+              procsnap[i]._sampletime = start;
+              procsnap[i]._starttime = (unsigned long long)kpptr->p_ustart_sec * 1000000ULL
+                  + kpptr->p_ustart_usec;
+              procsnap[i]._iobytes = -1;
+              procsnap[i]._iocalls = kpptr->p_uru_inblock + kpptr->p_uru_oublock;
+              procsnap[i]._majflt = kpptr->p_uru_majflt;
+              procsnap[i]._minflt = kpptr->p_uru_minflt;
+              procsnap[i]._vcsw = kpptr->p_uru_nvcsw;
+              procsnap[i]._ivcsw = kpptr->p_uru_nivcsw;
+              procsnap[i]._threads = 0;
               kpptr++;
           }
       if (kprocaccess != NULL)
           free(kprocaccess);
+      instr_record(INSTR_COLLECT_TIME, instr_now() - start);
+      instr_record(INSTR_COLLECT_PROCS, numprocs);
       pthread_mutex_unlock(&procsnap_mutex);
       pthread_mutex_lock(&hangup_mutex);
       if(m_hangup)
           hangup=1;
       pthread_mutex_unlock(&hangup_mutex);
       if (!hangup)
-          sleep(1);
+          {
+              pthread_mutex_lock(&pconfig_mutex);
+              interval = (pc != NULL) ? pc->interval : 0;
+              pthread_mutex_unlock(&pconfig_mutex);
+              ticker_wait(&cadence, cycle_interval(interval) * 1000000ULL);
+          }
     }
+  ticker_free(&cadence);
   return NULL;
 }
+
+/* Command lines are only gathered by the Linux collector */
+int get_cmdline(int pid, char *buf, int len)
+{
+  return -1;
+}
@@ -9,6 +9,9 @@ extern pthread_mutex_t procchart_mutex;
 extern proc_averages *procavs;
 extern int numprocavs;
 
+extern pthread_mutex_t pconfig_mutex;
+extern procan_config *pc;
+
 /* The collector thread is responsible
  * for collecting data about running processes
  * and placing them in a structure that 
@@ -0,0 +1,138 @@
+/* Copyright (c) 2008, Matthew W. Jones
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, 
+ *   this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice, 
+ *   this list of conditions and the following disclaimer in the documentation 
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Pid map, linear probing with backward shift deletion so there are
+ * no tombstones to clean up.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "pidmap.h"
+
+static unsigned int pidmap_hash(pidmap *m, int key)
+{
+    return ((unsigned int)key * 2654435761U) & (m->size - 1);
+}
+
+void pidmap_init(pidmap *m, int size)
+{
+    m->size = 16;
+    while (m->size < size)
+        m->size = m->size * 2;
+    m->count = 0;
+    m->keys = calloc(m->size, sizeof(int));
+    m->vals = calloc(m->size, sizeof(int));
+    if (m->keys == NULL || m->vals == NULL)
+        {
+            printf("malloc error, can not allocate memory.\n");
+            exit(-1);
+        }
+}
+
+void pidmap_free(pidmap *m)
+{
+    free(m->keys);
+    free(m->vals);
+    m->keys = NULL;
+    m->vals = NULL;
+    m->size = 0;
+    m->count = 0;
+}
+
+int pidmap_get(pidmap *m, int key)
+{
+    unsigned int i;
+    if (m->size == 0)
+        return -1;
+    for (i = pidmap_hash(m, key); m->keys[i] != 0; i = (i + 1) & (m->size - 1))
+        {
+            if (m->keys[i] == key)
+                return m->vals[i];
+        }
+    return -1;
+}
+
+static void pidmap_grow(pidmap *m)
+{
+    pidmap bigger;
+    int i;
+    pidmap_init(&bigger, m->size * 2);
+    for (i = 0; i < m->size; i++)
+        {
+            if (m->keys[i] != 0)
+                pidmap_put(&bigger, m->keys[i], m->vals[i]);
+        }
+    pidmap_free(m);
+    *m = bigger;
+}
+
+void pidmap_put(pidmap *m, int key, int val)
+{
+    unsigned int i;
+    if (m->size == 0)
+        pidmap_init(m, 16);
+    if ((m->count + 1) * 2 > m->size)
+        pidmap_grow(m);
+    for (i = pidmap_hash(m, key); m->keys[i] != 0; i = (i + 1) & (m->size - 1))
+        {
+            if (m->keys[i] == key)
+                {
+                    m->vals[i] = val;
+                    return;
+                }
+        }
+    m->keys[i] = key;
+    m->vals[i] = val;
+    m->count++;
+}
+
+void pidmap_del(pidmap *m, int key)
+{
+    unsigned int i, j, home;
+    if (m->size == 0)
+        return;
+    for (i = pidmap_hash(m, key); m->keys[i] != key; i = (i + 1) & (m->size - 1))
+        {
+            if (m->keys[i] == 0)
+                return;
+        }
+    /* Shift back any entries that probed past the hole */
+    j = i;
+    while (1)
+        {
+            j = (j + 1) & (m->size - 1);
+            if (m->keys[j] == 0)
+                break;
+            home = pidmap_hash(m, m->keys[j]);
+            if ((j > i && (home <= i || home > j)) ||
+                (j < i && (home <= i && home > j)))
+                {
+                    m->keys[i] = m->keys[j];
+                    m->vals[i] = m->vals[j];
+                    i = j;
+                }
+        }
+    m->keys[i] = 0;
+    m->count--;
+}
@@ -0,0 +1,24 @@
+/* A small open addressing hash from pids (or any positive int) to ints */
+
+typedef struct
+{
+  int *keys;
+  int *vals;
+  int size;
+  int count;
+}pidmap;
+
+/* Set up an empty map, size is rounded up to a power of two */
+void pidmap_init(pidmap *m, int size);
+
+/* Release a map's storage */
+void pidmap_free(pidmap *m);
+
+/* Look up a key, returns -1 if it is not present */
+int pidmap_get(pidmap *m, int key);
+
+/* Insert or replace a key */
+void pidmap_put(pidmap *m, int key, int val);
+
+/* Remove a key if it is present */
+void pidmap_del(pidmap *m, int key);
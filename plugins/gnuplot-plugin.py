@@ -78,6 +78,8 @@ class pp_ContinuousPlot:
 	s_line = string.split(line,",")
 	s_line[0] = s_line[0][1:len(s_line[0])]
 	s_line[len(s_line)-1] = s_line[len(s_line)-1][0:len(s_line[len(s_line)-1])-1]
+	if s_line[0] == "stats":
+	    return
 	if not self.history.has_key(time.localtime()[3]):
 	    self.history[time.localtime()[3]] = {}
 	lefthour = int(s_line[5][0:len(s_line[5])-1])
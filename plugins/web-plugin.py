@@ -87,6 +87,8 @@ class pp_WebPlugin:
         s_line = string.split(line,",")
         s_line[0] = s_line[0][1:len(s_line[0])]
         s_line[len(s_line)-1] = s_line[len(s_line)-1][0:len(s_line[len(s_line)-1])-1]
+        if s_line[0] == "stats":
+            return
         if not self.history.has_key(time.localtime()[3]):
             self.history[time.localtime()[3]] = {}
         if self.history[time.localtime()[3]].has_key(s_line[1]):
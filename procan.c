@@ -36,7 +36,9 @@
 #include <string.h>
 #include <sys/types.h>
 #include <sys/param.h>
+#if !defined (linux)
 #include <sys/sysctl.h>
+#endif
 #include <sys/user.h>
 #include <sys/stat.h>
 #include <sys/time.h>
@@ -45,7 +47,13 @@
 
 #include "procan.h"
 #include "backend.h"
+#include "cgroup.h"
 #include "cli.h"
+#include "instrument.h"
+#include "names.h"
+#include "aggregate.h"
+#include "tree.h"
+#include "cgscore.h"
 #if defined (__FreeBSD__)
 #include "freebsd_collector.h"
 #elif defined (__OpenBSD__)
@@ -56,17 +64,42 @@
 #error Could not determine your operating system.  Make sure it is supported.
 #endif
 
+#define STATS_LINE 128        /* Longest line of get_statistics_str */
+#define STATS_LINES 30        /* Five sections of five lines and their headers */
+
 /* Globals with their respective mutexes */
 pthread_mutex_t hangup_mutex;
 int m_hangup = 0;
 
+/* Set by SIGUSR2, the analyzer dumps the instrumentation when it sees it */
+volatile sig_atomic_t m_dumpstats = 0;
+
 pthread_mutex_t procsnap_mutex;
 proc_statistics *procsnap;
 int numprocsnap = 0;
+pid_t *procgone;          /* Pids the collector saw exit, drained with procsnap */
+int numprocgone = 0;
+cgroup_sample *cgroupsnap;  /* Newest read of each cgroup, drained with procsnap */
+int numcgroupsnap = 0;
+proc_memory memsnap[MAX_SMAPS_TOP];   /* smaps_rollup reads, drained with procsnap */
+int nummemsnap = 0;
+proc_fds *fdsnap;           /* Descriptor counts, drained with procsnap */
+int numfdsnap = 0;
+thread_sample *threadsnap;  /* Threads of the processes in threadwant, drained with procsnap */
+int numthreadsnap = 0;
+proc_churn *churnsnap;      /* Spawns and exits per parent, drained with procsnap */
+int numchurnsnap = 0;
+long long hostforks = -1;   /* Forks since boot from /proc/stat, -1 if unknown */
+int churnevents = 0;        /* Spawns come from the proc connector rather than pid deltas */
 
 pthread_mutex_t procchart_mutex;
 proc_averages *procavs;
+history_columns hcols;
 int numprocavs = 0;
+pid_t memwant[MAX_SMAPS_TOP];   /* Pids the analyzer wants smaps_rollup read for */
+int nummemwant = 0;
+pid_t threadwant[MAX_THREAD_PROCS];   /* Pids the analyzer wants the threads of */
+int numthreadwant = 0;
 
 pthread_mutex_t pconfig_mutex;
 procan_config *pc;
@@ -80,9 +113,13 @@ int get_statistics(int *mis, int *uis, int *numints)
 {
   int holder, i, j;
   int numids = 0;
+  struct timeval now;
+
+  gettimeofday(&now, NULL);
   for (i = 0; i < numprocavs; i++)
     {
       mis[i] = i;
+      decay_slot(i, now.tv_sec);
       int found = 0;
       for (j = 0; j < numids; j++)
           {
@@ -104,7 +141,7 @@ int get_statistics(int *mis, int *uis, int *numints)
 
   for (i = 0; i < numids; i++)
       {
-          for (j = 0; j < numids; j++)
+          for (j = 1; j < numids; j++)
               {
                   if (numints[j] > numints[j-1])
                       {
@@ -122,8 +159,8 @@ int get_statistics(int *mis, int *uis, int *numints)
       {
           for (j = 1; j < numprocavs; j++)
               {
-                  if (procavs[mis[j]].intrest_score >
-                      procavs[mis[j-1]].intrest_score)
+                  if (hcols.intrest_score[mis[j]] >
+                      hcols.intrest_score[mis[j-1]])
                       {
                           holder = mis[j];
                           mis[j] = mis[j-1];
@@ -136,27 +173,34 @@ int get_statistics(int *mis, int *uis, int *numints)
 
 /* Fetches a long string with the top 5 processes and why they are the top 5
  * Will also display the top 5 most interesting users.
- * Calling function must free
+ * Takes procchart_mutex itself, calling function must free
  */
 char* get_statistics_str()
 {
+    instr_lock(&procchart_mutex, INSTR_PROCCHART_WAIT);
     int mis[numprocavs];
     int uis[numprocavs];
     int numints[numprocavs];
+    int tops[5];
+    unsigned int cgtops[5];
+    struct timeval now;
     int numids, holder, i, j;
     char *nowstats;
-    char thenstats[50];
+    char thenstats[STATS_LINE];
 
-    if ((nowstats = malloc(sizeof(nowstats) * 300)) == NULL)
+    if ((nowstats = malloc(STATS_LINE * STATS_LINES)) == NULL)
         {
             printf("malloc error, can not allocate memory.\n");
             exit(-1);
         }
+    nowstats[0] = '\0';
     numids = 0;
 
+    gettimeofday(&now, NULL);
     for (i = 0; i < numprocavs; i++)
         {
             mis[i] = i;
+            decay_slot(i, now.tv_sec);
             int found=0;
             for (j = 0; j < numids; j++)
                 {
@@ -211,42 +255,92 @@ char* get_statistics_str()
             if (procavs[mis[i]].num_intrests < 1)
                 continue;
             place++;
-            snprintf(thenstats,50,"%i: %s (%i) because of %s %s %s\n",
+            snprintf(thenstats,STATS_LINE,"%i: %s (%i) because of %s %s %s\n",
                      place,
-                     procavs[mis[i]].command,
+                     name_text(procavs[mis[i]].name),
                      procavs[mis[i]].lastpid,
+                     (procavs[mis[i]].iintrests > procavs[mis[i]].pintrests &&
+                      procavs[mis[i]].iintrests > procavs[mis[i]].mintrests) ? "disk io." :
                      (procavs[mis[i]].pintrests > procavs[mis[i]].mintrests) ? "process load." : "memory usage.",
-                     (procavs[mis[i]].swarned || procavs[mis[i]].dwarned || procavs[mis[i]].mwarned) ? "*WARNED*" : "",
-                     (procavs[mis[i]].salarmed || procavs[mis[i]].dalarmed || procavs[mis[i]].malarmed) ? "*ALARMED*" : "");
-            nowstats = strncat(nowstats, (const char *)thenstats, 50);
+                     (procavs[mis[i]].notified & NOTIFY_WARNED) ? "*WARNED*" : "",
+                     (procavs[mis[i]].notified & NOTIFY_ALARMED) ? "*ALARMED*" : "");
+            nowstats = strcat(nowstats, (const char *)thenstats);
         }
 
-    nowstats = strncat(nowstats, "\nTop 5 users:\n", 14);
+    nowstats = strcat(nowstats, "\nTop 5 users:\n");
     place = 0;
     for (i = numids-1; i >= numids-5; i--)
         {
             if (numints[i] < 1)
                 continue;
             place++;
-            snprintf(thenstats,50,"%i: %i with total interest value of: %i\n",
+            snprintf(thenstats,STATS_LINE,"%i: %i with total interest value of: %i\n",
                      place,
                      uis[i],
                      numints[i]);
-            nowstats = strncat(nowstats, (const char *)thenstats, 50);
+            nowstats = strcat(nowstats, (const char *)thenstats);
+        }
+
+    nowstats = strcat(nowstats, "\nTop 5 commands:\n");
+    numids = agg_top(tops, 5);
+    for (i = 0; i < numids; i++)
+        {
+            command_aggregate *ca = agg_get(tops[i]);
+            if (ca->intrests < 1)
+                break;
+            snprintf(thenstats,STATS_LINE,"%i: %s of %i, %i running, interest %i\n",
+                     i+1,
+                     name_text(ca->name),
+                     ca->uid,
+                     ca->instances,
+                     ca->intrests);
+            nowstats = strcat(nowstats, (const char *)thenstats);
+        }
+
+    nowstats = strcat(nowstats, "\nTop 5 process trees:\n");
+    numids = tree_top(tops, 5);
+    for (i = 0; i < numids; i++)
+        {
+            tree_node *tn = tree_get(tops[i]);
+            snprintf(thenstats,STATS_LINE,"%i: %s (%i), %i processes, rss %lli\n",
+                     i+1,
+                     name_text(procavs[tops[i]].name),
+                     procavs[tops[i]].lastpid,
+                     tn->sub.count,
+                     tn->sub.rssize);
+            nowstats = strcat(nowstats, (const char *)thenstats);
+        }
+
+    numids = cgscore_top(cgtops, 5, now.tv_sec);
+    if (numids > 0)
+        nowstats = strcat(nowstats, "\nTop 5 cgroups:\n");
+    for (i = 0; i < numids; i++)
+        {
+            cgroup_history *ch = cgscore_get(cgtops[i]);
+            const char *dir = cgroup_dir(cgtops[i]);
+            if (strlen(dir) > 24)
+                dir = dir + strlen(dir) - 24;
+            snprintf(thenstats,STATS_LINE,"%i: %s score %i\n",
+                     i+1,
+                     dir,
+                     ch->score);
+            nowstats = strcat(nowstats, (const char *)thenstats);
         }
+    pthread_mutex_unlock(&procchart_mutex);
     return nowstats;
 }
 
 int pipe_mode()
 {
     pthread_t *threads;
-    int i, e;
+    int e;
     scriptoutput = 1;
 
     signal(SIGCHLD, SIG_IGN);
     signal(SIGHUP, handle_sig);
     signal(SIGTERM, handle_sig);
     signal(SIGUSR1, handle_sig);
+    signal(SIGUSR2, handle_sig);
 
     pthread_mutex_init(&procsnap_mutex,NULL);
     pthread_mutex_init(&procchart_mutex,NULL);
@@ -267,11 +361,10 @@ int pipe_mode()
     pthread_mutex_lock(&hangup_mutex);
     while (m_hangup != 1)
         {
+            pthread_mutex_unlock(&hangup_mutex);
             sleep(2);  /* Pipe mode output is handled in the analyzer thread */
+            pthread_mutex_lock(&hangup_mutex);
         }
-
-    pthread_mutex_lock(&hangup_mutex);
-    m_hangup=1;
     pthread_mutex_unlock(&hangup_mutex);
 
     pthread_join(threads[0],NULL);
@@ -281,87 +374,64 @@ int pipe_mode()
     pthread_mutex_destroy(&procchart_mutex);
     pthread_mutex_destroy(&pconfig_mutex);
     free(threads);
-#if defined (linux)
-    for (i = 0; i < numprocsnap; i++)
-        {
-            if (procsnap[i]._command != NULL)
-                free(procsnap[i]._command);
-        }
-#endif
     free(procsnap);
-    for (i = 0; i < numprocavs; i++)
-        {
-            if (procavs[i].command != NULL)
-                free(procavs[i].command);
-        }
-    free(procavs);
+    free(procgone);
+    free(cgroupsnap);
+    free_history();
+    name_free();
+    cgroup_free();
 
     return 0;
 }
 
-/*
-  Housekeeping is performed on all processes that are active.
-  This includes resetting the hourly_intrests flag and warn and alarm flags
- */
-void perform_housekeeping(long current)
-{
-    int i;
-    pthread_mutex_lock(&procchart_mutex);
-    for (i = 0; i < numprocavs; i++)
-        {
-            if (procavs[i].last_interest_time > 0 &&
-                (current - procavs[i].last_interest_time) > 3600)
-                {
-                    if (procavs[i].intrest_score > 0)
-                        procavs[i].intrest_score = procavs[i].intrest_score / 2;
-                    if (procavs[i].num_intrests > 0)
-                        procavs[i].num_intrests = procavs[i].num_intrests / 2;
-                    procavs[i].num_intrests = 0;
-                    procavs[i].interest_threshold = DEFAULT_INTEREST_THRESHOLD;
-                    procavs[i].mintrests = 0;
-                    procavs[i].pintrests = 0;
-                    procavs[i].mwarned = 0;
-                    procavs[i].malarmed = 0;
-                    procavs[i].swarned = 0;
-                    procavs[i].salarmed = 0;
-                    procavs[i].dwarned = 0;
-                    procavs[i].dalarmed = 0;
-                    procavs[i].last_interest_time = current;
-                }
-        }
-    pthread_mutex_unlock(&procchart_mutex);
-}
-
 /* Reset statistics and collections */
 void reset_statistics()
 {
     int i;
-    pthread_mutex_lock(&procchart_mutex);
+    instr_lock(&procchart_mutex, INSTR_PROCCHART_WAIT);
     for (i = 0; i < numprocavs; i++)
         {
-            procavs[i].mwarned = 0;
-            procavs[i].malarmed = 0;
-            procavs[i].swarned = 0;
-            procavs[i].salarmed = 0;
-            procavs[i].dwarned = 0;
-            procavs[i].dalarmed = 0;
-            procavs[i].intrest_score = 0;
+            procavs[i].notified = 0;
+            hcols.intrest_score[i] = 0;
             procavs[i].num_intrests = 0;
+            procavs[i].decayed_score = 0;
+            procavs[i].decayed_intrests = 0;
             procavs[i].mintrests = 0;
             procavs[i].pintrests = 0;
+            procavs[i].iintrests = 0;
+            procavs[i].decayed_io = 0;
+            procavs[i].io_level = 0;
+            agg_update(i);
+            tree_update(i);
         }
+    cgscore_free();
     pthread_mutex_unlock(&procchart_mutex);
 }
 
-int should_ignore_proc(char *name)
+/* Exclusions match the start of a command name, the verdict is kept
+ * with the name until the configuration is read again.
+ */
+int should_ignore_proc(unsigned int name)
 {
+    name_entry *e = name_lookup(name);
     int i;
-    for (i = 0; i < pc->nclusions; i++)
+
+    if (e == NULL)
+        return 0;
+    if (e->ignoregen != pc->generation)
         {
-            if (strncmp(pc->exclusions[i], name, strlen(pc->exclusions[i])) == 0)
-                return 1;
+            e->ignore = 0;
+            for (i = 0; i < pc->nclusions; i++)
+                {
+                    if (strncmp(pc->exclusions[i], e->text, strlen(pc->exclusions[i])) == 0)
+                        {
+                            e->ignore = 1;
+                            break;
+                        }
+                }
+            e->ignoregen = pc->generation;
         }
-    return 0;
+    return e->ignore;
 }
 
 int should_ignore_uid(int uid)
@@ -395,11 +465,12 @@ int daemon_mode()
     umask(027);
     chdir("/");
 
-    /* The 3 signals we watch for, and ignore the return value of children */
+    /* The 4 signals we watch for, and ignore the return value of children */
     signal(SIGCHLD, SIG_IGN);
     signal(SIGHUP, handle_sig);
     signal(SIGTERM, handle_sig);
     signal(SIGUSR1, handle_sig);
+    signal(SIGUSR2, handle_sig);
 
     pthread_mutex_init(&procsnap_mutex,NULL);
     pthread_mutex_init(&procchart_mutex,NULL);
@@ -424,6 +495,7 @@ int daemon_mode()
             sleep(2);
             pthread_mutex_lock(&hangup_mutex);
         }
+    pthread_mutex_unlock(&hangup_mutex);
 
     pthread_join(threads[0],NULL);
     pthread_join(threads[1],NULL);
@@ -433,12 +505,11 @@ int daemon_mode()
     pthread_mutex_destroy(&pconfig_mutex);
     free(threads);
     free(procsnap);
-    for (i = 0; i < numprocavs; i++)
-        {
-            if (procavs[i].command != NULL)
-                free(procavs[i].command);
-        }
-    free(procavs);
+    free(procgone);
+    free(cgroupsnap);
+    free_history();
+    name_free();
+    cgroup_free();
     return 0;
 }
 
@@ -455,6 +526,7 @@ void usage()
     printf("  script: Run a script or scripts based on given conditions\n");
     printf("  syslog: Log to syslog periodically\n\n");
     printf("Interactive Mode Commands:\n");
+    printf("  s: Show or hide the instrumentation panel\n");
     printf("  q: Quit\n\n");
     printf("Author: Matthew W. Jones <mat@matburt.net>\n");
     printf("http://matburt.net/projects/procan\n");
@@ -479,9 +551,13 @@ void handle_sig(int sig)
         case SIGUSR1:
             reset_statistics();
             break;
+        case SIGUSR2:
+            m_dumpstats = 1;
+            break;
         }
 }
 
+#ifndef PROCAN_BENCH
 int main(int argc, char *argv[])
 {
     int i,j;
@@ -560,3 +636,4 @@ int main(int argc, char *argv[])
 
     exit(0);
 }
+#endif
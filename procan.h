@@ -10,6 +10,13 @@
 #define MAXPROCAVS 500                /* Maximum unique procs to analyze */
 #define DEFAULT_INTEREST_THRESHOLD 5  /* Default Threshold for Interesting procs */
 #define ADAPTIVE_THRESHOLD 5          /* Adaptation threshold for interesting procs */
+#define DEFAULT_HALF_LIFE 60          /* Minutes for scores and interests to decay by half */
+#define MAX_CGROUP_SCOPE 8            /* Cgroups monitorcgroups can list */
+#define MAX_SMAPS_TOP 64              /* Most processes smapstop can ask for */
+#define DEFAULT_SMAPS_BUDGET 20       /* ms a cycle may spend reading smaps_rollup */
+#define MAX_THREAD_PROCS 16           /* Processes whose threads are followed at once */
+#define MAX_THREAD_NAMES 8            /* Commands threadprocs can list */
+#define THREAD_NAME 16                /* Longest thread name, as the kernel keeps it */
 
 #define INTERACTIVE_MODE 0            /* Interactive Mode Flag */
 #define BACKGROUND_MODE 1             /* Daemon/Server Mode Flag */
@@ -23,6 +30,12 @@
 #define BACKEND_WARNING 1            /* Backend Recieved a Temporary Warning */
 #define BACKEND_NORMAL 2
 
+#define ALERT_WARNING 1               /* Alert delivered as a warning */
+#define ALERT_ALARM 2                 /* Alert delivered as an alarm */
+
+#define SCORER_ADAPTIVE 0             /* Fixed increments with an adaptive threshold */
+#define SCORER_EWMA 1                 /* z-scores against running means and variances */
+
 /* The following struct is populated by the collector
    it is supposed to be a lightweight container for 
    a snapshot of a process
@@ -30,49 +43,164 @@
 typedef struct 
 {
   int _pid;        /* Proc's pid */
+  int _ppid;       /* Parent's pid, 0 if it has none */
   int _uid;
-  char *_command;  /* Command string */
+  unsigned int _cgroup; /* Cgroup id, see cgroup.h, 0 if unknown */
+  unsigned int _name; /* Command name id, see names.h */
   int _rssize;     /* The Resident Set Size */
   int _size;       /* Virtual Size */
   int _perc;       /* % Processor load */
   int _age;        /* How long it has been running */
   int _read;       /* Mutex flag to prevent duplication */
+  long _cputime;   /* ms of CPU used so far, -1 if the collector filled _perc */
+  unsigned long long _sampletime; /* Monotonic ns when the sample was read */
+  unsigned long long _starttime;  /* When the process started (collector's units), 0 if unknown */
+  long long _iobytes;  /* Bytes read and written so far, -1 if unknown */
+  long long _iocalls;  /* Read and write calls (block operations on the BSDs) so far, -1 if unknown */
+  long long _majflt;   /* Major and minor page faults so far, -1 if unknown */
+  long long _minflt;
+  long long _vcsw;     /* Voluntary and involuntary context switches so far, -1 if unknown */
+  long long _ivcsw;
+  int _threads;        /* Threads in the process, 0 if unknown */
 }proc_statistics;
 
+/* Proportional, unique and swapped memory of a process in KB, read
+ * from smaps_rollup for the few processes the analyzer asks about.
+ */
+typedef struct
+{
+  int pid;
+  long pss;
+  long uss;        /* Private_Clean + Private_Dirty */
+  long swap;
+}proc_memory;
+
+/* Open descriptors of a process, counted on a slower tier than the
+ * rest of its sample.
+ */
+typedef struct
+{
+  int pid;
+  int fds;
+  long limit;      /* Soft RLIMIT_NOFILE, -1 if unknown */
+}proc_fds;
+
+/* Processes a parent spawned and reaped, from the proc connector */
+typedef struct
+{
+  int pid;
+  int spawns;
+  int exits;
+}proc_churn;
+
+/* One thread of a process whose threads are followed */
+typedef struct
+{
+  int pid;
+  int tid;
+  char name[THREAD_NAME];
+  long cputime;    /* ms of processor used so far */
+  unsigned long long sampletime;
+}thread_sample;
+
+/* Bits in proc_averages.notified, one per backend and level */
+#define NOTIFY_DWARNED 0x01           /* Warned through syslog */
+#define NOTIFY_DALARMED 0x02          /* Alarmed through syslog */
+#define NOTIFY_MWARNED 0x04           /* Warned through mail */
+#define NOTIFY_MALARMED 0x08          /* Alarmed through mail */
+#define NOTIFY_SWARNED 0x10           /* Warned through the warn script */
+#define NOTIFY_SALARMED 0x20          /* Alarmed through the alarm script */
+#define NOTIFY_WARNED (NOTIFY_DWARNED | NOTIFY_MWARNED | NOTIFY_SWARNED)
+#define NOTIFY_ALARMED (NOTIFY_DALARMED | NOTIFY_MALARMED | NOTIFY_SALARMED)
+
 /* The following struct is used to keep history data
-   about individual types of processes
+   about individual types of processes.  The fields the
+   scoring pass works on every tick live in history_columns.
 */
 typedef struct
 {
-  char *command;
+  unsigned int name;                  /* Command name id, 0 while the slot was never used */
   int uid;
   int lastpid;
+  unsigned long long starttime;       /* _starttime of lastpid, tells a reused pid apart */
   long last_measure_time;
-  long last_interest_time;
+  long last_decay_time;               /* When the decayed figures were last brought up to date */
   int num_seen;
   int last_seen;
-  int mov_percent;
-  int last_percent;
-  int avg_size_gain;
-  int last_size;
-  int avg_rssize_gain;
-  int last_rssize;
   int times_measured;
-  int intrest_score;
-  int ticks_interesting;
-  int ticks_since_interesting;
   int num_intrests;
   int mintrests;
   int pintrests;
-  int interest_threshold;
-  int dwarned;
-  int dalarmed;
-  int mwarned;
-  int malarmed;
-  int swarned;
-  int salarmed;
+  int iintrests;
+  int notified;
+  long last_cputime;
+  unsigned long long last_sample_time;
+  unsigned long long last_interval;   /* Actual ns between the last two samples */
+  int leaking;                        /* Bit per leak window that is leaking */
+  long long leak_rate;                /* Projected bytes per hour of the worst leak, 0 if none */
+  float decayed_score;                /* intrest_score before rounding */
+  float decayed_intrests;             /* num_intrests before rounding */
+  long gone_time;                     /* When the process was seen to exit, 0 while it runs */
+  int next_free;                      /* Next slot on the free list once expired */
+  int due;                            /* In the list of slots the backends check, see due_slots() */
+  unsigned int cgroup;                /* Cgroup id of lastpid, 0 if unknown */
+  long pss;                           /* Last smaps_rollup figures in KB, -1 before the first */
+  long uss;
+  long swap;
+  long long last_iobytes;             /* _iobytes and _iocalls of the last sample */
+  long long last_iocalls;
+  int io_rate;                        /* KB a second read and written between the last two samples */
+  int io_calls;                       /* Read and write calls a second */
+  int io_busy;                        /* Busy samples in a row */
+  int io_change;                      /* io score from the sample being scored */
+  float decayed_io;                   /* io interests, decaying like decayed_intrests */
+  int io_level;                       /* ALERT_* level of the last io alert, 0 if none */
+  int io_watched;                     /* In io.c's list of slots with io interest */
+  int agg;                            /* Command aggregate the slot adds to, 0 if none */
+  int share_percent;                  /* What the slot last added to its aggregate */
+  int share_size;
+  int share_rssize;
+  int share_score;
+  int share_intrests;
 }proc_averages;
 
+/* Hot history data, kept a column per field so the scoring pass
+   streams through flat arrays.  Slot i of every column belongs
+   to procavs[i].
+*/
+typedef struct
+{
+  int *last_percent;
+  int *last_size;
+  int *last_rssize;
+  int *mov_percent;
+  int *avg_size_gain;
+  int *avg_rssize_gain;
+  int *intrest_score;
+  int *interest_threshold;
+  int *ticks_interesting;
+  int *ticks_since_interesting;
+  /* Inputs and results of one scoring pass */
+  int *fresh;         /* 1 if the slot has a new sample to score */
+  int *new_percent;
+  int *new_size;
+  int *new_rssize;
+  int *prev_score;    /* Score before the pass */
+  int *proc_change;   /* Score change from processor load */
+  int *mem_change;    /* Score change from the virtual size */
+  int *rss_change;    /* Score change from the resident set */
+  int *above;         /* 1 if the slot ended the pass above its threshold */
+  /* Running statistics for the ewma scorer */
+  float *cpu_mean;
+  float *cpu_var;
+  float *size_mean;
+  float *size_var;
+  float *rss_mean;
+  float *rss_var;
+  int *ewma_seen;     /* Samples folded into the statistics */
+  int *deviating;     /* Samples in a row that were out of line */
+}history_columns;
+
 /* Procan Configuration structure */
 typedef struct
 {
@@ -81,6 +209,9 @@ typedef struct
   int nuids;
   char exclusions[20][20];
   int nclusions;
+  char **cgroupscope;                 /* Cgroups to watch instead of the whole process table */
+  int ncgroupscope;
+  int generation;                     /* Bumped every time the configuration is read */
   char *adminemail;
   int warnlevel;
   int alarmlevel;
@@ -89,6 +220,42 @@ typedef struct
   char *warnscript;
   char *alarmscript;
   char *mtapath;
+  int stalltimeout;
+  int samplebudget;
+  int coldinterval;
+  int interval;
+  int scorer;
+  int zscore;
+  int leakrate;
+  int oomwarn;
+  int oomalarm;
+  int rollupseconds;
+  int rollupminutes;
+  int rolluphours;
+  int halflife;
+  int cgroupstats;
+  int psiweight;
+  int psiwarn;
+  int psialarm;
+  int smapstop;
+  int smapsbudget;
+  int iostats;
+  int iobusy;
+  int iowarnlevel;
+  int ioalarmlevel;
+  int ctxtstats;
+  int faultbusy;
+  int ctxswbusy;
+  int fdevery;
+  int fdwarn;
+  int fdalarm;
+  char threadprocs[MAX_THREAD_NAMES][20];  /* Commands whose threads are followed */
+  int nthreadprocs;
+  int threadcpu;
+  int churnevents;
+  int churnwarn;
+  int churnalarm;
+  int churnhost;
 }procan_config;
 
 typedef struct
@@ -105,6 +272,11 @@ typedef struct
  */
 void* analyzer_thread(void *a);
 
+/* Run a single analysis pass over the samples in the snapshot and
+ * drain it, the caller must hold procsnap_mutex.
+ */
+void analyze_snapshot(analyzer_times *an_time);
+
 /* Will gather and return ProcAn's configuration */
 procan_config* get_config(void);
 
@@ -117,24 +289,59 @@ int get_statistics(int *mis, int *uis, int *numints);
 /* Will fetch a character array of statistics */
 char* get_statistics_str(void);
 
-/* Modify a single proc_averages instance interest value */
-void modify_interest(proc_averages *pav, char *type, int change);
+/* Report a change in a slot's interest score, score is the value after it */
+void notify_interest(int slot, char *type, int change, int score);
 
 /* Initialize a proc averages slot */
-void initialize_slot(proc_averages *pav, proc_statistics *pc, long curtime);
+void initialize_slot(int slot, proc_statistics *pc, long curtime);
 
-/* Perform hourly housekeeping */
-void perform_housekeeping(long current);
+/* Make room for n slots in procavs and the history columns */
+void reserve_history(int n);
+
+/* Free procavs and the history columns */
+void free_history(void);
+
+/* Score every slot flagged fresh in the history columns against its
+ * new sample, the caller must hold procchart_mutex.
+ */
+void score_history(int n);
+
+/* Find the procavs slot holding history for a snapshot entry,
+ * returns -1 if there is none and -2 if the entry should be skipped.
+ * The caller must hold procchart_mutex.
+ */
+int locate_history(int snapoffset);
+
+/* Decay a slot's score and interests up to now, the caller must hold
+ * procchart_mutex.  Called whenever a slot is scored or read.
+ */
+void decay_slot(int slot, long now);
+
+/* Fill indcs with the slots whose interests may be past warnlevel or
+ * alarmlevel, decayed up to now, and return how many.  Slots join the
+ * list when their interests pass the lower level and leave it once they
+ * have decayed back with no warning or alarm standing.  The caller must
+ * hold procchart_mutex.
+ */
+int due_slots(int *indcs, long now);
+
+/* Fraction of a score left after dt seconds of decay */
+float decay_factor(long dt);
 
 /* Reset all proc averages */
 void reset_statistics(void);
 
 /* Used to determine if a process is in our ignore list */
-int should_ignore_proc(char *name);
+int should_ignore_proc(unsigned int name);
 
 /* Used to determine if a uid is in our ignore list */
 int should_ignore_uid(int uid);
 
+/* Fetch the full command line of a process into buf,
+ * returns -1 if it is not available (or would take too long to read).
+ */
+int get_cmdline(int pid, char *buf, int len);
+
 /* Signal Handler */
 void handle_sig(int sig);
 #endif
@@ -0,0 +1,194 @@
+/* Copyright (c) 2008, Matthew W. Jones
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, 
+ *   this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice, 
+ *   this list of conditions and the following disclaimer in the documentation 
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* ProcAn pressure stall information */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include "procan.h"
+#include "backend.h"
+#include "instrument.h"
+#include "cgroup.h"
+#include "cgscore.h"
+#include "psi.h"
+
+extern procan_config *pc;
+
+static const char *psi_files[PRESSURE_KINDS] = {"/proc/pressure/cpu", "/proc/pressure/memory",
+                                                "/proc/pressure/io"};
+static psi_state host = {{-1, -1, -1}, {-1, -1, -1}};
+static int triggerfds[PSI_MAX_TRIGGERS];
+static int ntriggers = 0;
+
+/* ALERT_* levels last delivered for memory and io, host first then by cgroup id */
+static int hostlevel[2];
+static int cglevel[CGROUP_MAX + 1][2];
+
+/* Cgroup pressures copied out from under procchart_mutex */
+static unsigned int stallids[CGROUP_MAX];
+static float stalls[CGROUP_MAX][2];
+
+int psi_update(void)
+{
+    int k, found = 0;
+
+    for (k = 0; k < PRESSURE_KINDS; k++)
+        {
+            if (read_pressure(psi_files[k], &host.some[k], &host.full[k]) == 0)
+                found = 1;
+        }
+    return found ? 0 : -1;
+}
+
+psi_state* psi_host(void)
+{
+    return &host;
+}
+
+static int psi_warn(procan_config *pc)
+{
+    return (pc->psiwarn != 0) ? pc->psiwarn : DEFAULT_PSI_WARN;
+}
+
+int psi_triggers(procan_config *pc, int *fds, int max)
+{
+#if defined (linux)
+    char trigger[40];
+    int kinds[2] = {PRESSURE_MEMORY, PRESSURE_IO};
+    int k, fd, len;
+
+    if (psi_warn(pc) < 0)
+        return 0;
+    len = snprintf(trigger, 40, "some %d %d", psi_warn(pc) * (PSI_WINDOW / 100), PSI_WINDOW);
+    for (k = 0; k < 2 && ntriggers < PSI_MAX_TRIGGERS && ntriggers < max; k++)
+        {
+            if ((fd = open(psi_files[kinds[k]], O_RDWR | O_NONBLOCK)) < 0)
+                continue;
+            if (write(fd, trigger, len + 1) < 0)
+                {
+                    close(fd);
+                    continue;
+                }
+            triggerfds[ntriggers] = fd;
+            fds[ntriggers++] = fd;
+        }
+#endif
+    return ntriggers;
+}
+
+float psi_boost(unsigned int cgroup, int cpu, int mem)
+{
+    int weight = (pc == NULL || pc->psiweight == 0) ? DEFAULT_PSI_WEIGHT : pc->psiweight;
+    cgroup_history *ch = cgscore_get(cgroup);
+    float *stall = (ch != NULL && ch->last.pressure[PRESSURE_CPU] >= 0) ? ch->last.pressure : host.some;
+    float extra = 0;
+
+    if (weight < 0)
+        return 0;
+    if (cpu > 0 && stall[PRESSURE_CPU] > 0)
+        extra += cpu * stall[PRESSURE_CPU] / weight;
+    if (mem > 0 && stall[PRESSURE_MEMORY] > 0)
+        extra += mem * stall[PRESSURE_MEMORY] / weight;
+    return extra;
+}
+
+/* Move an alert to the level a stall calls for, delivering it only
+ * when it gets worse, like the OOM forecasts.
+ */
+static void escalate(procan_config *pc, int *level, float stall, char *what, char *msg)
+{
+    int alarm = (pc->psialarm != 0) ? pc->psialarm : DEFAULT_PSI_ALARM;
+    int warn = psi_warn(pc);
+    int newlevel = 0;
+
+    if (alarm > 0 && stall >= alarm)
+        newlevel = ALERT_ALARM;
+    else if (warn > 0 && stall >= warn)
+        newlevel = ALERT_WARNING;
+    backend_escalate(pc, level, newlevel, what, (int)stall, msg);
+}
+
+void psi_alert(procan_config *pc, long now)
+{
+    const char *names[2] = {"memory", "io"};
+    int kinds[2] = {PRESSURE_MEMORY, PRESSURE_IO};
+    char what[CGROUP_PATH_LEN + 20];
+    char msg[CGROUP_PATH_LEN + 100];
+    cgroup_history *ch;
+    unsigned int id;
+    int n = 0, k, c;
+
+    if (psi_warn(pc) < 0 && pc->psialarm < 0)
+        return;
+    for (k = 0; k < 2; k++)
+        {
+            if (host.some[kinds[k]] < 0)
+                continue;
+            snprintf(what, CGROUP_PATH_LEN + 20, "psi:%s", names[k]);
+            snprintf(msg, CGROUP_PATH_LEN + 100, "tasks stalled on %s %.1f%% of the last 10 seconds",
+                     names[k], host.some[kinds[k]]);
+            escalate(pc, &hostlevel[k], host.some[kinds[k]], what, msg);
+        }
+
+    instr_lock(&procchart_mutex, INSTR_PROCCHART_WAIT);
+    for (id = 1; id <= CGROUP_MAX; id++)
+        {
+            if ((ch = cgscore_get(id)) == NULL || now - ch->last_seen > CGSCORE_IDLE)
+                {
+                    cglevel[id][0] = cglevel[id][1] = 0;
+                    continue;
+                }
+            stallids[n] = id;
+            stalls[n][0] = ch->last.pressure[PRESSURE_MEMORY];
+            stalls[n++][1] = ch->last.pressure[PRESSURE_IO];
+        }
+    pthread_mutex_unlock(&procchart_mutex);
+
+    for (c = 0; c < n; c++)
+        {
+            for (k = 0; k < 2; k++)
+                {
+                    if (stalls[c][k] < 0)
+                        continue;
+                    snprintf(what, CGROUP_PATH_LEN + 20, "psi:%s:%s", names[k], cgroup_dir(stallids[c]));
+                    snprintf(msg, CGROUP_PATH_LEN + 100, "tasks in cgroup %s stalled on %s %.1f%% "
+                             "of the last 10 seconds", cgroup_dir(stallids[c]), names[k], stalls[c][k]);
+                    escalate(pc, &cglevel[stallids[c]][k], stalls[c][k], what, msg);
+                }
+        }
+}
+
+void psi_free(void)
+{
+    int i;
+
+    for (i = 0; i < ntriggers; i++)
+        close(triggerfds[i]);
+    ntriggers = 0;
+}
@@ -0,0 +1,48 @@
+/* ProcAn pressure stall information
+ * Reads how long tasks stalled on processor, memory and io from
+ * /proc/pressure once a cycle.  Score increases are weighted by the
+ * pressure of the process's cgroup (or the host), so growth on a box
+ * that is thrashing counts for more than on an idle one, and stalls
+ * over psiwarn and psialarm percent are alerted on before single
+ * processes get that far.  Kernel triggers on the memory and io files
+ * wake the analyzer as soon as a stall starts.  (Linux 4.20 and later,
+ * the other platforms get stubs that report nothing.)
+ */
+
+#define PSI_WINDOW 2000000            /* us the kernel triggers measure stalls over, unprivileged triggers need whole 2s */
+#define DEFAULT_PSI_WEIGHT 20         /* Percent stalled that doubles a score increase */
+#define DEFAULT_PSI_WARN 10           /* Percent of memory or io stall that raises a warning */
+#define DEFAULT_PSI_ALARM 25          /* Percent that raises an alarm */
+#define PSI_MAX_TRIGGERS 2
+
+typedef struct
+{
+    float some[PRESSURE_KINDS];       /* avg10 of the "some" lines, -1 if unknown */
+    float full[PRESSURE_KINDS];       /* avg10 of the "full" lines, -1 if unknown */
+}psi_state;
+
+/* Read the host's pressure files, returns -1 if there are none */
+int psi_update(void);
+
+/* Fetch the host pressure from the last psi_update() */
+psi_state* psi_host(void);
+
+/* Arm kernel triggers on the memory and io pressure files at psiwarn
+ * percent and put their descriptors in fds.  Returns how many were
+ * armed, 0 where the kernel or our privileges do not allow it.
+ */
+int psi_triggers(procan_config *pc, int *fds, int max);
+
+/* Extra score for a slot whose processor score rose by cpu and memory
+ * scores by mem, from the pressure of its cgroup or the host.  Called
+ * with procchart_mutex held.
+ */
+float psi_boost(unsigned int cgroup, int cpu, int mem);
+
+/* Raise warnings and alarms for memory and io stalls of the host and
+ * the cgroups.  Called from the analyzer with pconfig_mutex held.
+ */
+void psi_alert(procan_config *pc, long now);
+
+/* Close the triggers */
+void psi_free(void);
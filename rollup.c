@@ -0,0 +1,169 @@
+/* Copyright (c) 2008, Matthew W. Jones
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, 
+ *   this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice, 
+ *   this list of conditions and the following disclaimer in the documentation 
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* ProcAn rollups */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include "procan.h"
+#include "rollup.h"
+
+extern procan_config *pc;
+
+static const int level_secs[ROLLUP_LEVELS] = {1, 60, 3600};
+
+/* Each slot takes stride bytes of the slab: its ROLLUP_LEVELS rings
+ * followed by the points of each ring in turn.
+ */
+static char *slab = NULL;
+static size_t stride = 0;
+static int capacity[ROLLUP_LEVELS];
+static int offset[ROLLUP_LEVELS];
+
+static int rollup_points(int wanted, int fallback)
+{
+    if (wanted <= 0)
+        return fallback;
+    return (wanted > MAX_ROLLUP_POINTS) ? MAX_ROLLUP_POINTS : wanted;
+}
+
+static rollup_ring* ring_of(int slot, int level)
+{
+    return (rollup_ring *)(slab + slot * stride) + level;
+}
+
+static rollup_point* points_of(int slot, int level)
+{
+    return (rollup_point *)(slab + slot * stride + ROLLUP_LEVELS * sizeof(rollup_ring)) + offset[level];
+}
+
+void rollup_reserve(int oldn, int n)
+{
+    int i, total = 0;
+
+    if (stride == 0)
+        {
+            capacity[0] = rollup_points(pc ? pc->rollupseconds : 0, DEFAULT_ROLLUP_SECONDS);
+            capacity[1] = rollup_points(pc ? pc->rollupminutes : 0, DEFAULT_ROLLUP_MINUTES);
+            capacity[2] = rollup_points(pc ? pc->rolluphours : 0, DEFAULT_ROLLUP_HOURS);
+            for (i = 0; i < ROLLUP_LEVELS; i++)
+                {
+                    offset[i] = total;
+                    total += capacity[i];
+                }
+            stride = ROLLUP_LEVELS * sizeof(rollup_ring) + total * sizeof(rollup_point);
+        }
+    if ((slab = realloc(slab, n * stride)) == NULL)
+        {
+            printf("malloc error, can not allocate memory.\n");
+            exit(-1);
+        }
+    for (i = oldn; i < n; i++)
+        rollup_init(i);
+}
+
+void rollup_free(void)
+{
+    free(slab);
+    slab = NULL;
+    stride = 0;
+}
+
+void rollup_init(int slot)
+{
+    memset(ring_of(slot, 0), 0, ROLLUP_LEVELS * sizeof(rollup_ring));
+}
+
+/* Fold point p into a slot's ring at level.  When p belongs to a later
+ * period than the point being filled, that point is closed into the
+ * ring and handed on to the next resolution first.
+ */
+static void fold(int slot, int level, const rollup_point *p)
+{
+    rollup_ring *r = ring_of(slot, level);
+    rollup_point *acc = &r->acc;
+    long start = p->start - p->start % level_secs[level];
+    int m, n;
+
+    if (acc->n > 0 && acc->start != start)
+        {
+            points_of(slot, level)[r->head] = *acc;
+            r->head = (r->head + 1) % capacity[level];
+            if (r->npoints < capacity[level])
+                r->npoints++;
+            if (level + 1 < ROLLUP_LEVELS)
+                fold(slot, level + 1, acc);
+            acc->n = 0;
+        }
+    if (acc->n == 0)
+        {
+            *acc = *p;
+            acc->start = start;
+            return;
+        }
+    n = acc->n + p->n;
+    for (m = 0; m < ROLLUP_METRICS; m++)
+        {
+            if (p->min[m] < acc->min[m])
+                acc->min[m] = p->min[m];
+            if (p->max[m] > acc->max[m])
+                acc->max[m] = p->max[m];
+            acc->mean[m] = (acc->mean[m] * acc->n + p->mean[m] * p->n) / n;
+        }
+    acc->n = n;
+}
+
+void rollup_update(int slot, long now, int percent, int size, int rssize)
+{
+    rollup_point p;
+
+    p.start = now;
+    p.n = 1;
+    p.min[ROLLUP_CPU] = p.max[ROLLUP_CPU] = percent;
+    p.min[ROLLUP_SIZE] = p.max[ROLLUP_SIZE] = size;
+    p.min[ROLLUP_RSS] = p.max[ROLLUP_RSS] = rssize;
+    p.mean[ROLLUP_CPU] = percent;
+    p.mean[ROLLUP_SIZE] = size;
+    p.mean[ROLLUP_RSS] = rssize;
+    fold(slot, 0, &p);
+}
+
+int rollup_recent(int slot, int level, rollup_point *out, int max)
+{
+    rollup_ring *r;
+    rollup_point *points;
+    int i, n;
+
+    if (slab == NULL)
+        return 0;
+    r = ring_of(slot, level);
+    points = points_of(slot, level);
+    n = (r->npoints < max) ? r->npoints : max;
+    for (i = 0; i < n; i++)
+        out[i] = points[(r->head - n + i + capacity[level]) % capacity[level]];
+    return n;
+}
@@ -0,0 +1,52 @@
+/* ProcAn rollups
+ * Every tracked process keeps rings of its processor load, size and
+ * resident set at three resolutions: seconds, minutes and hours.  A
+ * point that closes at one resolution is folded into the next, so the
+ * coarser rings are built incrementally as time rolls over.  The rings
+ * for every slot live in one slab sized when history is reserved.
+ */
+
+#define ROLLUP_LEVELS 3               /* Seconds, minutes and hours */
+#define ROLLUP_METRICS 3              /* Processor load, size and resident set */
+#define ROLLUP_CPU 0
+#define ROLLUP_SIZE 1
+#define ROLLUP_RSS 2
+#define DEFAULT_ROLLUP_SECONDS 120    /* Points kept per resolution */
+#define DEFAULT_ROLLUP_MINUTES 120
+#define DEFAULT_ROLLUP_HOURS 48
+#define MAX_ROLLUP_POINTS 10000
+
+typedef struct
+{
+    long start;                       /* Wall clock second the point begins at */
+    int n;                            /* Samples folded into the point */
+    int min[ROLLUP_METRICS];
+    int max[ROLLUP_METRICS];
+    float mean[ROLLUP_METRICS];
+}rollup_point;
+
+typedef struct
+{
+    int head;                 /* Next point to overwrite */
+    int npoints;
+    rollup_point acc;         /* Point still being filled, acc.n is 0 if none */
+}rollup_ring;
+
+/* Make room for rollups in slots [oldn, n), the number of points kept
+ * at each resolution is fixed by the first call after rollup_free().
+ */
+void rollup_reserve(int oldn, int n);
+
+/* Free the rollup slab */
+void rollup_free(void);
+
+/* Empty a slot's rings */
+void rollup_init(int slot);
+
+/* Fold a sample taken at now (wall clock seconds) into a slot */
+void rollup_update(int slot, long now, int percent, int size, int rssize);
+
+/* Copy up to max of a slot's most recent closed points at a resolution
+ * into out, oldest first.  Returns the number copied.
+ */
+int rollup_recent(int slot, int level, rollup_point *out, int max);
@@ -0,0 +1,234 @@
+/* Copyright (c) 2008, Matthew W. Jones
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, 
+ *   this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice, 
+ *   this list of conditions and the following disclaimer in the documentation 
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Adaptive sampling scheduler */
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include "procan.h"
+#include "pidmap.h"
+#include "sampler.h"
+#include "ticker.h"
+
+typedef struct
+{
+  int pid;
+  int tier;
+  int rounds;     /* Trips around the wheel left before it is due */
+  int slot;
+  int next;
+  int prev;
+  int seen;       /* Last sync that found this pid */
+}sample_entry;
+
+static pthread_mutex_t sampler_mutex = PTHREAD_MUTEX_INITIALIZER;
+static sample_entry *entries = NULL;
+static int nentries = 0;
+static int maxentries = 0;
+static int freelist = -1;
+static int wheel[SAMPLE_WHEEL];
+static int wheel_ready = 0;
+static long curtick = 0;
+static int syncgen = 0;
+static pidmap pids_index;
+
+static int tier_ticks(int tier, int coldinterval, int interval)
+{
+    int cold;
+    switch (tier)
+        {
+        case TIER_HOT:
+            return 1;
+        case TIER_COLD:
+            cold = (coldinterval > 0) ? coldinterval : DEFAULT_COLD_INTERVAL;
+            if (cold > MAX_COLD_INTERVAL)
+                cold = MAX_COLD_INTERVAL;
+            cold = (cold * 1000 * SAMPLE_TICKS_PER_CYCLE) / cycle_interval(interval);
+            return (cold > SAMPLE_TICKS_PER_CYCLE) ? cold : SAMPLE_TICKS_PER_CYCLE;
+        default:
+            return SAMPLE_TICKS_PER_CYCLE;
+        }
+}
+
+static void unlink_entry(int e)
+{
+    if (entries[e].prev >= 0)
+        entries[entries[e].prev].next = entries[e].next;
+    else
+        wheel[entries[e].slot] = entries[e].next;
+    if (entries[e].next >= 0)
+        entries[entries[e].next].prev = entries[e].prev;
+}
+
+/* Put an entry on the wheel so it fires delay ticks from now */
+static void schedule(int e, int delay)
+{
+    long due = curtick + delay;
+    entries[e].slot = due % SAMPLE_WHEEL;
+    entries[e].rounds = (delay - 1) / SAMPLE_WHEEL;
+    if (delay <= 0)
+        entries[e].rounds = 0;
+    entries[e].prev = -1;
+    entries[e].next = wheel[entries[e].slot];
+    if (entries[e].next >= 0)
+        entries[entries[e].next].prev = e;
+    wheel[entries[e].slot] = e;
+}
+
+static int new_entry(int pid)
+{
+    int e;
+    if (freelist >= 0)
+        {
+            e = freelist;
+            freelist = entries[e].next;
+        }
+    else
+        {
+            if (nentries == maxentries)
+                {
+                    maxentries = maxentries + MAXPROCAVS;
+                    if ((entries = realloc(entries, maxentries * sizeof(sample_entry))) == NULL)
+                        {
+                            printf("malloc error, can not allocate memory.\n");
+                            exit(-1);
+                        }
+                }
+            e = nentries++;
+        }
+    entries[e].pid = pid;
+    entries[e].tier = TIER_WARM;
+    pidmap_put(&pids_index, pid, e);
+    return e;
+}
+
+static void drop_entry(int e)
+{
+    unlink_entry(e);
+    pidmap_del(&pids_index, entries[e].pid);
+    entries[e].pid = 0;
+    entries[e].next = freelist;
+    freelist = e;
+}
+
+int sampler_sync(long tick, pid_t *pids, int npids, pid_t *gone)
+{
+    int i, e, ngone = 0;
+
+    pthread_mutex_lock(&sampler_mutex);
+    if (!wheel_ready)
+        {
+            for (i = 0; i < SAMPLE_WHEEL; i++)
+                wheel[i] = -1;
+            pidmap_init(&pids_index, MAXPROCAVS);
+            wheel_ready = 1;
+        }
+    curtick = tick;
+    syncgen++;
+    for (i = 0; i < npids; i++)
+        {
+            if ((e = pidmap_get(&pids_index, pids[i])) < 0)
+                {
+                    /* Spread new pids over the next cycle to keep the ticks even */
+                    e = new_entry(pids[i]);
+                    schedule(e, i % SAMPLE_TICKS_PER_CYCLE);
+                }
+            entries[e].seen = syncgen;
+        }
+    for (e = 0; e < nentries; e++)
+        {
+            if (entries[e].pid != 0 && entries[e].seen != syncgen)
+                {
+                    if (gone != NULL)
+                        gone[ngone] = entries[e].pid;
+                    ngone++;
+                    drop_entry(e);
+                }
+        }
+    pthread_mutex_unlock(&sampler_mutex);
+    return ngone;
+}
+
+int sampler_due(long tick, pid_t *due, int max, int coldinterval, int interval)
+{
+    int e, next, n = 0;
+
+    pthread_mutex_lock(&sampler_mutex);
+    if (!wheel_ready)
+        {
+            pthread_mutex_unlock(&sampler_mutex);
+            due[0] = 0;
+            return 0;
+        }
+    curtick = tick;
+    for (e = wheel[tick % SAMPLE_WHEEL]; e >= 0; e = next)
+        {
+            next = entries[e].next;
+            if (entries[e].rounds > 0)
+                {
+                    entries[e].rounds--;
+                    continue;
+                }
+            unlink_entry(e);
+            if (n < max)
+                {
+                    due[n++] = entries[e].pid;
+                    schedule(e, tier_ticks(entries[e].tier, coldinterval, interval));
+                }
+            else
+                schedule(e, 1);
+        }
+    due[n] = 0;
+    pthread_mutex_unlock(&sampler_mutex);
+    return n;
+}
+
+void sampler_set_tier(int pid, int tier)
+{
+    int e;
+
+    pthread_mutex_lock(&sampler_mutex);
+    if (wheel_ready && (e = pidmap_get(&pids_index, pid)) >= 0)
+        {
+            if (tier < entries[e].tier)
+                {
+                    unlink_entry(e);
+                    schedule(e, 1);
+                }
+            entries[e].tier = tier;
+        }
+    pthread_mutex_unlock(&sampler_mutex);
+}
+
+unsigned long long sampler_quantum(int interval)
+{
+    return (cycle_interval(interval) * 1000000ULL) / SAMPLE_TICKS_PER_CYCLE;
+}
+
+int sampler_count(void)
+{
+    return pids_index.count;
+}
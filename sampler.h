@@ -0,0 +1,39 @@
+/* ProcAn adaptive sampling scheduler
+ * Processes are kept in hot, warm and cold tiers and sampled from a
+ * timer wheel, hot processes every tick, warm ones every cycle and
+ * cold ones every coldinterval seconds.
+ */
+
+#define SAMPLE_TICKS_PER_CYCLE 4      /* Collector ticks in one analysis cycle */
+#define SAMPLE_WHEEL 64               /* Slots in the timer wheel */
+#define DEFAULT_COLD_INTERVAL 10      /* Seconds between samples of cold processes */
+#define MAX_COLD_INTERVAL 20          /* History slots expire after 30s unseen */
+
+#define SAMPLE_HOT_MOVEMENT 3         /* Score movement per pass that makes a process hot */
+#define SAMPLE_COLD_RSS 2560          /* Resident pages below which an idle process is cold */
+
+#define TIER_HOT 0
+#define TIER_WARM 1
+#define TIER_COLD 2
+
+/* Bring the scheduler in line with the pids currently in the process
+ * table.  New pids are due right away, pids that are gone are dropped
+ * and written to gone (if it is not NULL).  Returns the number gone.
+ */
+int sampler_sync(long tick, pid_t *pids, int npids, pid_t *gone);
+
+/* Fetch up to max pids that are due on this tick into due,
+ * the list is 0 terminated.  Pids over the budget wait for the next tick.
+ * coldinterval and interval are the values of those config keys, 0 for
+ * the defaults, read by the caller from its copy of the configuration.
+ */
+int sampler_due(long tick, pid_t *due, int max, int coldinterval, int interval);
+
+/* Move a pid to another tier, promotions take effect on the next tick */
+void sampler_set_tier(int pid, int tier);
+
+/* Length of one collector tick in ns for the interval config key */
+unsigned long long sampler_quantum(int interval);
+
+/* Number of pids the scheduler knows about */
+int sampler_count(void);
@@ -0,0 +1,202 @@
+/* Copyright (c) 2008, Matthew W. Jones
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, 
+ *   this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice, 
+ *   this list of conditions and the following disclaimer in the documentation 
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* ProcAn thread monitor */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include "procan.h"
+#include "names.h"
+#include "threads.h"
+
+extern procan_config *pc;
+
+/* One table per process followed, found by a walk of MAX_THREAD_PROCS */
+static thread_table *tables = NULL;
+
+int threads_wanted(unsigned int name)
+{
+    const char *text = name_text(name);
+    int i;
+
+    for (i = 0; i < pc->nthreadprocs; i++)
+        {
+            if (strncmp(pc->threadprocs[i], text, strlen(pc->threadprocs[i])) == 0)
+                return 1;
+        }
+    return 0;
+}
+
+thread_table* threads_get(int slot)
+{
+    int i;
+
+    for (i = 0; tables != NULL && i < MAX_THREAD_PROCS; i++)
+        {
+            if (tables[i].slot == slot)
+                return &tables[i];
+        }
+    return NULL;
+}
+
+thread_table* threads_at(int i)
+{
+    if (tables == NULL || tables[i].slot < 0)
+        return NULL;
+    return &tables[i];
+}
+
+/* Find a slot's table or hand it a free or idle one */
+static thread_table* claim(int slot, int pid, long now)
+{
+    thread_table *tt = threads_get(slot);
+    int i;
+
+    if (tt != NULL && tt->pid == pid)
+        return tt;
+    if (tt == NULL)
+        {
+            if (tables == NULL)
+                {
+                    if ((tables = malloc(MAX_THREAD_PROCS * sizeof(thread_table))) == NULL)
+                        {
+                            printf("malloc error, can not allocate memory.\n");
+                            exit(-1);
+                        }
+                    for (i = 0; i < MAX_THREAD_PROCS; i++)
+                        tables[i].slot = -1;
+                }
+            for (i = 0; i < MAX_THREAD_PROCS && tt == NULL; i++)
+                {
+                    if (tables[i].slot < 0 || now - tables[i].updated > THREAD_IDLE)
+                        tt = &tables[i];
+                }
+            if (tt == NULL)
+                return NULL;
+        }
+    tt->slot = slot;
+    tt->pid = pid;
+    tt->nthreads = 0;
+    tt->nhot = 0;
+    return tt;
+}
+
+/* Find a thread in a table, the task directory lists threads in the same
+ * order every time so the guess is usually right.
+ */
+static int find_thread(thread_table *tt, int tid, int guess)
+{
+    int i;
+
+    if (guess < tt->nthreads && tt->threads[guess].tid == tid)
+        return guess;
+    for (i = 0; i < tt->nthreads; i++)
+        {
+            if (tt->threads[i].tid == tid)
+                return i;
+        }
+    return -1;
+}
+
+/* Keep the THREAD_HOT busiest threads, hottest first */
+static void rank(thread_table *tt)
+{
+    int i, k;
+
+    tt->nhot = 0;
+    for (i = 0; i < tt->nthreads; i++)
+        {
+            if (tt->threads[i].percent <= 0)
+                continue;
+            if (tt->nhot == THREAD_HOT &&
+                tt->threads[i].percent <= tt->threads[tt->hot[THREAD_HOT - 1]].percent)
+                continue;
+            if (tt->nhot < THREAD_HOT)
+                tt->nhot++;
+            for (k = tt->nhot - 1; k > 0 && tt->threads[i].percent > tt->threads[tt->hot[k - 1]].percent; k--)
+                tt->hot[k] = tt->hot[k - 1];
+            tt->hot[k] = i;
+        }
+}
+
+void threads_update(int slot, thread_sample *ts, int n, long now)
+{
+    thread_table *tt = claim(slot, ts[0].pid, now);
+    thread_usage *tu;
+    unsigned long long dt;
+    int i, t, j;
+
+    if (tt == NULL)
+        return;
+    for (t = 0; t < tt->nthreads; t++)
+        tt->threads[t].seen = 0;
+    for (i = 0; i < n; i++)
+        {
+            if ((t = find_thread(tt, ts[i].tid, i)) < 0)
+                {
+                    if (tt->nthreads == THREAD_MAX)
+                        continue;
+                    t = tt->nthreads++;
+                    tu = &tt->threads[t];
+                    tu->tid = ts[i].tid;
+                    tu->percent = 0;
+                }
+            else
+                {
+                    tu = &tt->threads[t];
+                    dt = ts[i].sampletime - tu->sampletime;
+                    tu->percent = (dt > 0 && ts[i].cputime >= tu->cputime)
+                        ? (int)((ts[i].cputime - tu->cputime) * 100000000LL / dt) : 0;
+                }
+            memcpy(tu->name, ts[i].name, THREAD_NAME);
+            tu->cputime = ts[i].cputime;
+            tu->sampletime = ts[i].sampletime;
+            tu->seen = 1;
+        }
+    for (t = 0, j = 0; t < tt->nthreads; t++)   /* Threads that ended */
+        {
+            if (tt->threads[t].seen)
+                tt->threads[j++] = tt->threads[t];
+        }
+    tt->nthreads = j;
+    tt->updated = now;
+    rank(tt);
+}
+
+void threads_forget(int slot)
+{
+    thread_table *tt = threads_get(slot);
+
+    if (tt != NULL)
+        tt->slot = -1;
+}
+
+void threads_free(void)
+{
+    free(tables);
+    tables = NULL;
+}
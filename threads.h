@@ -0,0 +1,54 @@
+/* ProcAn thread monitor
+ * For commands listed in threadprocs the collector also walks
+ * /proc/<pid>/task, but only for processes using threadcpu percent of
+ * a processor or more, so the cost stays bounded on a box full of
+ * threaded servers.  Each process followed gets a table of its threads
+ * with the processor each used between samples, and the hottest few
+ * are shown in the interactive display and named in alerts.
+ */
+
+#define THREAD_MAX 512                /* Threads kept per process */
+#define THREAD_HOT 3                  /* Hottest threads reported */
+#define DEFAULT_THREAD_CPU 50         /* % processor a process needs to be descended into */
+#define THREAD_IDLE 30                /* Seconds a table is kept after its last update */
+
+typedef struct
+{
+    int tid;
+    char name[THREAD_NAME];
+    long cputime;                     /* ms of processor used so far */
+    unsigned long long sampletime;    /* Monotonic ns of the last sample */
+    int percent;                      /* % processor between the last two samples */
+    int seen;                         /* In the last update */
+}thread_usage;
+
+typedef struct
+{
+    int slot;                         /* History slot, -1 if the table is free */
+    int pid;
+    long updated;                     /* When it was last updated */
+    int nthreads;
+    int nhot;
+    int hot[THREAD_HOT];              /* Indices into threads, hottest first */
+    thread_usage threads[THREAD_MAX];
+}thread_table;
+
+/* Is this a command threadprocs asks to follow */
+int threads_wanted(unsigned int name);
+
+/* Fold the samples of one process's threads into its table.
+ * Called with procchart_mutex held.
+ */
+void threads_update(int slot, thread_sample *ts, int n, long now);
+
+/* Fetch the thread table of a slot, NULL if it has none */
+thread_table* threads_get(int slot);
+
+/* Fetch table i of MAX_THREAD_PROCS, NULL if it is not in use */
+thread_table* threads_at(int i);
+
+/* Drop the thread table of a slot whose history is released */
+void threads_forget(int slot);
+
+/* Free the tables */
+void threads_free(void);
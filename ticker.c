@@ -0,0 +1,191 @@
+/* Copyright (c) 2008, Matthew W. Jones
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, 
+ *   this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice, 
+ *   this list of conditions and the following disclaimer in the documentation 
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* ProcAn cycle scheduling */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#if defined (linux)
+#include <stdint.h>
+#include <poll.h>
+#include <sys/timerfd.h>
+#endif
+#include "procan.h"
+#include "instrument.h"
+#include "ticker.h"
+
+int cycle_interval(int configured)
+{
+    int interval = (configured > 0) ? configured : DEFAULT_CYCLE_INTERVAL;
+    if (interval < MIN_CYCLE_INTERVAL)
+        interval = MIN_CYCLE_INTERVAL;
+    if (interval > MAX_CYCLE_INTERVAL)
+        interval = MAX_CYCLE_INTERVAL;
+    return interval;
+}
+
+static void ns_to_timespec(unsigned long long ns, struct timespec *ts)
+{
+    ts->tv_sec = ns / 1000000000ULL;
+    ts->tv_nsec = ns % 1000000000ULL;
+}
+
+void ticker_init(ticker *t, int hist)
+{
+    t->fd = -1;
+    t->hist = hist;
+    t->interval = 0;
+    t->deadline = 0;
+    t->last = instr_now();
+    t->elapsed = 0;
+    t->overruns = 0;
+    t->nwake = 0;
+#if defined (linux)
+    t->fd = timerfd_create(CLOCK_MONOTONIC, 0);
+#endif
+}
+
+/* Start counting ticks from now */
+static void ticker_arm(ticker *t, unsigned long long interval)
+{
+    t->interval = interval;
+    t->deadline = instr_now() + interval;
+#if defined (linux)
+    if (t->fd >= 0)
+        {
+            struct itimerspec its;
+            ns_to_timespec(t->deadline, &its.it_value);
+            ns_to_timespec(interval, &its.it_interval);
+            if (timerfd_settime(t->fd, TFD_TIMER_ABSTIME, &its, NULL) == -1)
+                {
+                    close(t->fd);
+                    t->fd = -1;
+                }
+        }
+#endif
+}
+
+void ticker_watch(ticker *t, int fd)
+{
+    if (t->nwake < TICKER_WAKE)
+        t->wake[t->nwake++] = fd;
+}
+
+#if defined (linux)
+/* Wait for the timerfd or a watched descriptor, returns 1 if a watched
+ * one ended the wait.  A descriptor that fails is no longer watched.
+ */
+static int wait_wake(ticker *t)
+{
+    struct pollfd fds[TICKER_WAKE + 1];
+    int i, woke = 0;
+
+    fds[0].fd = t->fd;
+    fds[0].events = POLLIN;
+    for (i = 0; i < t->nwake; i++)
+        {
+            fds[i+1].fd = t->wake[i];
+            fds[i+1].events = POLLPRI;
+        }
+    while (poll(fds, t->nwake + 1, -1) == -1 && errno == EINTR)
+        ;
+    if (fds[0].revents & POLLIN)
+        return 0;
+    for (i = t->nwake - 1; i >= 0; i--)
+        {
+            if (fds[i+1].revents & (POLLERR | POLLNVAL))
+                t->wake[i] = t->wake[--t->nwake];
+            else if (fds[i+1].revents & POLLPRI)
+                woke = 1;
+        }
+    return woke;
+}
+#endif
+
+int ticker_wait(ticker *t, unsigned long long interval)
+{
+    unsigned long long now;
+    struct timespec ts;
+    int missed = 0;
+
+    if (interval != t->interval)
+        ticker_arm(t, interval);
+#if defined (linux)
+    if (t->fd >= 0)
+        {
+            uint64_t expirations = 0;
+            int n;
+            if (t->nwake > 0 && wait_wake(t))
+                return -1;
+            while ((n = read(t->fd, &expirations, sizeof(expirations))) == -1 && errno == EINTR)
+                ;
+            if (n == sizeof(expirations) && expirations > 1)
+                missed = (int)(expirations - 1);
+            t->deadline = t->deadline + (missed + 1) * interval;
+        }
+    else
+#endif
+        {
+            /* Deadlines are absolute, a sleep that wakes late or a
+             * signal cutting it short does not move the next one.
+             */
+            now = instr_now();
+            if (now >= t->deadline)
+                missed = (int)((now - t->deadline) / interval);
+            else
+                {
+                    while (now < t->deadline)
+                        {
+                            ns_to_timespec(t->deadline - now, &ts);
+                            nanosleep(&ts, NULL);
+                            now = instr_now();
+                        }
+                }
+            t->deadline = t->deadline + (missed + 1) * interval;
+        }
+
+    now = instr_now();
+    t->elapsed = now - t->last;
+    t->last = now;
+    instr_record(t->hist, t->elapsed);
+    if (missed > 0)
+        {
+            t->overruns = t->overruns + missed;
+            instr_record(INSTR_OVERRUNS, missed);
+        }
+    return missed;
+}
+
+void ticker_free(ticker *t)
+{
+    if (t->fd >= 0)
+        close(t->fd);
+    t->fd = -1;
+}
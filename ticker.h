@@ -0,0 +1,46 @@
+/* ProcAn cycle scheduling
+ * The collector and analyzer run on absolute CLOCK_MONOTONIC deadlines
+ * so their period does not stretch by the time each cycle takes.
+ */
+
+#define DEFAULT_CYCLE_INTERVAL 1000   /* ms in one analysis cycle by default */
+#define MIN_CYCLE_INTERVAL 100        /* Shortest interval we accept */
+#define MAX_CYCLE_INTERVAL 10000      /* History slots expire after 30s unseen */
+#define TICKER_WAKE 4                 /* Descriptors that can cut a wait short */
+
+typedef struct
+{
+  int fd;                          /* timerfd, -1 when sleeping on our own deadlines */
+  int hist;                        /* Histogram the measured intervals go to */
+  unsigned long long interval;     /* ns between ticks */
+  unsigned long long deadline;     /* Next tick on the monotonic clock */
+  unsigned long long last;         /* When the previous wait returned */
+  unsigned long long elapsed;      /* Actual ns between the last two ticks */
+  unsigned long overruns;          /* Ticks missed because a cycle ran long */
+  int wake[TICKER_WAKE];           /* Descriptors whose urgent events end a wait early */
+  int nwake;
+}ticker;
+
+/* Length of one analysis cycle in ms from the value of the interval
+ * config key, 0 for the default.  The caller reads the key under
+ * pconfig_mutex or from a copy of it.
+ */
+int cycle_interval(int configured);
+
+/* Set up a ticker, the measured intervals are recorded into hist */
+void ticker_init(ticker *t, int hist);
+
+/* Wait for the next tick, interval ns after the previous one.  The
+ * ticker is rearmed if interval changed.  Returns the number of ticks
+ * missed because the caller overran its deadline, or -1 if a watched
+ * descriptor woke it before the tick.
+ */
+int ticker_wait(ticker *t, unsigned long long interval);
+
+/* Also end waits when fd has an urgent (POLLPRI) event, such as a
+ * pressure trigger firing.  Only honoured with a timerfd.
+ */
+void ticker_watch(ticker *t, int fd);
+
+/* Release a ticker */
+void ticker_free(ticker *t);
@@ -0,0 +1,182 @@
+/* Copyright (c) 2008, Matthew W. Jones
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice, 
+ *   this list of conditions and the following disclaimer.
+ * * Redistributions in binary form must reproduce the above copyright notice, 
+ *   this list of conditions and the following disclaimer in the documentation 
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* ProcAn process trees */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "procan.h"
+#include "tree.h"
+
+extern proc_averages *procavs;
+extern history_columns hcols;
+extern int numprocavs;
+
+static tree_node *nodes = NULL;
+
+void tree_reserve(int oldn, int n)
+{
+    if ((nodes = realloc(nodes, n * sizeof(tree_node))) == NULL)
+        {
+            printf("malloc error, can not allocate memory.\n");
+            exit(-1);
+        }
+    memset(&nodes[oldn], 0, (n - oldn) * sizeof(tree_node));
+}
+
+void tree_free(void)
+{
+    free(nodes);
+    nodes = NULL;
+}
+
+void tree_init(int slot)
+{
+    memset(&nodes[slot], 0, sizeof(tree_node));
+    nodes[slot].parent = -1;
+    nodes[slot].child = -1;
+    nodes[slot].next = -1;
+    nodes[slot].prev = -1;
+}
+
+/* Add sign times d to the subtree sums of slot and its ancestors */
+static void carry(int slot, tree_sums *d, int sign)
+{
+    int s;
+
+    for (s = slot; s >= 0; s = nodes[s].parent)
+        {
+            nodes[s].sub.count += sign * d->count;
+            nodes[s].sub.percent += sign * d->percent;
+            nodes[s].sub.rssize += sign * d->rssize;
+            nodes[s].sub.score += sign * d->score;
+            nodes[s].sub.intrests += sign * d->intrests;
+        }
+}
+
+void tree_attach(int slot, int parent)
+{
+    tree_node *n = &nodes[slot];
+    int p;
+
+    for (p = parent; p >= 0; p = nodes[p].parent)
+        {
+            if (p == slot)
+                {
+                    parent = -1;
+                    break;
+                }
+        }
+    if (n->parent == parent)
+        return;
+    if (n->parent >= 0)
+        {
+            carry(n->parent, &n->sub, -1);
+            if (n->prev >= 0)
+                nodes[n->prev].next = n->next;
+            else
+                nodes[n->parent].child = n->next;
+            if (n->next >= 0)
+                nodes[n->next].prev = n->prev;
+        }
+    n->parent = parent;
+    n->prev = -1;
+    n->next = -1;
+    if (parent >= 0)
+        {
+            n->next = nodes[parent].child;
+            if (n->next >= 0)
+                nodes[n->next].prev = slot;
+            nodes[parent].child = slot;
+            carry(parent, &n->sub, 1);
+        }
+}
+
+void tree_remove(int slot)
+{
+    int c, next;
+
+    tree_attach(slot, -1);
+    for (c = nodes[slot].child; c >= 0; c = next)
+        {
+            next = nodes[c].next;
+            nodes[c].parent = -1;
+            nodes[c].next = -1;
+            nodes[c].prev = -1;
+        }
+    tree_init(slot);
+}
+
+void tree_update(int slot)
+{
+    tree_node *n = &nodes[slot];
+    tree_sums d;
+
+    d.count = 1 - n->own.count;
+    d.percent = hcols.last_percent[slot] - n->own.percent;
+    d.rssize = hcols.last_rssize[slot] - n->own.rssize;
+    d.score = hcols.intrest_score[slot] - n->own.score;
+    d.intrests = procavs[slot].num_intrests - n->own.intrests;
+    if (d.count == 0 && d.percent == 0 && d.rssize == 0 && d.score == 0 && d.intrests == 0)
+        return;
+    n->own.count = 1;
+    n->own.percent = hcols.last_percent[slot];
+    n->own.rssize = hcols.last_rssize[slot];
+    n->own.score = hcols.intrest_score[slot];
+    n->own.intrests = procavs[slot].num_intrests;
+    carry(slot, &d, 1);
+}
+
+int tree_parent(int slot)
+{
+    return nodes[slot].parent;
+}
+
+tree_node* tree_get(int slot)
+{
+    return &nodes[slot];
+}
+
+int tree_top(int *order, int max)
+{
+    int j, i, n = 0;
+
+    for (j = 0; j < numprocavs; j++)
+        {
+            if (nodes[j].sub.count < 2 || procavs[j].lastpid == 1 ||
+                (nodes[j].parent >= 0 && procavs[nodes[j].parent].lastpid != 1))
+                continue;
+            if (n < max)
+                i = n++;
+            else if (max > 0 && nodes[order[max-1]].sub.rssize < nodes[j].sub.rssize)
+                i = max - 1;
+            else
+                continue;
+            for (; i > 0 && nodes[order[i-1]].sub.rssize < nodes[j].sub.rssize; i--)
+                order[i] = order[i-1];
+            order[i] = j;
+        }
+    return n;
+}
@@ -0,0 +1,60 @@
+/* ProcAn process trees
+ * Links the history slots into the parent/child tree of their
+ * processes and keeps sums of processor load, resident set, score and
+ * interest over every subtree, so a forking service is charged for
+ * what its children use.  A change to a slot is carried up to its
+ * ancestors, O(depth) rather than a rebuild of the tree.  Only touched
+ * with procchart_mutex held.
+ */
+
+typedef struct
+{
+    int count;                /* Slots in the subtree */
+    int percent;
+    long long rssize;
+    int score;
+    int intrests;
+}tree_sums;
+
+typedef struct
+{
+    int parent;               /* Slot of the parent process, -1 if it is not tracked */
+    int child;                /* First child slot, -1 if none */
+    int next;                 /* Siblings under the same parent, -1 at the ends */
+    int prev;
+    tree_sums own;            /* What the slot itself adds */
+    tree_sums sub;            /* Sums over the slot and everything below it */
+}tree_node;
+
+/* Make room for tree nodes of slots [oldn, n) */
+void tree_reserve(int oldn, int n);
+
+/* Free the tree */
+void tree_free(void);
+
+/* Start a freshly set up slot as a tree of its own */
+void tree_init(int slot);
+
+/* Move a slot and its subtree under parent, -1 to make it a root.
+ * A parent that is the slot itself or below it is taken as -1.
+ */
+void tree_attach(int slot, int parent);
+
+/* Take a slot out of the tree, its children become roots */
+void tree_remove(int slot);
+
+/* Bring a slot's own figures up to date and carry the change up */
+void tree_update(int slot);
+
+/* Parent slot of a slot, -1 for a root */
+int tree_parent(int slot);
+
+/* Fetch a slot's node */
+tree_node* tree_get(int slot);
+
+/* Fill order with up to max slots heading a tree of more than one
+ * process, largest resident set first.  A tree is headed by a root or a
+ * child of init, so services are listed rather than init itself.
+ * Returns how many were filled.
+ */
+int tree_top(int *order, int max);